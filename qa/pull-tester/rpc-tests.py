@@ -144,6 +144,8 @@ testScripts = [
     'signmessages.py',
     'p2p-compactblocks.py',
     'nulldummy.py',
+    'oerusignal.py',
+    'stratum.py',
 ]
 if ENABLE_ZMQ:
     testScripts.append('zmq_test.py')
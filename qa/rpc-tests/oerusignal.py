@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The e-Gulden Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the OeruSignal dispatcher against a local stand-in endpoint:
+# block acceptance must not wait for the endpoint, and failed signals
+# are retried.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+import http.server
+import threading
+import time
+
+ENDPOINT_DELAY = 5
+
+class SlowSignalHandler(http.server.BaseHTTPRequestHandler):
+    def do_GET(self):
+        self.server.paths.append(self.path)
+        time.sleep(ENDPOINT_DELAY)
+        # Fail the first request so the dispatcher has to retry
+        self.send_response(500 if len(self.server.paths) == 1 else 200)
+        self.end_headers()
+
+    def log_message(self, format, *args):
+        pass
+
+class OeruSignalTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 1
+        self.setup_clean_chain = False
+
+    def setup_network(self):
+        self.server = http.server.HTTPServer(('127.0.0.1', 0), SlowSignalHandler)
+        self.server.paths = []
+        self.server_thread = threading.Thread(target=self.server.serve_forever)
+        self.server_thread.daemon = True
+        self.server_thread.start()
+
+        endpoint = "127.0.0.1:%d" % self.server.server_address[1]
+        self.nodes = start_nodes(1, self.options.tmpdir, [["-uacomment=oerutest", "-oerusignalendpoint=" + endpoint,
+                                                           "-oerusignaltimeout=30", "-debug=OeruSignal"]])
+        self.is_network_split = False
+
+    def run_test(self):
+        node = self.nodes[0]
+        assert_equal(node.getoerusignalinfo()["queued"], 0)
+
+        # The first block queues a signal; accepting it must not wait for the endpoint
+        start = time.time()
+        node.generate(1)
+        elapsed = time.time() - start
+        assert(elapsed < ENDPOINT_DELAY / 2)
+        assert_equal(node.getoerusignalinfo()["queued"], 1)
+
+        # Later blocks are rate limited and accepted just as fast
+        start = time.time()
+        node.generate(5)
+        assert(time.time() - start < ENDPOINT_DELAY / 2)
+        assert_equal(node.getoerusignalinfo()["queued"], 1)
+
+        # The failed first attempt is retried after a backoff
+        timeout = time.time() + 4 * ENDPOINT_DELAY
+        while node.getoerusignalinfo()["sent"] < 1:
+            assert(time.time() < timeout)
+            time.sleep(0.5)
+
+        info = node.getoerusignalinfo()
+        assert_equal(info["retries"], 1)
+        assert_equal(info["failed"], 0)
+        assert_equal(info["queuesize"], 0)
+        assert_equal(info["laststatus"], 200)
+        assert(info["lastlatency"] >= ENDPOINT_DELAY * 1000)
+        assert_equal(len(self.server.paths), 2)
+        assert(self.server.paths[0].startswith("/oerutest:"))
+
+        self.server.shutdown()
+
+if __name__ == '__main__':
+    OeruSignalTest().main()
@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The e-Gulden Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the built-in stratum server with a scripted stratum v1 client:
+# jobs follow the tip, shares are checked against the share target and
+# solved blocks are submitted by the server.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+from test_framework.address import script_to_p2sh
+from test_framework.script import CScript, OP_TRUE
+from test_framework.mininode import CTransaction, FromHex, ToHex, hash256
+
+import json
+import litecoin_scrypt
+import socket
+import struct
+
+class StratumClient(object):
+    def __init__(self, port):
+        self.sock = socket.create_connection(('127.0.0.1', port), timeout=30)
+        self.buf = b''
+        self.next_id = 1
+        self.notifications = []
+
+    def read(self):
+        while b'\n' not in self.buf:
+            data = self.sock.recv(4096)
+            assert(data)
+            self.buf += data
+        line, self.buf = self.buf.split(b'\n', 1)
+        return json.loads(line.decode())
+
+    def call(self, method, params):
+        req_id = self.next_id
+        self.next_id += 1
+        self.sock.sendall((json.dumps({'id': req_id, 'method': method, 'params': params}) + '\n').encode())
+        while True:
+            msg = self.read()
+            if msg.get('id') == req_id:
+                return msg
+            self.notifications.append(msg)
+
+    def wait_for(self, method):
+        while True:
+            msg = self.notifications.pop(0) if self.notifications else self.read()
+            if msg.get('method') == method:
+                return msg['params']
+
+class Job(object):
+    def __init__(self, params, extranonce1):
+        (self.job_id, prevhash, coinb1, coinb2, branch, version, nbits, ntime, self.clean) = params
+        self.extranonce1 = extranonce1
+        self.prevhash = b''.join(bytes.fromhex(prevhash)[i:i+4][::-1] for i in range(0, 32, 4))
+        self.coinb1 = bytes.fromhex(coinb1)
+        self.coinb2 = bytes.fromhex(coinb2)
+        self.branch = [bytes.fromhex(h) for h in branch]
+        self.version = int(version, 16)
+        self.nbits = int(nbits, 16)
+        self.ntime = int(ntime, 16)
+
+    def header(self, extranonce2, nonce):
+        root = hash256(self.coinb1 + self.extranonce1 + extranonce2 + self.coinb2)
+        for h in self.branch:
+            root = hash256(root + h)
+        return (struct.pack('<i', self.version) + self.prevhash + root +
+                struct.pack('<III', self.ntime, self.nbits, nonce))
+
+def pow_hash(header):
+    return int.from_bytes(litecoin_scrypt.getPoWHash(header), 'little')
+
+def block_target(nbits):
+    return (nbits & 0xffffff) << (8 * ((nbits >> 24) - 3))
+
+def share_target(difficulty):
+    # Scrypt miners count difficulty 1 as 0x0000ffff << 224 times 65536
+    return (0xffff << 240) // difficulty
+
+def submit_params(job, extranonce2, nonce):
+    return ['worker', job.job_id, extranonce2.hex(), '%08x' % job.ntime, '%08x' % nonce]
+
+def find_nonce(job, extranonce2, accept):
+    nonce = 0
+    while not accept(pow_hash(job.header(extranonce2, nonce))):
+        nonce += 1
+    return nonce
+
+class StratumTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+        self.address = script_to_p2sh(CScript([OP_TRUE]))
+
+    def start_stratum_node(self, difficulty):
+        self.stratum_port = rpc_port(0) + PORT_RANGE
+        self.nodes = [start_node(0, self.options.tmpdir, ["-stratum", "-stratumport=%d" % self.stratum_port,
+                                                          "-stratumaddress=" + self.address,
+                                                          "-stratumdifficulty=" + difficulty, "-debug=stratum"])]
+
+    def setup_network(self):
+        # Difficulty 1: almost every hash is a share, about half are blocks
+        self.start_stratum_node("1")
+        self.is_network_split = False
+
+    def connect(self):
+        client = StratumClient(self.stratum_port)
+        reply = client.call('mining.subscribe', ['test/1.0'])
+        assert_equal(reply['error'], None)
+        extranonce1 = bytes.fromhex(reply['result'][1])
+        assert_equal(len(extranonce1), 4)
+        assert_equal(reply['result'][2], 4)
+        reply = client.call('mining.authorize', ['worker', 'x'])
+        assert_equal(reply['result'], True)
+        client.difficulty = client.wait_for('mining.set_difficulty')[0]
+        return client, extranonce1
+
+    def run_test(self):
+        node = self.nodes[0]
+        # Leave initial block download so the server hands out jobs, with a
+        # mature coinbase to spend
+        node.generatetoaddress(11, self.address)
+
+        client, extranonce1 = self.connect()
+        assert_equal(client.difficulty, 1)
+        job = Job(client.wait_for('mining.notify'), extranonce1)
+        assert_equal(job.clean, True)
+        assert_equal(job.prevhash[::-1].hex(), node.getbestblockhash())
+        assert_equal(job.branch, [])
+        target = block_target(job.nbits)
+
+        # New mempool transactions are picked up by the periodic refresh
+        spend = node.getblock(node.getblockhash(1))['tx'][0]
+        value = node.gettxout(spend, 0)['value']
+        tx = FromHex(CTransaction(), node.createrawtransaction([{'txid': spend, 'vout': 0}], {self.address: value - Decimal('0.01')}))
+        tx.vin[0].scriptSig = CScript([CScript([OP_TRUE])])
+        txid = node.sendrawtransaction(ToHex(tx))
+        job = Job(client.wait_for('mining.notify'), extranonce1)
+        assert_equal(job.clean, False)
+        assert_equal(job.branch, [bytes.fromhex(txid)[::-1]])
+
+        # Submitting needs a subscription
+        other = StratumClient(self.stratum_port)
+        reply = other.call('mining.submit', submit_params(job, b'\0' * 4, 0))
+        assert_equal(reply['error'][0], 25)
+
+        # A difficulty 1 share, as a miner told difficulty 1 finds them, is
+        # accepted; it does not meet the block target and so does not change the tip
+        extranonce2 = bytes.fromhex('00000001')
+        nonce = find_nonce(job, extranonce2, lambda h: target < h <= share_target(1))
+        reply = client.call('mining.submit', submit_params(job, extranonce2, nonce))
+        assert_equal(reply['result'], True)
+        assert_equal(node.getblockcount(), 11)
+
+        reply = client.call('mining.submit', submit_params(job, extranonce2, nonce))
+        assert_equal(reply['error'][0], 22)
+        reply = client.call('mining.submit', submit_params(job, b'\0\0\0', nonce))
+        assert_equal(reply['error'][0], 20)
+
+        # A solved block is submitted, and a clean job follows the new tip
+        nonce = find_nonce(job, extranonce2, lambda h: h <= target)
+        reply = client.call('mining.submit', submit_params(job, extranonce2, nonce))
+        assert_equal(reply['result'], True)
+        assert_equal(node.getblockcount(), 12)
+        blockhash = node.getbestblockhash()
+        assert_equal(hash256(job.header(extranonce2, nonce))[::-1].hex(), blockhash)
+        block = node.getblock(blockhash)
+        assert_equal(block['tx'][1], txid)
+        coinbase = block['tx'][0]
+        assert_equal(node.gettxout(coinbase, 0)['scriptPubKey']['addresses'], [self.address])
+
+        newjob = Job(client.wait_for('mining.notify'), extranonce1)
+        assert_equal(newjob.clean, True)
+        assert_equal(newjob.prevhash[::-1].hex(), blockhash)
+
+        # Shares for jobs on the old tip are stale
+        reply = client.call('mining.submit', submit_params(job, b'\0\0\0\2', 0))
+        assert_equal(reply['error'][0], 21)
+
+        # Blocks found by other means also start a clean job
+        node.generatetoaddress(1, self.address)
+        newjob = Job(client.wait_for('mining.notify'), extranonce1)
+        assert_equal(newjob.clean, True)
+        assert_equal(newjob.prevhash[::-1].hex(), node.getbestblockhash())
+
+        # Difficulty 65536 is harder than the regtest block target: hashes
+        # above it are low difficulty shares, while blocks are still accepted
+        stop_node(node, 0)
+        self.start_stratum_node("65536")
+        node = self.nodes[0]
+        client, extranonce1 = self.connect()
+        assert_equal(client.difficulty, 65536)
+        job = Job(client.wait_for('mining.notify'), extranonce1)
+        target = block_target(job.nbits)
+        assert(share_target(65536) < target)
+        nonce = find_nonce(job, extranonce2, lambda h: h > target)
+        reply = client.call('mining.submit', submit_params(job, extranonce2, nonce))
+        assert_equal(reply['error'][0], 23)
+        height = node.getblockcount()
+        nonce = find_nonce(job, extranonce2, lambda h: h <= target)
+        reply = client.call('mining.submit', submit_params(job, extranonce2, nonce))
+        assert_equal(reply['result'], True)
+        assert_equal(node.getblockcount(), height + 1)
+
+if __name__ == '__main__':
+    StratumTest().main()
@@ -169,6 +169,11 @@ public:
     base_uint& operator*=(uint32_t b32);
     base_uint& operator*=(const base_uint& b);
     base_uint& operator/=(const base_uint& b);
+    /**
+     * Same result as operator/=(base_uint(b32)), using one 64-bit division
+     * per limb instead of a shift-and-subtract per bit.
+     */
+    base_uint& DivideUint32(uint32_t b32);
 
     base_uint& operator++()
     {
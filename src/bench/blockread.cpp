@@ -0,0 +1,141 @@
+// Copyright (c) 2026 The e-Gulden Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "blockfilemap.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "main.h"
+#include "streams.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/filesystem.hpp>
+
+/** A block of nTx transactions written to a block file in a temporary datadir, and its index entry. */
+class CBenchBlockFile
+{
+    boost::filesystem::path pathTemp;
+
+public:
+    CBlock block;
+    uint256 hash;
+    CDiskBlockPos pos;
+    CBlockIndex index;
+
+    CBenchBlockFile(unsigned int nTx, unsigned int nValidity)
+    {
+        SelectParams(CBaseChainParams::MAIN);
+        const CChainParams& chainparams = Params();
+        pathTemp = boost::filesystem::temp_directory_path() / strprintf("bench_egulden_%lu", (unsigned long)GetTimeMicros());
+        mapArgs["-datadir"] = pathTemp.string();
+        ClearDatadirCache();
+
+        block = chainparams.GenesisBlock();
+        block.vtx.resize(nTx, block.vtx[0]);
+        pos = CDiskBlockPos(0, 0);
+        if (!WriteBlockToDisk(block, pos, chainparams.MessageStart()))
+            throw std::runtime_error("WriteBlockToDisk failed");
+
+        hash = block.GetHash();
+        index = CBlockIndex(block);
+        index.phashBlock = &hash;
+        index.nFile = pos.nFile;
+        index.nDataPos = pos.nPos;
+        index.nStatus = BLOCK_HAVE_DATA | nValidity;
+    }
+
+    ~CBenchBlockFile()
+    {
+        boost::filesystem::remove_all(pathTemp);
+        mapArgs.erase("-datadir");
+        ClearDatadirCache();
+    }
+};
+
+/**
+ * Read a ~250 kB block back through ReadBlockFromDisk(CBlockIndex*), as done
+ * for every block served to a peer, for an index entry that was never
+ * validated (scrypt check) and one at BLOCK_VALID_TREE (trusted). With
+ * fMapped the block is read from its mapped file instead, as it is for
+ * files that are no longer appended to.
+ */
+static void ReadBlockFromDiskServing(benchmark::State& state, unsigned int nValidity, bool fMapped = false, unsigned int nTx = 1000)
+{
+    CBenchBlockFile file(nTx, nValidity);
+    CBlock blockRead;
+    CBlockFileMap files;
+    while (state.KeepRunning()) {
+        if (fMapped) {
+            if (!files.ReadBlock(file.pos, blockRead) || blockRead.GetHash() != file.hash)
+                throw std::runtime_error("CBlockFileMap::ReadBlock failed");
+        } else if (!ReadBlockFromDisk(blockRead, &file.index, Params().GetConsensus()))
+            throw std::runtime_error("ReadBlockFromDisk failed");
+    }
+}
+
+/**
+ * Answer a getdata for the ~250 kB block: read it and serialize it into a
+ * send buffer. Decoded, as for witness stripping; raw, copying the stored
+ * bytes from the block file; or raw from the mapped file.
+ */
+static void ServeBlock(benchmark::State& state, bool fRaw, bool fMapped)
+{
+    CBenchBlockFile file(1000, BLOCK_VALID_TREE);
+    CBlockFileMap files;
+    while (state.KeepRunning()) {
+        CDataStream ssSend(SER_NETWORK, PROTOCOL_VERSION);
+        if (!fRaw) {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, &file.index, Params().GetConsensus()))
+                throw std::runtime_error("ReadBlockFromDisk failed");
+            ssSend << block;
+        } else {
+            CMappedBlock rawBlock;
+            std::vector<char> vchRawBlock;
+            if (fMapped ? !files.GetBlock(file.pos, rawBlock) : !ReadRawBlockFromDisk(rawBlock, vchRawBlock, &file.index))
+                throw std::runtime_error("ReadRawBlockFromDisk failed");
+            ssSend << CFlatData((void*)rawBlock.pbegin, (void*)rawBlock.pend);
+        }
+    }
+}
+
+static void ReadBlockFromDiskUnvalidated(benchmark::State& state)
+{
+    ReadBlockFromDiskServing(state, BLOCK_VALID_UNKNOWN);
+}
+
+static void ReadBlockFromDiskValidTree(benchmark::State& state)
+{
+    ReadBlockFromDiskServing(state, BLOCK_VALID_TREE);
+}
+
+static void ReadBlockFromDiskMapped(benchmark::State& state)
+{
+    ReadBlockFromDiskServing(state, BLOCK_VALID_TREE, true);
+}
+
+// A nearly empty block, where opening and seeking the file dominate
+static void ReadSmallBlockFromDisk(benchmark::State& state)
+{
+    ReadBlockFromDiskServing(state, BLOCK_VALID_TREE, false, 2);
+}
+
+static void ReadSmallBlockFromDiskMapped(benchmark::State& state)
+{
+    ReadBlockFromDiskServing(state, BLOCK_VALID_TREE, true, 2);
+}
+
+static void ServeBlockDecoded(benchmark::State& state) { ServeBlock(state, false, false); }
+static void ServeBlockRaw(benchmark::State& state) { ServeBlock(state, true, false); }
+static void ServeBlockRawMapped(benchmark::State& state) { ServeBlock(state, true, true); }
+
+BENCHMARK(ReadBlockFromDiskUnvalidated);
+BENCHMARK(ReadBlockFromDiskValidTree);
+BENCHMARK(ReadBlockFromDiskMapped);
+BENCHMARK(ReadSmallBlockFromDisk);
+BENCHMARK(ReadSmallBlockFromDiskMapped);
+BENCHMARK(ServeBlockDecoded);
+BENCHMARK(ServeBlockRaw);
+BENCHMARK(ServeBlockRawMapped);
@@ -0,0 +1,115 @@
+// Copyright (c) 2026 The e-Gulden Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "main.h"
+#include "miner.h"
+#include "primitives/transaction.h"
+#include "txmempool.h"
+
+static CMutableTransaction MakeTx(uint32_t n, const uint256& hashPrev)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vin[0].prevout.hash = hashPrev;
+    tx.vin[0].prevout.n = n;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1;
+    tx.vout[0].nValue = 10 * COIN;
+    return tx;
+}
+
+static void AddTx(const CTransaction& tx, CAmount nFee)
+{
+    LockPoints lp;
+    mempool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, nFee, 0, 0.0, 1, false, 0, false, 4, lp));
+}
+
+/**
+ * Block templates over a mempool of nTx transactions: a third of them are
+ * children of another, so package selection has ancestors to account for.
+ * A full assembly starts from scratch; an incremental one appends a newly
+ * accepted low fee transaction to the last selection.
+ */
+static void BlockTemplate(benchmark::State& state, size_t nTx, bool fIncremental)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    uint256 hashTip = uint256S("0x01");
+    CBlockIndex tip;
+    tip.phashBlock = &hashTip;
+    tip.nHeight = 0;
+    tip.nTime = 1500000000;
+
+    mempool.clear();
+    uint256 hashFunding = uint256S("0x02");
+    for (size_t i = 0; i < nTx; i++) {
+        CTransaction tx(MakeTx(i, hashFunding));
+        AddTx(tx, 1000 + (i * 7919) % 50000);
+        if (i % 2 == 0 && ++i < nTx)
+            AddTx(MakeTx(0, tx.GetHash()), 1000 + (i * 104729) % 50000);
+    }
+
+    BlockTemplateEngine engine(Params());
+    engine.UpdateSelection(&tip);
+    uint32_t n = nTx;
+    while (state.KeepRunning()) {
+        if (fIncremental) {
+            AddTx(MakeTx(n++, hashFunding), 100);
+        } else {
+            engine.SetStale();
+        }
+        engine.UpdateSelection(&tip);
+    }
+    mempool.clear();
+}
+
+/**
+ * An extranonce change on a block of nTx transactions, recomputing the
+ * whole merkle tree or only the coinbase's branch of it.
+ */
+static void ExtraNonce(benchmark::State& state, size_t nTx, bool fBranch)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    CBlockIndex tip;
+    tip.nHeight = 0;
+
+    CBlock block;
+    CMutableTransaction coinbase = MakeTx(0, uint256());
+    coinbase.vin[0].prevout.SetNull();
+    block.vtx.push_back(coinbase);
+    uint256 hashFunding = uint256S("0x02");
+    for (size_t i = 1; i < nTx; i++)
+        block.vtx.push_back(MakeTx(i, hashFunding));
+    std::vector<uint256> vBranch = BlockMerkleBranch(block, 0);
+
+    unsigned int nExtraNonce = 0;
+    while (state.KeepRunning()) {
+        if (fBranch)
+            IncrementExtraNonce(&block, &tip, nExtraNonce, vBranch);
+        else
+            IncrementExtraNonce(&block, &tip, nExtraNonce);
+    }
+}
+
+static void BlockTemplateFull10k(benchmark::State& state) { BlockTemplate(state, 10000, false); }
+static void BlockTemplateFull50k(benchmark::State& state) { BlockTemplate(state, 50000, false); }
+static void BlockTemplateFull100k(benchmark::State& state) { BlockTemplate(state, 100000, false); }
+static void BlockTemplateIncremental10k(benchmark::State& state) { BlockTemplate(state, 10000, true); }
+static void BlockTemplateIncremental50k(benchmark::State& state) { BlockTemplate(state, 50000, true); }
+static void BlockTemplateIncremental100k(benchmark::State& state) { BlockTemplate(state, 100000, true); }
+static void ExtraNonceMerkleRoot(benchmark::State& state) { ExtraNonce(state, 4000, false); }
+static void ExtraNonceMerkleBranch(benchmark::State& state) { ExtraNonce(state, 4000, true); }
+
+BENCHMARK(BlockTemplateFull10k);
+BENCHMARK(BlockTemplateFull50k);
+BENCHMARK(BlockTemplateFull100k);
+BENCHMARK(BlockTemplateIncremental10k);
+BENCHMARK(BlockTemplateIncremental50k);
+BENCHMARK(BlockTemplateIncremental100k);
+BENCHMARK(ExtraNonceMerkleRoot);
+BENCHMARK(ExtraNonceMerkleBranch);
@@ -0,0 +1,107 @@
+// Copyright (c) 2026 The e-Gulden Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "coins.h"
+#include "hash.h"
+#include "main.h"
+#include "txdb.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+static const uint32_t COINS_BENCH_TXS = 200000;
+static const unsigned int COINS_BENCH_BLOCK_INPUTS = 4000;
+
+static uint256 BenchTxid(uint32_t n)
+{
+    unsigned char buf[4];
+    WriteLE32(buf, n);
+    return Hash(buf, buf + sizeof(buf));
+}
+
+static std::vector<CCoinsPrefetch> BlockInputs(const CCoinsViewCache& tip, std::vector<uint256>& vInputs, uint32_t& n)
+{
+    std::vector<CCoinsPrefetch> vPrefetch;
+    vInputs.clear();
+    for (unsigned int i = 0; i < COINS_BENCH_BLOCK_INPUTS; i++, n += 7919) {
+        vInputs.push_back(BenchTxid(n % COINS_BENCH_TXS));
+        vPrefetch.push_back(CCoinsPrefetch(tip, vInputs.back()));
+    }
+    return vPrefetch;
+}
+
+/**
+ * Resolve and spend the inputs of a run of large blocks against pcoinsTip
+ * backed by an on-disk chainstate, as ConnectBlock does, flushing whenever
+ * the cache exceeds a small -dbcache. With nThreads workers, the inputs of
+ * each block are queued for prefetching while the one before it connects,
+ * as ActivateBestChainStep does; without, the owner reads them all itself.
+ */
+static void CoinsConnectInputs(benchmark::State& state, int nThreads)
+{
+    boost::filesystem::path pathTemp = boost::filesystem::temp_directory_path() / strprintf("bench_egulden_%lu", (unsigned long)GetTimeMicros());
+    mapArgs["-datadir"] = pathTemp.string();
+    ClearDatadirCache();
+    {
+        CCoinsViewDB db(8 << 20);
+        CCoinsViewCache tip(&db, COINS_TIP_SHARDS);
+        for (uint32_t i = 0; i < COINS_BENCH_TXS; i++) {
+            CCoinsModifier coins = tip.ModifyNewCoins(BenchTxid(i), false);
+            coins->nVersion = 1;
+            coins->nHeight = i / 1000;
+            coins->vout.resize(2);
+            for (unsigned int j = 0; j < coins->vout.size(); j++) {
+                coins->vout[j].nValue = 50 * COIN;
+                coins->vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(BenchTxid(i + j)) << OP_EQUALVERIFY << OP_CHECKSIG;
+            }
+        }
+        tip.SetBestBlock(BenchTxid(COINS_BENCH_TXS));
+        tip.Flush();
+
+        CCoinsPrefetchQueue queue(MAX_COINS_PREFETCH_QUEUED);
+        boost::thread_group threads;
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&CCoinsPrefetchQueue::Thread, &queue));
+
+        uint32_t n = 0;
+        std::vector<uint256> vInputs, vNext;
+        std::vector<CCoinsPrefetch> vPrefetch = BlockInputs(tip, vNext, n);
+        if (nThreads)
+            queue.Add(vPrefetch);
+        while (state.KeepRunning()) {
+            vInputs.swap(vNext);
+            vPrefetch = BlockInputs(tip, vNext, n);
+            if (nThreads)
+                queue.Add(vPrefetch);
+
+            CCoinsViewCache view(&tip);
+            for (unsigned int i = 0; i < vInputs.size(); i++) {
+                assert(view.HaveCoins(vInputs[i]));
+                view.ModifyCoins(vInputs[i])->Spend(0);
+            }
+            view.Flush();
+            if (tip.DynamicMemoryUsage() > (4 << 20)) {
+                tip.Flush();
+                if (nThreads)
+                    queue.Add(vPrefetch);
+            }
+        }
+        if (nThreads)
+            queue.Wait();
+        threads.interrupt_all();
+        threads.join_all();
+    }
+    boost::filesystem::remove_all(pathTemp);
+}
+
+static void CoinsConnectInputsSerial(benchmark::State& state) { CoinsConnectInputs(state, 0); }
+static void CoinsConnectInputsPrefetch2(benchmark::State& state) { CoinsConnectInputs(state, 2); }
+static void CoinsConnectInputsPrefetch4(benchmark::State& state) { CoinsConnectInputs(state, 4); }
+
+BENCHMARK(CoinsConnectInputsSerial);
+BENCHMARK(CoinsConnectInputsPrefetch2);
+BENCHMARK(CoinsConnectInputsPrefetch4);
@@ -0,0 +1,174 @@
+// Copyright (c) 2026 The e-Gulden Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "coins.h"
+#include "dbwrapper.h"
+#include "hash.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/filesystem.hpp>
+
+static const uint32_t PROFILE_BENCH_TXS = 200000;
+static const unsigned int PROFILE_BENCH_BLOCKS = 20;
+static const unsigned int PROFILE_BENCH_BLOCK_TXS = 1000;
+static const unsigned int PROFILE_BENCH_FLUSH_BLOCKS = 5;
+static const size_t PROFILE_BENCH_CACHE = 8 << 20;
+static const char DB_COINS = 'c';
+
+static uint256 BenchTxid(uint32_t n)
+{
+    unsigned char buf[4];
+    WriteLE32(buf, n);
+    return Hash(buf, buf + sizeof(buf));
+}
+
+static CCoins BenchCoins(uint32_t n, int nHeight)
+{
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = nHeight;
+    coins.vout.resize(2);
+    for (unsigned int j = 0; j < coins.vout.size(); j++) {
+        coins.vout[j].nValue = 50 * COIN;
+        coins.vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(BenchTxid(n + j)) << OP_EQUALVERIFY << OP_CHECKSIG;
+    }
+    return coins;
+}
+
+/** One chainstate access: a lookup, a write (an erase if the coins are pruned), or the end of a write batch. */
+struct CTraceEntry
+{
+    enum Type { READ, WRITE, COMMIT } type;
+    uint256 txid;
+    CCoins coins;
+
+    CTraceEntry(Type typeIn, const uint256& txidIn = uint256()) : type(typeIn), txid(txidIn) {}
+};
+
+/** In-memory base view that records every access a cache makes to it. */
+class CCoinsViewRecorder : public CCoinsView
+{
+public:
+    std::map<uint256, CCoins> mapCoins;
+    std::vector<CTraceEntry> vTrace;
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const
+    {
+        const_cast<CCoinsViewRecorder*>(this)->vTrace.push_back(CTraceEntry(CTraceEntry::READ, txid));
+        std::map<uint256, CCoins>::const_iterator it = mapCoins.find(txid);
+        if (it == mapCoins.end())
+            return false;
+        coins = it->second;
+        return true;
+    }
+
+    bool HaveCoins(const uint256& txid) const
+    {
+        CCoins coins;
+        return GetCoins(txid, coins);
+    }
+
+    bool BatchWrite(CCoinsMap& mapIn, const uint256& hashBlock)
+    {
+        for (CCoinsMap::iterator it = mapIn.begin(); it != mapIn.end(); it = mapIn.erase(it)) {
+            if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+                continue;
+            vTrace.push_back(CTraceEntry(CTraceEntry::WRITE, it->first));
+            vTrace.back().coins = it->second.coins;
+            if (it->second.coins.IsPruned())
+                mapCoins.erase(it->first);
+            else
+                mapCoins[it->first] = it->second.coins;
+        }
+        vTrace.push_back(CTraceEntry(CTraceEntry::COMMIT));
+        return true;
+    }
+};
+
+/**
+ * Record the chainstate accesses of connecting a run of blocks: each
+ * transaction spends an older output and is first looked up by its own
+ * txid, as the mempool does, which misses. The cache is flushed every
+ * few blocks, as a small -dbcache would.
+ */
+static const std::vector<CTraceEntry>& ConnectTrace()
+{
+    static CCoinsViewRecorder recorder;
+    if (!recorder.vTrace.empty())
+        return recorder.vTrace;
+
+    for (uint32_t i = 0; i < PROFILE_BENCH_TXS; i++)
+        recorder.mapCoins[BenchTxid(i)] = BenchCoins(i, i / 1000);
+    CCoinsViewCache tip(&recorder);
+    uint32_t nTx = PROFILE_BENCH_TXS;
+    uint64_t nRand = 1;
+    for (unsigned int nBlock = 0; nBlock < PROFILE_BENCH_BLOCKS; nBlock++) {
+        CCoinsViewCache view(&tip);
+        for (unsigned int i = 0; i < PROFILE_BENCH_BLOCK_TXS; i++, nTx++) {
+            nRand = nRand * 6364136223846793005ULL + 1442695040888963407ULL;
+            uint256 txidPrev = BenchTxid((nRand >> 33) % nTx);
+            view.HaveCoins(BenchTxid(nTx));
+            if (view.HaveCoins(txidPrev)) {
+                CCoinsModifier coins = view.ModifyCoins(txidPrev);
+                coins->Spend(coins->vout[0].IsNull() ? 1 : 0);
+            }
+            *view.ModifyNewCoins(BenchTxid(nTx), false) = BenchCoins(nTx, PROFILE_BENCH_TXS / 1000 + nBlock);
+        }
+        view.Flush();
+        if ((nBlock + 1) % PROFILE_BENCH_FLUSH_BLOCKS == 0)
+            tip.Flush();
+    }
+    return recorder.vTrace;
+}
+
+/**
+ * Replay the connect trace against an on-disk chainstate opened with the
+ * given profile. Replays after the first find the spent coins erased, as
+ * a node would.
+ */
+static void DBProfileReplay(benchmark::State& state, const char* pszProfile)
+{
+    const std::vector<CTraceEntry>& vTrace = ConnectTrace();
+    boost::filesystem::path pathTemp = boost::filesystem::temp_directory_path() / strprintf("bench_egulden_%lu", (unsigned long)GetTimeMicros());
+    {
+        CDBWrapper db(pathTemp, PROFILE_BENCH_CACHE, false, false, true, *FindDBProfile(pszProfile));
+        for (uint32_t i = 0; i < PROFILE_BENCH_TXS; i += 10000) {
+            CDBBatch batch(db);
+            for (uint32_t j = i; j < i + 10000; j++)
+                batch.Write(std::make_pair(DB_COINS, BenchTxid(j)), BenchCoins(j, j / 1000));
+            db.WriteBatch(batch, true);
+        }
+
+        while (state.KeepRunning()) {
+            std::vector<CTraceEntry>::const_iterator it = vTrace.begin();
+            while (it != vTrace.end()) {
+                CDBBatch batch(db);
+                for (; it->type != CTraceEntry::COMMIT; it++) {
+                    CCoins coins;
+                    if (it->type == CTraceEntry::READ)
+                        db.Read(std::make_pair(DB_COINS, it->txid), coins);
+                    else if (it->coins.IsPruned())
+                        batch.Erase(std::make_pair(DB_COINS, it->txid));
+                    else
+                        batch.Write(std::make_pair(DB_COINS, it->txid), it->coins);
+                }
+                db.WriteBatch(batch);
+                it++;
+            }
+        }
+    }
+    boost::filesystem::remove_all(pathTemp);
+}
+
+static void DBProfileLegacy(benchmark::State& state) { DBProfileReplay(state, "legacy"); }
+static void DBProfileCoins(benchmark::State& state) { DBProfileReplay(state, "coins"); }
+static void DBProfileIndex(benchmark::State& state) { DBProfileReplay(state, "index"); }
+static void DBProfileSmall(benchmark::State& state) { DBProfileReplay(state, "small"); }
+
+BENCHMARK(DBProfileLegacy);
+BENCHMARK(DBProfileCoins);
+BENCHMARK(DBProfileIndex);
+BENCHMARK(DBProfileSmall);
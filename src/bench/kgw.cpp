@@ -0,0 +1,36 @@
+// Copyright (c) 2026 The e-Gulden Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "arith_uint256.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "kgw.h"
+
+#include <vector>
+
+/**
+ * One mainnet KGW retarget over a steady chain, so the walk covers the full
+ * PastBlocksMax window. The index entries have no hash, so the per-tip result
+ * cache doesn't apply.
+ */
+static void KGWRetarget(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = Params().GetConsensus();
+
+    std::vector<CBlockIndex> blocks(2000);
+    for (size_t i = 0; i < blocks.size(); i++) {
+        blocks[i].pprev = i ? &blocks[i - 1] : NULL;
+        blocks[i].nHeight = i;
+        blocks[i].nTime = 1400000000 + i * 120 + (i * 7919) % 31;
+        blocks[i].nBits = 0x1b0404cb + (i % 13);
+    }
+
+    while (state.KeepRunning()) {
+        KimotoGravityWell(&blocks.back(), 120, 42, 1181, params);
+    }
+}
+
+BENCHMARK(KGWRetarget);
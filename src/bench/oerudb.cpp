@@ -0,0 +1,86 @@
+// Copyright (c) 2026 The e-Gulden Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "hash.h"
+#include "oerushield/oerudb.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+static const int OERUDB_BENCH_CERTIFIED = 16384;
+
+static CKeyID BenchKeyID(uint32_t n)
+{
+    unsigned char buf[4];
+    WriteLE32(buf, n);
+    return CKeyID(Hash160(buf, buf + sizeof(buf)));
+}
+
+static void FillOeruDB(COeruDB& oeruDB)
+{
+    for (int i = 0; i < OERUDB_BENCH_CERTIFIED; i++)
+        oeruDB.AddCertifiedAddress(BenchKeyID(i));
+    oeruDB.PublishSnapshot();
+}
+
+// Per-block certification check of an identified miner, as done by IsBlockCertified
+static void OeruDBIsCertified(benchmark::State& state)
+{
+    COeruDB oeruDB(boost::filesystem::unique_path(), 1 << 20, true);
+    FillOeruDB(oeruDB);
+
+    std::vector<CKeyID> vKeys;
+    for (int i = 0; i < 1024; i++)
+        vKeys.push_back(BenchKeyID(i * 31));
+
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < vKeys.size(); i++)
+            n += oeruDB.IsAddressCertified(vKeys[i]);
+    }
+    assert(n > 0);
+}
+
+static void OeruDBIsNotCertified(benchmark::State& state)
+{
+    COeruDB oeruDB(boost::filesystem::unique_path(), 1 << 20, true);
+    FillOeruDB(oeruDB);
+
+    std::vector<CKeyID> vKeys;
+    for (int i = 0; i < 1024; i++)
+        vKeys.push_back(BenchKeyID(OERUDB_BENCH_CERTIFIED + i));
+
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < vKeys.size(); i++)
+            n += oeruDB.IsAddressCertified(vKeys[i]);
+    }
+    assert(n == 0);
+}
+
+// RPC reader: take the published snapshot and search it, without cs_main
+static void OeruDBSnapshotLookup(benchmark::State& state)
+{
+    COeruDB oeruDB(boost::filesystem::unique_path(), 1 << 20, true);
+    FillOeruDB(oeruDB);
+
+    std::vector<CKeyID> vKeys;
+    for (int i = 0; i < 1024; i++)
+        vKeys.push_back(BenchKeyID(i * 31));
+
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        CertifiedSnapshotRef snapshot = oeruDB.GetCertifiedSnapshot();
+        for (size_t i = 0; i < vKeys.size(); i++)
+            n += std::binary_search(snapshot->begin(), snapshot->end(), CTxDestination(vKeys[i]));
+    }
+    assert(n > 0);
+}
+
+BENCHMARK(OeruDBIsCertified);
+BENCHMARK(OeruDBIsNotCertified);
+BENCHMARK(OeruDBSnapshotLookup);
@@ -0,0 +1,81 @@
+// Copyright (c) 2026 The e-Gulden Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "primitives/block.h"
+#include "crypto/common.h"
+#include "crypto/scrypt.h"
+#include "utilstrencodings.h"
+
+#include <string.h>
+#include <vector>
+
+static CBlockHeader BenchHeader()
+{
+    CBlockHeader header;
+    header.nVersion = 2;
+    header.nTime = 1231006505;
+    header.nBits = 0x1e0ffff0;
+    return header;
+}
+
+// Old path: a fresh scratchpad on the stack for every hash
+static void ScryptStackScratchpad(benchmark::State& state)
+{
+    scrypt_detect();
+    CBlockHeader header = BenchHeader();
+    uint256 hash;
+    while (state.KeepRunning()) {
+        char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
+        scrypt_1024_1_1_256_sp(BEGIN(header.nVersion), BEGIN(hash), scratchpad);
+        header.nNonce++;
+    }
+}
+
+static void ScryptContextHash(benchmark::State& state)
+{
+    scrypt_detect();
+    CBlockHeader header = BenchHeader();
+    CScryptContext context;
+    while (state.KeepRunning()) {
+        header.GetPoWHash(context);
+        header.nNonce++;
+    }
+}
+
+// Full 16-header batches through the widest kernel, as used for headers messages
+static void ScryptContextHashMulti16(benchmark::State& state)
+{
+    scrypt_detect();
+    std::vector<CBlockHeader> headers(16, BenchHeader());
+    std::vector<uint256> hashes(headers.size());
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < headers.size(); i++)
+            headers[i].nNonce++;
+        GetPoWHashes(&headers[0], headers.size(), &hashes[0]);
+    }
+}
+
+// The same batches as a nonce search hashes them, sharing the first 64 header bytes
+static void ScryptMidstateHashMulti16(benchmark::State& state)
+{
+    scrypt_detect();
+    CBlockHeader header = BenchHeader();
+    CScryptMidstate midstate(BEGIN(header.nVersion));
+    CScryptContext& context = CScryptContext::ThreadLocal();
+    std::vector<char> tails(16 * 16);
+    for (size_t i = 0; i < 16; i++)
+        memcpy(&tails[16 * i], BEGIN(header.nVersion) + 64, 16);
+    std::vector<uint256> hashes(16);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < 16; i++)
+            WriteLE32((unsigned char*)&tails[16 * i + 12], ++header.nNonce);
+        context.HashMulti(midstate, &tails[0], BEGIN(hashes[0]), 16);
+    }
+}
+
+BENCHMARK(ScryptStackScratchpad);
+BENCHMARK(ScryptContextHash);
+BENCHMARK(ScryptContextHashMulti16);
+BENCHMARK(ScryptMidstateHashMulti16);
@@ -0,0 +1,122 @@
+// Copyright (c) 2026 The e-Gulden Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "chain.h"
+#include "clientversion.h"
+#include "compat.h"
+#include "crypto/common.h"
+#include "main.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "util.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CMappedBlockFile::~CMappedBlockFile()
+{
+#ifndef WIN32
+    munmap((void*)pdata, nLength);
+#endif
+}
+
+std::shared_ptr<const CMappedBlockFile> CBlockFileMap::Map(int nFile)
+{
+    AssertLockHeld(cs);
+    std::map<int, std::pair<std::shared_ptr<const CMappedBlockFile>, std::list<int>::iterator> >::iterator it = mapFiles.find(nFile);
+    if (it != mapFiles.end()) {
+        listFiles.splice(listFiles.begin(), listFiles, it->second.second);
+        return it->second.first;
+    }
+    if (nMaxFiles == 0)
+        return std::shared_ptr<const CMappedBlockFile>();
+
+#ifdef WIN32
+    return std::shared_ptr<const CMappedBlockFile>();
+#else
+    boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk");
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return std::shared_ptr<const CMappedBlockFile>();
+    struct stat st;
+    void* pdata = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        pdata = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pdata == MAP_FAILED) {
+        LogPrintf("Unable to map %s\n", path.string());
+        return std::shared_ptr<const CMappedBlockFile>();
+    }
+
+    while (mapFiles.size() >= nMaxFiles) {
+        mapFiles.erase(listFiles.back());
+        listFiles.pop_back();
+    }
+    std::shared_ptr<const CMappedBlockFile> file(new CMappedBlockFile((const char*)pdata, st.st_size));
+    listFiles.push_front(nFile);
+    mapFiles[nFile] = std::make_pair(file, listFiles.begin());
+    return file;
+#endif
+}
+
+void CBlockFileMap::SetMaxFiles(unsigned int nMaxFilesIn)
+{
+    LOCK(cs);
+    nMaxFiles = nMaxFilesIn;
+    while (mapFiles.size() > nMaxFiles) {
+        mapFiles.erase(listFiles.back());
+        listFiles.pop_back();
+    }
+}
+
+bool CBlockFileMap::GetBlock(const CDiskBlockPos& pos, CMappedBlock& block)
+{
+    std::shared_ptr<const CMappedBlockFile> file;
+    {
+        LOCK(cs);
+        file = Map(pos.nFile);
+    }
+    // Blocks are stored after their network magic and size
+    if (!file || pos.nPos < 8 || pos.nPos > file->nLength)
+        return false;
+    uint32_t nSize = ReadLE32((const unsigned char*)file->pdata + pos.nPos - 4);
+    if (nSize > file->nLength - pos.nPos)
+        return false;
+    block.file = file;
+    block.pbegin = file->pdata + pos.nPos;
+    block.pend = block.pbegin + nSize;
+    return true;
+}
+
+bool CBlockFileMap::ReadBlock(const CDiskBlockPos& pos, CBlock& block)
+{
+    CMappedBlock mapped;
+    if (!GetBlock(pos, mapped))
+        return false;
+    CMemoryReader reader(SER_DISK, CLIENT_VERSION, mapped.pbegin, mapped.pend);
+    reader >> block;
+    return true;
+}
+
+void CBlockFileMap::Release(int nFile)
+{
+    LOCK(cs);
+    std::map<int, std::pair<std::shared_ptr<const CMappedBlockFile>, std::list<int>::iterator> >::iterator it = mapFiles.find(nFile);
+    if (it != mapFiles.end()) {
+        listFiles.erase(it->second.second);
+        mapFiles.erase(it);
+    }
+}
+
+void CBlockFileMap::Clear()
+{
+    LOCK(cs);
+    mapFiles.clear();
+    listFiles.clear();
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2026 The e-Gulden Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include "sync.h"
+
+#include <list>
+#include <map>
+#include <memory>
+
+class CBlock;
+struct CDiskBlockPos;
+
+/** Default number of block files kept mapped. Mappings only cost address space, which 32-bit builds lack. */
+static const unsigned int DEFAULT_BLOCK_MMAP_FILES = sizeof(void*) >= 8 ? 16 : 0;
+
+/** A read-only mapping of a whole blk?????.dat file. */
+class CMappedBlockFile
+{
+private:
+    CMappedBlockFile(const CMappedBlockFile&);
+    CMappedBlockFile& operator=(const CMappedBlockFile&);
+
+public:
+    const char* pdata;
+    size_t nLength;
+
+    CMappedBlockFile(const char* pdataIn, size_t nLengthIn) : pdata(pdataIn), nLength(nLengthIn) {}
+    ~CMappedBlockFile();
+};
+
+/** A serialized block inside a mapped file. Its bytes stay valid for as long as it is held. */
+struct CMappedBlock
+{
+    std::shared_ptr<const CMappedBlockFile> file;
+    const char* pbegin;
+    const char* pend;
+
+    CMappedBlock() : pbegin(NULL), pend(NULL) {}
+};
+
+/**
+ * Blocks read straight from memory-mapped block files, with the most
+ * recently used files kept mapped. Only block files that are no longer
+ * appended to (or truncated) may be mapped: the caller decides which.
+ */
+class CBlockFileMap
+{
+private:
+    CCriticalSection cs;
+    unsigned int nMaxFiles;
+    //! Mapped file numbers, most recently used first
+    std::list<int> listFiles;
+    std::map<int, std::pair<std::shared_ptr<const CMappedBlockFile>, std::list<int>::iterator> > mapFiles;
+
+    std::shared_ptr<const CMappedBlockFile> Map(int nFile);
+
+public:
+    CBlockFileMap(unsigned int nMaxFilesIn = DEFAULT_BLOCK_MMAP_FILES) : nMaxFiles(nMaxFilesIn) {}
+
+    /** Change the number of files kept mapped; 0 disables mapping. */
+    void SetMaxFiles(unsigned int nMaxFilesIn);
+
+    /** Locate the block stored at pos. Returns false if its file cannot be mapped or the block is not inside it. */
+    bool GetBlock(const CDiskBlockPos& pos, CMappedBlock& block);
+
+    /** Deserialize the block stored at pos from its mapped file. Returns false as GetBlock does, and throws on a malformed block. */
+    bool ReadBlock(const CDiskBlockPos& pos, CBlock& block);
+
+    /** Drop the mapping of a file that is about to be deleted. Blocks already handed out stay readable. */
+    void Release(int nFile);
+    void Clear();
+};
+
+#endif // BITCOIN_BLOCKFILEMAP_H
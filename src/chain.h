@@ -146,6 +146,11 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_OPT_WITNESS       =   128, //!< block data in blk*.data was received with a witness-enforcing client
+
+    BLOCK_HAVE_POWHASH      =   256, //!< scrypt proof-of-work hash of the header is stored in the index entry
+
+    BLOCK_OERU_CHECKED      =   512, //!< OeruShield identification of the coinbase has been evaluated
+    BLOCK_OERU_IDENTIFIED   =  1024, //!< coinbase carries a valid OERU signature by hashOeruMiner
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -199,6 +204,12 @@ public:
     unsigned int nBits;
     unsigned int nNonce;
 
+    //! Scrypt proof-of-work hash of the header. Only valid if nStatus & BLOCK_HAVE_POWHASH
+    uint256 hashPoW;
+
+    //! Key ID of the OeruShield-identified miner. Only valid if nStatus & BLOCK_OERU_IDENTIFIED
+    uint160 hashOeruMiner;
+
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId;
 
@@ -222,6 +233,8 @@ public:
         nTime          = 0;
         nBits          = 0;
         nNonce         = 0;
+        hashPoW        = uint256();
+        hashOeruMiner  = uint160();
     }
 
     CBlockIndex()
@@ -278,6 +291,8 @@ public:
 
     uint256 GetBlockPoWHash() const
     {
+        if (nStatus & BLOCK_HAVE_POWHASH)
+            return hashPoW;
         return GetBlockHeader().GetPoWHash();
     }
 
@@ -383,6 +398,10 @@ public:
         READWRITE(nTime);
         READWRITE(nBits);
         READWRITE(nNonce);
+        if (nStatus & BLOCK_HAVE_POWHASH)
+            READWRITE(hashPoW);
+        if (nStatus & BLOCK_OERU_IDENTIFIED)
+            READWRITE(hashOeruMiner);
     }
 
     uint256 GetBlockHash() const
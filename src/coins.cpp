@@ -58,7 +58,9 @@ CCoinsViewCursor *CCoinsViewBacked::Cursor() const { return base->Cursor(); }
 
 SaltedTxidHasher::SaltedTxidHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), cachedCoinsUsage(0) { }
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn, unsigned int nShardsIn) : CCoinsViewBacked(baseIn), hasModifier(false), nShards(nShardsIn), shards(new CacheShard[nShardsIn]) {
+    assert(nShards > 0);
+}
 
 CCoinsViewCache::~CCoinsViewCache()
 {
@@ -66,31 +68,68 @@ CCoinsViewCache::~CCoinsViewCache()
 }
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
-    return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
+    size_t ret = 0;
+    for (unsigned int i = 0; i < nShards; i++) {
+        boost::unique_lock<boost::mutex> lock(shards[i].cs);
+        ret += memusage::DynamicUsage(shards[i].cacheCoins) + shards[i].cachedCoinsUsage;
+    }
+    return ret;
+}
+
+/** Add coins read from the base view, unless another thread got there first. */
+static CCoinsCacheEntry* InsertFetched(CCoinsMap& cacheCoins, size_t& cachedCoinsUsage, const uint256 &txid, CCoins& coins) {
+    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    if (ret.second) {
+        coins.swap(ret.first->second.coins);
+        if (ret.first->second.coins.IsPruned()) {
+            // The parent only has an empty entry for this txid; we can consider our
+            // version as fresh.
+            ret.first->second.flags = CCoinsCacheEntry::FRESH;
+        }
+        cachedCoinsUsage += ret.first->second.coins.DynamicMemoryUsage();
+    }
+    return &ret.first->second;
 }
 
-CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const {
-    CCoinsMap::iterator it = cacheCoins.find(txid);
-    if (it != cacheCoins.end())
-        return it;
+CCoinsCacheEntry* CCoinsViewCache::FetchCoins(const uint256 &txid) const {
+    CacheShard& shard = GetShard(txid);
+    {
+        boost::unique_lock<boost::mutex> lock(shard.cs);
+        CCoinsMap::iterator it = shard.cacheCoins.find(txid);
+        if (it != shard.cacheCoins.end())
+            return &it->second;
+    }
+    // Only the owner changes the base, so the read needs no lock, and
+    // prefetches into the same shard can go on meanwhile.
     CCoins tmp;
     if (!base->GetCoins(txid, tmp))
-        return cacheCoins.end();
-    CCoinsMap::iterator ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry())).first;
-    tmp.swap(ret->second.coins);
-    if (ret->second.coins.IsPruned()) {
-        // The parent only has an empty entry for this txid; we can consider our
-        // version as fresh.
-        ret->second.flags = CCoinsCacheEntry::FRESH;
+        return NULL;
+    boost::unique_lock<boost::mutex> lock(shard.cs);
+    return InsertFetched(shard.cacheCoins, shard.cachedCoinsUsage, txid, tmp);
+}
+
+void CCoinsViewCache::PrefetchCoins(const uint256 &txid) const {
+    CacheShard& shard = GetShard(txid);
+    uint64_t nGeneration;
+    {
+        boost::unique_lock<boost::mutex> lock(shard.cs);
+        if (shard.cacheCoins.count(txid))
+            return;
+        nGeneration = shard.nGeneration;
     }
-    cachedCoinsUsage += ret->second.coins.DynamicMemoryUsage();
-    return ret;
+    CCoins tmp;
+    if (!base->GetCoins(txid, tmp))
+        return;
+    boost::unique_lock<boost::mutex> lock(shard.cs);
+    // A flush in the meantime may have written newer coins to the base.
+    if (shard.nGeneration == nGeneration)
+        InsertFetched(shard.cacheCoins, shard.cachedCoinsUsage, txid, tmp);
 }
 
 bool CCoinsViewCache::GetCoins(const uint256 &txid, CCoins &coins) const {
-    CCoinsMap::const_iterator it = FetchCoins(txid);
-    if (it != cacheCoins.end()) {
-        coins = it->second.coins;
+    const CCoinsCacheEntry* entry = FetchCoins(txid);
+    if (entry) {
+        coins = entry->coins;
         return true;
     }
     return false;
@@ -98,23 +137,31 @@ bool CCoinsViewCache::GetCoins(const uint256 &txid, CCoins &coins) const {
 
 CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256 &txid) {
     assert(!hasModifier);
-    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    CacheShard& shard = GetShard(txid);
+    CCoinsMap::value_type* entry;
+    bool fInserted;
+    {
+        boost::unique_lock<boost::mutex> lock(shard.cs);
+        std::pair<CCoinsMap::iterator, bool> ret = shard.cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+        entry = &*ret.first;
+        fInserted = ret.second;
+    }
     size_t cachedCoinUsage = 0;
-    if (ret.second) {
-        if (!base->GetCoins(txid, ret.first->second.coins)) {
+    if (fInserted) {
+        if (!base->GetCoins(txid, entry->second.coins)) {
             // The parent view does not have this entry; mark it as fresh.
-            ret.first->second.coins.Clear();
-            ret.first->second.flags = CCoinsCacheEntry::FRESH;
-        } else if (ret.first->second.coins.IsPruned()) {
+            entry->second.coins.Clear();
+            entry->second.flags = CCoinsCacheEntry::FRESH;
+        } else if (entry->second.coins.IsPruned()) {
             // The parent view only has a pruned entry for this; mark it as fresh.
-            ret.first->second.flags = CCoinsCacheEntry::FRESH;
+            entry->second.flags = CCoinsCacheEntry::FRESH;
         }
     } else {
-        cachedCoinUsage = ret.first->second.coins.DynamicMemoryUsage();
+        cachedCoinUsage = entry->second.coins.DynamicMemoryUsage();
     }
     // Assume that whenever ModifyCoins is called, the entry will be modified.
-    ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
-    return CCoinsModifier(*this, ret.first, cachedCoinUsage);
+    entry->second.flags |= CCoinsCacheEntry::DIRTY;
+    return CCoinsModifier(*this, entry, cachedCoinUsage);
 }
 
 // ModifyNewCoins has to know whether the new outputs its creating are for a
@@ -123,36 +170,42 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256 &txid) {
 // in effect will still be properly overwritten when spent.
 CCoinsModifier CCoinsViewCache::ModifyNewCoins(const uint256 &txid, bool coinbase) {
     assert(!hasModifier);
-    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
-    ret.first->second.coins.Clear();
+    CacheShard& shard = GetShard(txid);
+    CCoinsMap::value_type* entry;
+    {
+        boost::unique_lock<boost::mutex> lock(shard.cs);
+        entry = &*shard.cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry())).first;
+    }
+    entry->second.coins.Clear();
     if (!coinbase) {
-        ret.first->second.flags = CCoinsCacheEntry::FRESH;
+        entry->second.flags = CCoinsCacheEntry::FRESH;
     }
-    ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
-    return CCoinsModifier(*this, ret.first, 0);
+    entry->second.flags |= CCoinsCacheEntry::DIRTY;
+    return CCoinsModifier(*this, entry, 0);
 }
 
 const CCoins* CCoinsViewCache::AccessCoins(const uint256 &txid) const {
-    CCoinsMap::const_iterator it = FetchCoins(txid);
-    if (it == cacheCoins.end()) {
+    const CCoinsCacheEntry* entry = FetchCoins(txid);
+    if (!entry) {
         return NULL;
     } else {
-        return &it->second.coins;
+        return &entry->coins;
     }
 }
 
 bool CCoinsViewCache::HaveCoins(const uint256 &txid) const {
-    CCoinsMap::const_iterator it = FetchCoins(txid);
+    const CCoinsCacheEntry* entry = FetchCoins(txid);
     // We're using vtx.empty() instead of IsPruned here for performance reasons,
     // as we only care about the case where a transaction was replaced entirely
     // in a reorganization (which wipes vout entirely, as opposed to spending
     // which just cleans individual outputs).
-    return (it != cacheCoins.end() && !it->second.coins.vout.empty());
+    return (entry && !entry->coins.vout.empty());
 }
 
 bool CCoinsViewCache::HaveCoinsInCache(const uint256 &txid) const {
-    CCoinsMap::const_iterator it = cacheCoins.find(txid);
-    return it != cacheCoins.end();
+    CacheShard& shard = GetShard(txid);
+    boost::unique_lock<boost::mutex> lock(shard.cs);
+    return shard.cacheCoins.count(txid) != 0;
 }
 
 uint256 CCoinsViewCache::GetBestBlock() const {
@@ -169,16 +222,18 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
     assert(!hasModifier);
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) { // Ignore non-dirty entries (optimization).
-            CCoinsMap::iterator itUs = cacheCoins.find(it->first);
-            if (itUs == cacheCoins.end()) {
+            CacheShard& shard = GetShard(it->first);
+            boost::unique_lock<boost::mutex> lock(shard.cs);
+            CCoinsMap::iterator itUs = shard.cacheCoins.find(it->first);
+            if (itUs == shard.cacheCoins.end()) {
                 // The parent cache does not have an entry, while the child does
                 // We can ignore it if it's both FRESH and pruned in the child
                 if (!(it->second.flags & CCoinsCacheEntry::FRESH && it->second.coins.IsPruned())) {
                     // Otherwise we will need to create it in the parent
                     // and move the data up and mark it as dirty
-                    CCoinsCacheEntry& entry = cacheCoins[it->first];
+                    CCoinsCacheEntry& entry = shard.cacheCoins[it->first];
                     entry.coins.swap(it->second.coins);
-                    cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
+                    shard.cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
                     entry.flags = CCoinsCacheEntry::DIRTY;
                     // We can mark it FRESH in the parent if it was FRESH in the child
                     // Otherwise it might have just been flushed from the parent's cache
@@ -192,13 +247,13 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                     // The grandparent does not have an entry, and the child is
                     // modified and being pruned. This means we can just delete
                     // it from the parent.
-                    cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
-                    cacheCoins.erase(itUs);
+                    shard.cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
+                    shard.cacheCoins.erase(itUs);
                 } else {
                     // A normal modification.
-                    cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
+                    shard.cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
                     itUs->second.coins.swap(it->second.coins);
-                    cachedCoinsUsage += itUs->second.coins.DynamicMemoryUsage();
+                    shard.cachedCoinsUsage += itUs->second.coins.DynamicMemoryUsage();
                     itUs->second.flags |= CCoinsCacheEntry::DIRTY;
                 }
             }
@@ -211,23 +266,55 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
 }
 
 bool CCoinsViewCache::Flush() {
-    bool fOk = base->BatchWrite(cacheCoins, hashBlock);
-    cacheCoins.clear();
-    cachedCoinsUsage = 0;
+    CCoinsMap mapCoins;
+    if (nShards == 1) {
+        boost::unique_lock<boost::mutex> lock(shards[0].cs);
+        mapCoins.swap(shards[0].cacheCoins);
+    } else {
+        // The base takes a single map, so that the entries and the best block
+        // are written in one batch. Clean entries would be skipped anyway.
+        mapCoins.reserve(GetCacheSize());
+        for (unsigned int i = 0; i < nShards; i++) {
+            boost::unique_lock<boost::mutex> lock(shards[i].cs);
+            for (CCoinsMap::iterator it = shards[i].cacheCoins.begin(); it != shards[i].cacheCoins.end(); it++) {
+                if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+                    CCoinsCacheEntry& entry = mapCoins[it->first];
+                    entry.coins.swap(it->second.coins);
+                    entry.flags = it->second.flags;
+                }
+            }
+            shards[i].cacheCoins.clear();
+        }
+    }
+    bool fOk = base->BatchWrite(mapCoins, hashBlock);
+    for (unsigned int i = 0; i < nShards; i++) {
+        // Also drops whatever was prefetched while the batch was written.
+        boost::unique_lock<boost::mutex> lock(shards[i].cs);
+        shards[i].cacheCoins.clear();
+        shards[i].cachedCoinsUsage = 0;
+        shards[i].nGeneration++;
+    }
     return fOk;
 }
 
 void CCoinsViewCache::Uncache(const uint256& hash)
 {
-    CCoinsMap::iterator it = cacheCoins.find(hash);
-    if (it != cacheCoins.end() && it->second.flags == 0) {
-        cachedCoinsUsage -= it->second.coins.DynamicMemoryUsage();
-        cacheCoins.erase(it);
+    CacheShard& shard = GetShard(hash);
+    boost::unique_lock<boost::mutex> lock(shard.cs);
+    CCoinsMap::iterator it = shard.cacheCoins.find(hash);
+    if (it != shard.cacheCoins.end() && it->second.flags == 0) {
+        shard.cachedCoinsUsage -= it->second.coins.DynamicMemoryUsage();
+        shard.cacheCoins.erase(it);
     }
 }
 
 unsigned int CCoinsViewCache::GetCacheSize() const {
-    return cacheCoins.size();
+    unsigned int nSize = 0;
+    for (unsigned int i = 0; i < nShards; i++) {
+        boost::unique_lock<boost::mutex> lock(shards[i].cs);
+        nSize += shards[i].cacheCoins.size();
+    }
+    return nSize;
 }
 
 const CTxOut &CCoinsViewCache::GetOutputFor(const CTxIn& input) const
@@ -282,7 +369,7 @@ double CCoinsViewCache::GetPriority(const CTransaction &tx, int nHeight, CAmount
     return tx.ComputePriority(dResult);
 }
 
-CCoinsModifier::CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage) : cache(cache_), it(it_), cachedCoinUsage(usage) {
+CCoinsModifier::CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::value_type* it_, size_t usage) : cache(cache_), it(it_), cachedCoinUsage(usage) {
     assert(!cache.hasModifier);
     cache.hasModifier = true;
 }
@@ -292,12 +379,14 @@ CCoinsModifier::~CCoinsModifier()
     assert(cache.hasModifier);
     cache.hasModifier = false;
     it->second.coins.Cleanup();
-    cache.cachedCoinsUsage -= cachedCoinUsage; // Subtract the old usage
+    CCoinsViewCache::CacheShard& shard = cache.GetShard(it->first);
+    boost::unique_lock<boost::mutex> lock(shard.cs);
+    shard.cachedCoinsUsage -= cachedCoinUsage; // Subtract the old usage
     if ((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned()) {
-        cache.cacheCoins.erase(it);
+        shard.cacheCoins.erase(shard.cacheCoins.find(it->first));
     } else {
         // If the coin still exists after the modification, add the new usage
-        cache.cachedCoinsUsage += it->second.coins.DynamicMemoryUsage();
+        shard.cachedCoinsUsage += it->second.coins.DynamicMemoryUsage();
     }
 }
 
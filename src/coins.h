@@ -14,9 +14,11 @@
 #include "uint256.h"
 
 #include <assert.h>
+#include <memory>
 #include <stdint.h>
 
 #include <boost/foreach.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/unordered_map.hpp>
 
 /** 
@@ -374,9 +376,9 @@ class CCoinsModifier
 {
 private:
     CCoinsViewCache& cache;
-    CCoinsMap::iterator it;
+    CCoinsMap::value_type* it; // Map nodes stay put while other threads insert into the same shard
     size_t cachedCoinUsage; // Cached memory usage of the CCoins object before modification
-    CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage);
+    CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::value_type* it_, size_t usage);
 
 public:
     CCoins* operator->() { return &it->second.coins; }
@@ -385,7 +387,16 @@ public:
     friend class CCoinsViewCache;
 };
 
-/** CCoinsView that adds a memory cache for transactions to another CCoinsView */
+/**
+ * CCoinsView that adds a memory cache for transactions to another CCoinsView
+ *
+ * The cache is split into shards by txid, each with its own lock. Apart from
+ * PrefetchCoins, all methods must be called by a single owning thread (for
+ * pcoinsTip, the one holding cs_main). PrefetchCoins may be called from any
+ * number of other threads at the same time, provided the base view's GetCoins
+ * is thread-safe, as CCoinsViewDB's is; it only ever adds entries that are
+ * missing, so pointers and modifiers held by the owner stay valid.
+ */
 class CCoinsViewCache : public CCoinsViewBacked
 {
 protected:
@@ -398,13 +409,34 @@ protected:
      * declared as "const".  
      */
     mutable uint256 hashBlock;
-    mutable CCoinsMap cacheCoins;
 
-    /* Cached dynamic memory usage for the inner CCoins objects. */
-    mutable size_t cachedCoinsUsage;
+    /** The entries whose txid maps to one shard, and their memory usage. */
+    struct CacheShard
+    {
+        boost::mutex cs;
+        CCoinsMap cacheCoins;
+
+        /* Cached dynamic memory usage for the inner CCoins objects. */
+        size_t cachedCoinsUsage;
+
+        /* Bumped when a flush drops the entries, so prefetches that read the
+         * base before the flush do not put back stale coins. */
+        uint64_t nGeneration;
+
+        CacheShard() : cachedCoinsUsage(0), nGeneration(0) {}
+    };
+
+    const unsigned int nShards;
+    mutable std::unique_ptr<CacheShard[]> shards;
+
+    CacheShard& GetShard(const uint256 &txid) const {
+        // Txids are uniform already; the maps salt their own hash, so picking
+        // the shard from other bits keeps it independent of the buckets.
+        return shards[nShards == 1 ? 0 : txid.GetCheapHash() % nShards];
+    }
 
 public:
-    CCoinsViewCache(CCoinsView *baseIn);
+    CCoinsViewCache(CCoinsView *baseIn, unsigned int nShardsIn = 1);
     ~CCoinsViewCache();
 
     // Standard CCoinsView methods
@@ -446,6 +478,13 @@ public:
      */
     CCoinsModifier ModifyNewCoins(const uint256 &txid, bool coinbase);
 
+    /**
+     * Load the coins for txid from the base view into this cache, unless
+     * they are already cached. Safe to call from other threads while the
+     * owner uses the cache; see the class comment.
+     */
+    void PrefetchCoins(const uint256 &txid) const;
+
     /**
      * Push the modifications applied to this cache to its base.
      * Failure to call this method before destruction will cause the changes to be forgotten.
@@ -490,8 +529,7 @@ public:
     friend class CCoinsModifier;
 
 private:
-    CCoinsMap::iterator FetchCoins(const uint256 &txid);
-    CCoinsMap::const_iterator FetchCoins(const uint256 &txid) const;
+    CCoinsCacheEntry* FetchCoins(const uint256 &txid) const;
 
     /**
      * By making the copy constructor private, we prevent accidentally using it when one intends to create a cache on top of a base cache.
@@ -0,0 +1,42 @@
+// Copyright (c) 2026 The e-Gulden Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// This file is built with -mavx2; only call into it after CPUID confirmed support.
+
+#include "crypto/scrypt.h"
+#include "crypto/scrypt-lanes.h"
+
+#include <stdint.h>
+#include <immintrin.h>
+
+/* Eight independent hashes, one per 32-bit lane. */
+struct ScryptAVX2x8
+{
+	typedef __m256i T;
+	static const uint32_t LANES = 8;
+
+	static inline T Add(T a, T b) { return _mm256_add_epi32(a, b); }
+	static inline T Xor(T a, T b) { return _mm256_xor_si256(a, b); }
+	template <int s> static inline T Rotl(T a) { return _mm256_or_si256(_mm256_slli_epi32(a, s), _mm256_srli_epi32(a, 32 - s)); }
+	static inline T Load(const uint32_t *p) { return _mm256_loadu_si256((const __m256i *)p); }
+	static inline void Store(uint32_t *p, T a) { _mm256_storeu_si256((__m256i *)p, a); }
+
+	/* Offset (in words) of lane l of V_j: j * 32 * LANES + l. */
+	static inline T Index(T x)
+	{
+		return _mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(1023)), 8), _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+	}
+
+	static inline T Gather(const uint32_t *base, T idx) { return _mm256_i32gather_epi32((const int *)base, idx, 4); }
+};
+
+void scrypt_1024_1_1_256_sp_avx2_8way(const char *input, char *output, char *scratchpad)
+{
+	scrypt_1024_1_1_256_sp_lanes<ScryptAVX2x8>(input, output, scratchpad);
+}
+
+void scrypt_core_avx2_8way(uint8_t *B, char *scratchpad)
+{
+	scrypt_core_lanes<ScryptAVX2x8>(B, scratchpad);
+}
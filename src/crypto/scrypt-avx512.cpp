@@ -0,0 +1,43 @@
+// Copyright (c) 2026 The e-Gulden Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// This file is built with -mavx512f; only call into it after CPUID confirmed support.
+
+#include "crypto/scrypt.h"
+#include "crypto/scrypt-lanes.h"
+
+#include <stdint.h>
+#include <immintrin.h>
+
+/* Sixteen independent hashes, one per 32-bit lane. */
+struct ScryptAVX512x16
+{
+	typedef __m512i T;
+	static const uint32_t LANES = 16;
+
+	static inline T Add(T a, T b) { return _mm512_add_epi32(a, b); }
+	static inline T Xor(T a, T b) { return _mm512_xor_si512(a, b); }
+	template <int s> static inline T Rotl(T a) { return _mm512_rol_epi32(a, s); }
+	static inline T Load(const uint32_t *p) { return _mm512_loadu_si512((const void *)p); }
+	static inline void Store(uint32_t *p, T a) { _mm512_storeu_si512((void *)p, a); }
+
+	/* Offset (in words) of lane l of V_j: j * 32 * LANES + l. */
+	static inline T Index(T x)
+	{
+		return _mm512_add_epi32(_mm512_slli_epi32(_mm512_and_si512(x, _mm512_set1_epi32(1023)), 9),
+			_mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+	}
+
+	static inline T Gather(const uint32_t *base, T idx) { return _mm512_i32gather_epi32(idx, (const void *)base, 4); }
+};
+
+void scrypt_1024_1_1_256_sp_avx512_16way(const char *input, char *output, char *scratchpad)
+{
+	scrypt_1024_1_1_256_sp_lanes<ScryptAVX512x16>(input, output, scratchpad);
+}
+
+void scrypt_core_avx512_16way(uint8_t *B, char *scratchpad)
+{
+	scrypt_core_lanes<ScryptAVX512x16>(B, scratchpad);
+}
@@ -0,0 +1,135 @@
+// Copyright (c) 2026 The e-Gulden Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_SCRYPT_LANES_H
+#define BITCOIN_CRYPTO_SCRYPT_LANES_H
+
+#include "crypto/scrypt.h"
+
+#include <stdint.h>
+
+/*
+ * Interleaved scrypt(1024,1,1) shared by the multi-lane kernels.
+ *
+ * The state of V::LANES independent hashes is kept word-sliced: vector k holds
+ * word k of every lane, so salsa20/8 runs on all lanes with the same
+ * instructions and only the data-dependent V_j reads need a gather. Each
+ * kernel instantiates this with its own vector type in a translation unit
+ * built with the matching -m flags; the anonymous namespace keeps those
+ * instantiations from being merged by the linker.
+ */
+namespace {
+
+#define SALSA_STEP(a, b, c, s) x[a] = V::Xor(x[a], V::template Rotl<s>(V::Add(x[b], x[c])))
+
+template <typename V>
+inline void xor_salsa8_lanes(typename V::T B[16], const typename V::T Bx[16])
+{
+	typename V::T x[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		x[i] = B[i] = V::Xor(B[i], Bx[i]);
+	for (i = 0; i < 8; i += 2) {
+		/* Operate on columns. */
+		SALSA_STEP( 4,  0, 12,  7);  SALSA_STEP( 9,  5,  1,  7);
+		SALSA_STEP(14, 10,  6,  7);  SALSA_STEP( 3, 15, 11,  7);
+
+		SALSA_STEP( 8,  4,  0,  9);  SALSA_STEP(13,  9,  5,  9);
+		SALSA_STEP( 2, 14, 10,  9);  SALSA_STEP( 7,  3, 15,  9);
+
+		SALSA_STEP(12,  8,  4, 13);  SALSA_STEP( 1, 13,  9, 13);
+		SALSA_STEP( 6,  2, 14, 13);  SALSA_STEP(11,  7,  3, 13);
+
+		SALSA_STEP( 0, 12,  8, 18);  SALSA_STEP( 5,  1, 13, 18);
+		SALSA_STEP(10,  6,  2, 18);  SALSA_STEP(15, 11,  7, 18);
+
+		/* Operate on rows. */
+		SALSA_STEP( 1,  0,  3,  7);  SALSA_STEP( 6,  5,  4,  7);
+		SALSA_STEP(11, 10,  9,  7);  SALSA_STEP(12, 15, 14,  7);
+
+		SALSA_STEP( 2,  1,  0,  9);  SALSA_STEP( 7,  6,  5,  9);
+		SALSA_STEP( 8, 11, 10,  9);  SALSA_STEP(13, 12, 15,  9);
+
+		SALSA_STEP( 3,  2,  1, 13);  SALSA_STEP( 4,  7,  6, 13);
+		SALSA_STEP( 9,  8, 11, 13);  SALSA_STEP(14, 13, 12, 13);
+
+		SALSA_STEP( 0,  3,  2, 18);  SALSA_STEP( 5,  4,  7, 18);
+		SALSA_STEP(10,  9,  8, 18);  SALSA_STEP(15, 14, 13, 18);
+	}
+	for (i = 0; i < 16; i++)
+		B[i] = V::Add(B[i], x[i]);
+}
+
+#undef SALSA_STEP
+
+/**
+ * The salsa20/8 mixing step of V::LANES hashes. B holds V::LANES consecutive
+ * 128-byte PBKDF2 outputs and is updated in place. The scratchpad must hold
+ * scrypt_scratchpad_size(V::LANES) bytes.
+ */
+template <typename V>
+void scrypt_core_lanes(uint8_t *B, char *scratchpad)
+{
+	typedef typename V::T T;
+	const uint32_t N = V::LANES;
+	uint32_t W[32 * N];
+	T X[32];
+	T *Vp;
+	T j;
+	uint32_t i, k, l;
+
+	Vp = (T *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+
+	for (l = 0; l < N; l++) {
+		for (k = 0; k < 32; k++)
+			W[k * N + l] = le32dec(&B[128 * l + 4 * k]);
+	}
+	for (k = 0; k < 32; k++)
+		X[k] = V::Load(&W[k * N]);
+
+	for (i = 0; i < 1024; i++) {
+		for (k = 0; k < 32; k++)
+			Vp[i * 32 + k] = X[k];
+		xor_salsa8_lanes<V>(&X[0], &X[16]);
+		xor_salsa8_lanes<V>(&X[16], &X[0]);
+	}
+	for (i = 0; i < 1024; i++) {
+		/* Every lane reads its own V_j, so word k of each lane is gathered at a per-lane offset. */
+		j = V::Index(X[16]);
+		for (k = 0; k < 32; k++)
+			X[k] = V::Xor(X[k], V::Gather((const uint32_t *)&Vp[k], j));
+		xor_salsa8_lanes<V>(&X[0], &X[16]);
+		xor_salsa8_lanes<V>(&X[16], &X[0]);
+	}
+
+	for (k = 0; k < 32; k++)
+		V::Store(&W[k * N], X[k]);
+	for (l = 0; l < N; l++) {
+		for (k = 0; k < 32; k++)
+			le32enc(&B[128 * l + 4 * k], W[k * N + l]);
+	}
+}
+
+/**
+ * Hash V::LANES consecutive 80-byte inputs. The scratchpad must hold
+ * scrypt_scratchpad_size(V::LANES) bytes.
+ */
+template <typename V>
+void scrypt_1024_1_1_256_sp_lanes(const char *input, char *output, char *scratchpad)
+{
+	const uint32_t N = V::LANES;
+	uint8_t B[128 * N];
+	uint32_t l;
+
+	for (l = 0; l < N; l++)
+		PBKDF2_SHA256((const uint8_t *)&input[80 * l], 80, (const uint8_t *)&input[80 * l], 80, 1, &B[128 * l], 128);
+	scrypt_core_lanes<V>(B, scratchpad);
+	for (l = 0; l < N; l++)
+		PBKDF2_SHA256((const uint8_t *)&input[80 * l], 80, &B[128 * l], 128, 1, (uint8_t *)&output[32 * l], 32);
+}
+
+} // namespace
+
+#endif // BITCOIN_CRYPTO_SCRYPT_LANES_H
@@ -28,6 +28,7 @@
  */
 
 #include "crypto/scrypt.h"
+#include "crypto/scrypt-lanes.h"
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
@@ -92,9 +93,8 @@ static inline void xor_salsa8_sse2(__m128i B[4], const __m128i Bx[4])
 	B[3] = _mm_add_epi32(B[3], X3);
 }
 
-void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchpad)
+void scrypt_core_sse2(uint8_t *B, char *scratchpad)
 {
-	uint8_t B[128];
 	union {
 		__m128i i128[8];
 		uint32_t u32[32];
@@ -104,8 +104,6 @@ void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchp
 
 	V = (__m128i *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
 
-	PBKDF2_SHA256((const uint8_t *)input, 80, (const uint8_t *)input, 80, 1, B, 128);
-
 	for (k = 0; k < 2; k++) {
 		for (i = 0; i < 16; i++) {
 			X.u32[k * 16 + i] = le32dec(&B[(k * 16 + (i * 5 % 16)) * 4]);
@@ -131,6 +129,50 @@ void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchp
 			le32enc(&B[(k * 16 + (i * 5 % 16)) * 4], X.u32[k * 16 + i]);
 		}
 	}
+}
 
+void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchpad)
+{
+	uint8_t B[128];
+
+	PBKDF2_SHA256((const uint8_t *)input, 80, (const uint8_t *)input, 80, 1, B, 128);
+	scrypt_core_sse2(B, scratchpad);
 	PBKDF2_SHA256((const uint8_t *)input, 80, B, 128, 1, (uint8_t *)output, 32);
 }
+
+/* Four independent hashes, one per 32-bit lane. */
+struct ScryptSSE2x4
+{
+	typedef __m128i T;
+	static const uint32_t LANES = 4;
+
+	static inline T Add(T a, T b) { return _mm_add_epi32(a, b); }
+	static inline T Xor(T a, T b) { return _mm_xor_si128(a, b); }
+	template <int s> static inline T Rotl(T a) { return _mm_or_si128(_mm_slli_epi32(a, s), _mm_srli_epi32(a, 32 - s)); }
+	static inline T Load(const uint32_t *p) { return _mm_loadu_si128((const __m128i *)p); }
+	static inline void Store(uint32_t *p, T a) { _mm_storeu_si128((__m128i *)p, a); }
+
+	/* Offset (in words) of lane l of V_j: j * 32 * LANES + l. */
+	static inline T Index(T x)
+	{
+		return _mm_add_epi32(_mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(1023)), 7), _mm_set_epi32(3, 2, 1, 0));
+	}
+
+	/* SSE2 has no gather; assemble the lanes with scalar loads. */
+	static inline T Gather(const uint32_t *base, T idx)
+	{
+		uint32_t j[4];
+		Store(j, idx);
+		return _mm_set_epi32(base[j[3]], base[j[2]], base[j[1]], base[j[0]]);
+	}
+};
+
+void scrypt_1024_1_1_256_sp_sse2_4way(const char *input, char *output, char *scratchpad)
+{
+	scrypt_1024_1_1_256_sp_lanes<ScryptSSE2x4>(input, output, scratchpad);
+}
+
+void scrypt_core_sse2_4way(uint8_t *B, char *scratchpad)
+{
+	scrypt_core_lanes<ScryptSSE2x4>(B, scratchpad);
+}
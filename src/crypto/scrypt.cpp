@@ -27,6 +27,10 @@
  * online backup system.
  */
 
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
 #include "crypto/scrypt.h"
 //#include "util.h"
 #include <stdlib.h>
@@ -34,14 +38,29 @@
 #include <string.h>
 #include <openssl/sha.h>
 
-#if defined(USE_SSE2) && !defined(USE_SSE2_ALWAYS)
-#ifdef _MSC_VER
-// MSVC 64bit is unable to use inline asm
-#include <intrin.h>
-#else
-// GCC Linux or i686-w64-mingw32
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+#if (defined(USE_SSE2) || defined(ENABLE_AVX2) || defined(ENABLE_AVX512)) && !defined(BUILD_BITCOIN_INTERNAL)
+// GCC/clang on x86; the kernels below are built in separate libraries with their own -m flags
+#define SCRYPT_CPUID_DISPATCH 1
 #include <cpuid.h>
 #endif
+
+#if defined(USE_SSE2) && !defined(BUILD_BITCOIN_INTERNAL)
+void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchpad);
+void scrypt_1024_1_1_256_sp_sse2_4way(const char *input, char *output, char *scratchpad);
+void scrypt_core_sse2(uint8_t *B, char *scratchpad);
+void scrypt_core_sse2_4way(uint8_t *B, char *scratchpad);
+#endif
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+void scrypt_1024_1_1_256_sp_avx2_8way(const char *input, char *output, char *scratchpad);
+void scrypt_core_avx2_8way(uint8_t *B, char *scratchpad);
+#endif
+#if defined(ENABLE_AVX512) && !defined(BUILD_BITCOIN_INTERNAL)
+void scrypt_1024_1_1_256_sp_avx512_16way(const char *input, char *output, char *scratchpad);
+void scrypt_core_avx512_16way(uint8_t *B, char *scratchpad);
 #endif
 
 static inline uint32_t be32dec(const void *pp)
@@ -253,17 +272,14 @@ static inline void xor_salsa8(uint32_t B[16], const uint32_t Bx[16])
 	B[15] += x15;
 }
 
-void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad)
+void scrypt_core_generic(uint8_t *B, char *scratchpad)
 {
-	uint8_t B[128];
 	uint32_t X[32];
 	uint32_t *V;
 	uint32_t i, j, k;
 
 	V = (uint32_t *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
 
-	PBKDF2_SHA256((const uint8_t *)input, 80, (const uint8_t *)input, 80, 1, B, 128);
-
 	for (k = 0; k < 32; k++)
 		X[k] = le32dec(&B[4 * k]);
 
@@ -282,48 +298,308 @@ void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scrat
 
 	for (k = 0; k < 32; k++)
 		le32enc(&B[4 * k], X[k]);
+}
 
+void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad)
+{
+	uint8_t B[128];
+
+	PBKDF2_SHA256((const uint8_t *)input, 80, (const uint8_t *)input, 80, 1, B, 128);
+	scrypt_core_generic(B, scratchpad);
 	PBKDF2_SHA256((const uint8_t *)input, 80, B, 128, 1, (uint8_t *)output, 32);
 }
 
-#if defined(USE_SSE2)
-// By default, set to generic scrypt function. This will prevent crash in case when scrypt_detect_sse2() wasn't called
-void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad) = &scrypt_1024_1_1_256_sp_generic;
+// By default, use the generic scrypt functions. This prevents a crash in case scrypt_detect() wasn't called.
+static void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad) = &scrypt_1024_1_1_256_sp_generic;
 
-void scrypt_detect_sse2()
+// Kernels used by scrypt_1024_1_1_256_sp_multi(), widest first; the last one always has a single lane.
+static const size_t SCRYPT_MAX_LANES = 16;
+static ScryptKernel scrypt_multi_kernels[5] = {{"generic", 1, &scrypt_1024_1_1_256_sp_generic, &scrypt_core_generic}};
+static size_t scrypt_multi_kernel_count = 1;
+
+#if defined(SCRYPT_CPUID_DISPATCH)
+/** Read XCR0, which tells whether the OS saves the AVX/AVX-512 register state. */
+static uint64_t scrypt_xgetbv()
 {
-#if defined(USE_SSE2_ALWAYS)
-    printf("scrypt: using scrypt-sse2 as built.\n");
-#else // USE_SSE2_ALWAYS
-    // 32bit x86 Linux or Windows, detect cpuid features
-    unsigned int cpuid_edx=0;
-#if defined(_MSC_VER)
-    // MSVC
-    int x86cpuid[4];
-    __cpuid(x86cpuid, 1);
-    cpuid_edx = (unsigned int)buffer[3];
-#else // _MSC_VER
-    // Linux or i686-w64-mingw32 (gcc-4.6.3)
-    unsigned int eax, ebx, ecx;
-    __get_cpuid(1, &eax, &ebx, &ecx, &cpuid_edx);
-#endif // _MSC_VER
-
-    if (cpuid_edx & 1<<26)
-    {
-        scrypt_1024_1_1_256_sp_detected = &scrypt_1024_1_1_256_sp_sse2;
-        printf("scrypt: using scrypt-sse2 as detected.\n");
-    }
-    else
-    {
-        scrypt_1024_1_1_256_sp_detected = &scrypt_1024_1_1_256_sp_generic;
-        printf("scrypt: using scrypt-generic, SSE2 unavailable.\n");
-    }
-#endif // USE_SSE2_ALWAYS
+	uint32_t a, d;
+	__asm__ ("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+	return a | ((uint64_t)d << 32);
 }
 #endif
 
+std::vector<ScryptKernel> scrypt_supported_kernels()
+{
+	std::vector<ScryptKernel> kernels;
+	ScryptKernel generic = {"generic", 1, &scrypt_1024_1_1_256_sp_generic, &scrypt_core_generic};
+	kernels.push_back(generic);
+
+#if defined(SCRYPT_CPUID_DISPATCH)
+	uint32_t eax, ebx, ecx, edx;
+	uint32_t cpuid1_ecx = 0, cpuid1_edx = 0, cpuid7_ebx = 0;
+	uint64_t xcr0 = 0;
+	if (__get_cpuid(1, &eax, &ebx, &cpuid1_ecx, &cpuid1_edx)) {
+		if ((cpuid1_ecx >> 27) & 1)
+			xcr0 = scrypt_xgetbv();
+		if (__get_cpuid_max(0, NULL) >= 7) {
+			__cpuid_count(7, 0, eax, cpuid7_ebx, ecx, edx);
+		}
+	}
+
+#if defined(USE_SSE2) && !defined(BUILD_BITCOIN_INTERNAL)
+	if ((cpuid1_edx >> 26) & 1) {
+		ScryptKernel sse2 = {"sse2", 1, &scrypt_1024_1_1_256_sp_sse2, &scrypt_core_sse2};
+		ScryptKernel sse2_4way = {"sse2(4way)", 4, &scrypt_1024_1_1_256_sp_sse2_4way, &scrypt_core_sse2_4way};
+		kernels.push_back(sse2);
+		kernels.push_back(sse2_4way);
+	}
+#endif
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+	// AVX2 needs the OS to save both the xmm (bit 1) and ymm (bit 2) state
+	if (((cpuid1_ecx >> 28) & 1) && ((cpuid7_ebx >> 5) & 1) && (xcr0 & 0x6) == 0x6) {
+		ScryptKernel avx2_8way = {"avx2(8way)", 8, &scrypt_1024_1_1_256_sp_avx2_8way, &scrypt_core_avx2_8way};
+		kernels.push_back(avx2_8way);
+	}
+#endif
+#if defined(ENABLE_AVX512) && !defined(BUILD_BITCOIN_INTERNAL)
+	// AVX-512 additionally needs the opmask and zmm state (bits 5-7)
+	if (((cpuid7_ebx >> 16) & 1) && (xcr0 & 0xe6) == 0xe6) {
+		ScryptKernel avx512_16way = {"avx512(16way)", 16, &scrypt_1024_1_1_256_sp_avx512_16way, &scrypt_core_avx512_16way};
+		kernels.push_back(avx512_16way);
+	}
+#endif
+#endif // SCRYPT_CPUID_DISPATCH
+
+	return kernels;
+}
+
+std::string scrypt_detect()
+{
+	std::vector<ScryptKernel> kernels = scrypt_supported_kernels();
+	std::string ret;
+
+	// Walk from the widest kernel down, keeping the preferred (last listed) kernel of each width
+	scrypt_multi_kernel_count = 0;
+	for (size_t i = kernels.size(); i-- > 0; ) {
+		if (scrypt_multi_kernel_count > 0 && scrypt_multi_kernels[scrypt_multi_kernel_count - 1].lanes <= kernels[i].lanes)
+			continue;
+		scrypt_multi_kernels[scrypt_multi_kernel_count++] = kernels[i];
+		if (!ret.empty())
+			ret += ",";
+		ret += kernels[i].name;
+	}
+	scrypt_1024_1_1_256_sp_detected = scrypt_multi_kernels[scrypt_multi_kernel_count - 1].hash;
+
+	return ret;
+}
+
+void scrypt_1024_1_1_256_sp(const char *input, char *output, char *scratchpad)
+{
+	scrypt_1024_1_1_256_sp_detected(input, output, scratchpad);
+}
+
+size_t scrypt_multi_lanes()
+{
+	return scrypt_multi_kernels[0].lanes;
+}
+
+void scrypt_1024_1_1_256_sp_multi(const char *inputs, char *outputs, size_t n)
+{
+	CScryptContext::ThreadLocal().HashMulti(inputs, outputs, n);
+}
+
 void scrypt_1024_1_1_256(const char *input, char *output)
 {
-	char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
-    scrypt_1024_1_1_256_sp(input, output, scratchpad);
+	CScryptContext::ThreadLocal().Hash(input, output);
+}
+
+CScryptContext::CScryptContext() : scratchpad(NULL), capacity(0)
+{
+}
+
+CScryptContext::~CScryptContext()
+{
+	Free();
+}
+
+void CScryptContext::Free()
+{
+	if (scratchpad == NULL)
+		return;
+#ifndef WIN32
+	munmap(scratchpad, capacity);
+#else
+	free(scratchpad);
+#endif
+	scratchpad = NULL;
+	capacity = 0;
+}
+
+char *CScryptContext::Scratchpad(size_t lanes)
+{
+#ifndef WIN32
+	// mmap returns page-aligned memory, so the kernels need no slack to
+	// align it and 16 lanes fit exactly in one 2 MiB huge page
+	size_t needed = scrypt_scratchpad_size_aligned(lanes);
+#else
+	size_t needed = scrypt_scratchpad_size(lanes);
+#endif
+	if (needed <= capacity)
+		return scratchpad;
+	Free();
+
+#ifndef WIN32
+	// Round up to whole 2 MiB huge pages
+	const size_t hugepage = 2 * 1024 * 1024;
+	size_t size = (needed + hugepage - 1) & ~(hugepage - 1);
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		abort();
+#if defined(MADV_HUGEPAGE)
+	madvise(p, size, MADV_HUGEPAGE);
+#endif
+#else
+	size_t size = needed;
+	void *p = malloc(size);
+	if (p == NULL)
+		abort();
+#endif
+	scratchpad = (char *)p;
+	capacity = size;
+	return scratchpad;
+}
+
+void CScryptContext::Hash(const char *input, char *output)
+{
+	scrypt_1024_1_1_256_sp_detected(input, output, Scratchpad(1));
+}
+
+/** Index of the widest selected kernel that a batch of n inputs can fill */
+static size_t scrypt_first_kernel(size_t n)
+{
+	size_t k = 0;
+	while (scrypt_multi_kernels[k].lanes > n)
+		k++;
+	return k;
+}
+
+void CScryptContext::HashMulti(const char *inputs, char *outputs, size_t n)
+{
+	if (n == 0)
+		return;
+
+	size_t k = scrypt_first_kernel(n);
+	char *sp = Scratchpad(scrypt_multi_kernels[k].lanes);
+	for (; k < scrypt_multi_kernel_count; k++) {
+		const ScryptKernel& kernel = scrypt_multi_kernels[k];
+		while (n >= kernel.lanes) {
+			kernel.hash(inputs, outputs, sp);
+			inputs += 80 * kernel.lanes;
+			outputs += 32 * kernel.lanes;
+			n -= kernel.lanes;
+		}
+	}
+}
+
+void CScryptContext::HashMulti(const CScryptMidstate& midstate, const char *tails, char *outputs, size_t n)
+{
+	uint8_t B[128 * SCRYPT_MAX_LANES];
+	CScryptMidstate::HMACKey keys[SCRYPT_MAX_LANES];
+	size_t l;
+
+	if (n == 0)
+		return;
+
+	size_t k = scrypt_first_kernel(n);
+	char *sp = Scratchpad(scrypt_multi_kernels[k].lanes);
+	for (; k < scrypt_multi_kernel_count; k++) {
+		const ScryptKernel& kernel = scrypt_multi_kernels[k];
+		while (n >= kernel.lanes) {
+			for (l = 0; l < kernel.lanes; l++)
+				midstate.Begin(&tails[16 * l], &B[128 * l], keys[l]);
+			kernel.core(B, sp);
+			for (l = 0; l < kernel.lanes; l++)
+				CScryptMidstate::Finish(keys[l], &B[128 * l], &outputs[32 * l]);
+			tails += 16 * kernel.lanes;
+			outputs += 32 * kernel.lanes;
+			n -= kernel.lanes;
+		}
+	}
+}
+
+CScryptContext& CScryptContext::ThreadLocal()
+{
+	static thread_local CScryptContext context;
+	return context;
+}
+
+CScryptMidstate::CScryptMidstate(const char *prefixIn)
+{
+	memcpy(prefix, prefixIn, 64);
+	SHA256_Init(&keyhash);
+	SHA256_Update(&keyhash, prefix, 64);
+}
+
+void CScryptMidstate::Begin(const char *tail, uint8_t B[128], HMACKey& key) const
+{
+	SHA256_CTX ctx, salted;
+	unsigned char khash[32];
+	unsigned char pad[64];
+	unsigned char U[32];
+	uint8_t ivec[4];
+	uint32_t i;
+
+	/* The 80-byte key is longer than a block, so the HMAC key is SHA256(header). */
+	memcpy(&ctx, &keyhash, sizeof(SHA256_CTX));
+	SHA256_Update(&ctx, tail, 16);
+	SHA256_Final(khash, &ctx);
+
+	SHA256_Init(&key.inner);
+	memset(pad, 0x36, 64);
+	for (i = 0; i < 32; i++)
+		pad[i] ^= khash[i];
+	SHA256_Update(&key.inner, pad, 64);
+
+	SHA256_Init(&key.outer);
+	memset(pad, 0x5c, 64);
+	for (i = 0; i < 32; i++)
+		pad[i] ^= khash[i];
+	SHA256_Update(&key.outer, pad, 64);
+
+	/* U_1 = PRF(header, header || INT(i)); the salt's first block is shared by all four. */
+	memcpy(&salted, &key.inner, sizeof(SHA256_CTX));
+	SHA256_Update(&salted, prefix, 64);
+	for (i = 0; i < 4; i++) {
+		be32enc(ivec, i + 1);
+		memcpy(&ctx, &salted, sizeof(SHA256_CTX));
+		SHA256_Update(&ctx, tail, 16);
+		SHA256_Update(&ctx, ivec, 4);
+		SHA256_Final(U, &ctx);
+		memcpy(&ctx, &key.outer, sizeof(SHA256_CTX));
+		SHA256_Update(&ctx, U, 32);
+		SHA256_Final(&B[32 * i], &ctx);
+	}
+
+	/* Clean the stack. */
+	memset(khash, 0, 32);
+	memset(pad, 0, 64);
+}
+
+void CScryptMidstate::Finish(const HMACKey& key, const uint8_t B[128], char *output)
+{
+	static const uint8_t ivec[4] = {0, 0, 0, 1};
+	SHA256_CTX ctx;
+	unsigned char U[32];
+
+	memcpy(&ctx, &key.inner, sizeof(SHA256_CTX));
+	SHA256_Update(&ctx, B, 128);
+	SHA256_Update(&ctx, ivec, 4);
+	SHA256_Final(U, &ctx);
+	memcpy(&ctx, &key.outer, sizeof(SHA256_CTX));
+	SHA256_Update(&ctx, U, 32);
+	SHA256_Final((unsigned char *)output, &ctx);
+}
+
+void CScryptMidstate::Hash(const char *tail, char *output) const
+{
+	CScryptContext::ThreadLocal().HashMulti(*this, tail, output, 1);
 }
@@ -3,25 +3,126 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#include <openssl/sha.h>
+
+#include <string>
+#include <vector>
+
 static const int SCRYPT_SCRATCHPAD_SIZE = 131072 + 63;
 
+/** Scratchpad size for a kernel hashing `lanes` inputs at once (including alignment slack). */
+static inline size_t scrypt_scratchpad_size(size_t lanes)
+{
+    return lanes * 131072 + 63;
+}
+
+/** As scrypt_scratchpad_size(), for a buffer that is already 64-byte aligned. */
+static inline size_t scrypt_scratchpad_size_aligned(size_t lanes)
+{
+    return lanes * 131072;
+}
+
 void scrypt_1024_1_1_256(const char *input, char *output);
+void scrypt_1024_1_1_256_sp(const char *input, char *output, char *scratchpad);
 void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad);
+/** The salsa20/8 mixing step alone, applied in place to a 128-byte PBKDF2 output. */
+void scrypt_core_generic(uint8_t *B, char *scratchpad);
 
-#if defined(USE_SSE2)
-#if defined(_M_X64) || defined(__x86_64__) || defined(_M_AMD64) || (defined(MAC_OSX) && defined(__i386__))
-#define USE_SSE2_ALWAYS 1
-#define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_sse2((input), (output), (scratchpad))
-#else
-#define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_detected((input), (output), (scratchpad))
-#endif
+/**
+ * Hash n consecutive 80-byte inputs into n consecutive 32-byte outputs, using
+ * the widest interleaved kernels selected by scrypt_detect().
+ */
+void scrypt_1024_1_1_256_sp_multi(const char *inputs, char *outputs, size_t n);
 
-void scrypt_detect_sse2();
-void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchpad);
-extern void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad);
-#else
-#define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_generic((input), (output), (scratchpad))
-#endif
+/** Number of inputs the widest selected kernel hashes at once */
+size_t scrypt_multi_lanes();
+
+/** A scrypt(1024,1,1) implementation hashing `lanes` consecutive inputs per call. */
+struct ScryptKernel
+{
+    const char *name;
+    size_t lanes;
+    void (*hash)(const char *input, char *output, char *scratchpad);
+    /** Mixing step only, on `lanes` consecutive 128-byte blocks, for callers doing their own PBKDF2. */
+    void (*core)(uint8_t *B, char *scratchpad);
+};
+
+/** Kernels that are compiled in and supported by the running CPU, narrowest first. */
+std::vector<ScryptKernel> scrypt_supported_kernels();
+
+/** Select the fastest supported kernels for this CPU and return their names. */
+std::string scrypt_detect();
+
+class CScryptMidstate;
+
+/**
+ * Reusable scrypt scratchpad. The buffer is 64-byte aligned, grows to fit the
+ * widest kernel on first use and, where the OS supports it, is backed by
+ * transparent huge pages. Not thread-safe; use one context per thread.
+ */
+class CScryptContext
+{
+public:
+	CScryptContext();
+	~CScryptContext();
+
+	/** Hash one 80-byte input with the kernel selected by scrypt_detect(). */
+	void Hash(const char *input, char *output);
+	/** As scrypt_1024_1_1_256_sp_multi(), without allocating. */
+	void HashMulti(const char *inputs, char *outputs, size_t n);
+	/** Hash n headers sharing midstate's prefix, given as consecutive 16-byte tails. */
+	void HashMulti(const CScryptMidstate& midstate, const char *tails, char *outputs, size_t n);
+
+	/** Context owned by the calling thread, created on first use. */
+	static CScryptContext& ThreadLocal();
+
+private:
+	char *scratchpad;
+	size_t capacity;
+
+	char *Scratchpad(size_t lanes);
+	void Free();
+
+	CScryptContext(const CScryptContext&);
+	CScryptContext& operator=(const CScryptContext&);
+};
+
+/**
+ * Precomputed SHA-256 state for hashing many 80-byte headers that share their
+ * first 64 bytes, as in a nonce search where only the final 16 bytes (nTime,
+ * nBits, nNonce) change.
+ *
+ * The PBKDF2-HMAC-SHA256 key is the whole header, so only the hash of its
+ * first block is shared across nonces; per header the HMAC pads are then
+ * derived once and reused by both PBKDF2 steps, instead of twice each.
+ */
+class CScryptMidstate
+{
+public:
+	/** prefix is the first 64 bytes of the header. */
+	explicit CScryptMidstate(const char *prefix);
+
+	/** Hash prefix || tail, where tail is the final 16 bytes of the header. */
+	void Hash(const char *tail, char *output) const;
+
+private:
+	friend class CScryptContext;
+
+	/** HMAC-SHA256 state keyed with one header */
+	struct HMACKey
+	{
+		SHA256_CTX inner;
+		SHA256_CTX outer;
+	};
+
+	unsigned char prefix[64];
+	SHA256_CTX keyhash;
+
+	/** B = PBKDF2(header, header, 1, 128); key receives the HMAC state for Finish(). */
+	void Begin(const char *tail, uint8_t B[128], HMACKey& key) const;
+	/** output = PBKDF2(header, B, 1, 32) */
+	static void Finish(const HMACKey& key, const uint8_t B[128], char *output);
+};
 
 void
 PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
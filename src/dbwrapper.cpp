@@ -8,6 +8,7 @@
 #include "random.h"
 
 #include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -15,14 +16,88 @@
 #include <memenv.h>
 #include <stdint.h>
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+const CDBProfile LEGACY_DB_PROFILE = {"legacy", 4096, false, 10, 50, 25, 64};
+
+static const CDBProfile DB_PROFILES[] = {
+    LEGACY_DB_PROFILE,
+    // Random point lookups and large flush batches: small blocks keep each
+    // lookup to one short read, and a larger write buffer turns a flush into
+    // fewer level-0 tables to compact.
+    {"coins", 4096, false, 10, 40, 30, 64},
+    // Scanned front to back at startup, with point lookups only for -txindex:
+    // bigger blocks make the scan cheaper.
+    {"index", 16384, false, 10, 50, 25, 64},
+    // Loaded by a scan at startup and rarely read after: no filter, few files.
+    {"small", 4096, false, 0, 50, 25, 16},
+};
+
+static const struct {
+    const char* pszDatabase;
+    const char* pszProfile;
+} DB_DEFAULT_PROFILES[] = {
+    {"chainstate", "coins"},
+    {"index", "index"},
+    {"oerushield", "small"},
+};
+
+const CDBProfile* FindDBProfile(const std::string& strName)
+{
+    for (unsigned int i = 0; i < ARRAYLEN(DB_PROFILES); i++) {
+        if (strName == DB_PROFILES[i].pszName)
+            return &DB_PROFILES[i];
+    }
+    return NULL;
+}
+
+std::string ListDBProfiles()
+{
+    std::string strList;
+    for (unsigned int i = 0; i < ARRAYLEN(DB_PROFILES); i++)
+        strList += (i ? ", " : "") + std::string(DB_PROFILES[i].pszName);
+    return strList;
+}
+
+bool ParseDBProfileArg(const std::string& strArg, std::string& strDatabase, const CDBProfile*& profile)
+{
+    size_t nColon = strArg.find(':');
+    if (nColon == std::string::npos)
+        return false;
+    strDatabase = strArg.substr(0, nColon);
+    profile = FindDBProfile(strArg.substr(nColon + 1));
+    for (unsigned int i = 0; i < ARRAYLEN(DB_DEFAULT_PROFILES); i++) {
+        if (strDatabase == DB_DEFAULT_PROFILES[i].pszDatabase)
+            return profile != NULL;
+    }
+    return false;
+}
+
+const CDBProfile& GetDBProfile(const std::string& strDatabase)
+{
+    const CDBProfile* profile = NULL;
+    for (unsigned int i = 0; i < ARRAYLEN(DB_DEFAULT_PROFILES); i++) {
+        if (strDatabase == DB_DEFAULT_PROFILES[i].pszDatabase)
+            profile = FindDBProfile(DB_DEFAULT_PROFILES[i].pszProfile);
+    }
+    if (mapMultiArgs.count("-dbprofile")) {
+        BOOST_FOREACH(const std::string& strArg, mapMultiArgs.at("-dbprofile")) {
+            std::string strArgDatabase;
+            const CDBProfile* argProfile;
+            if (ParseDBProfileArg(strArg, strArgDatabase, argProfile) && strArgDatabase == strDatabase)
+                profile = argProfile;
+        }
+    }
+    return profile ? *profile : LEGACY_DB_PROFILE;
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, const CDBProfile& profile)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.block_cache = leveldb::NewLRUCache(nCacheSize * profile.nBlockCachePercent / 100);
+    options.write_buffer_size = nCacheSize * profile.nWriteBufferPercent / 100; // up to two write buffers may be held in memory simultaneously
+    options.filter_policy = profile.nBloomBits ? leveldb::NewBloomFilterPolicy(profile.nBloomBits) : NULL;
+    options.block_size = profile.nBlockSize;
+    options.compression = profile.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = profile.nMaxOpenFiles;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -31,14 +106,14 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, const CDBProfile& profile)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, profile);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -50,7 +125,7 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
             dbwrapper_private::HandleError(result);
         }
         TryCreateDirectory(path);
-        LogPrintf("Opening LevelDB in %s\n", path.string());
+        LogPrintf("Opening LevelDB in %s (profile %s)\n", path.string(), profile.pszName);
     }
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
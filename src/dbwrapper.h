@@ -25,6 +25,42 @@ public:
 
 class CDBWrapper;
 
+/**
+ * LevelDB tuning for one database. Databases differ in how they are read:
+ * the chainstate takes random point lookups, the block index is scanned at
+ * startup, and the OeruShield database is tiny. LevelDB has no column
+ * families, so each database gets its own profile instead.
+ */
+struct CDBProfile
+{
+    const char* pszName;
+    //! Approximate amount of user data packed into each table block
+    size_t nBlockSize;
+    //! Snappy-compress blocks; without snappy support in LevelDB they are stored as is
+    bool fCompression;
+    //! Bloom filter bits per key, or 0 for no filter
+    int nBloomBits;
+    //! Shares of the cache budget, in percent. Up to two write buffers can be held at
+    //! once, and each one filled triggers a level-0 table, so the write buffer also
+    //! sets how often compactions run.
+    int nBlockCachePercent;
+    int nWriteBufferPercent;
+    //! Table files kept open; file descriptors are budgeted for at most 64
+    int nMaxOpenFiles;
+};
+
+//! The settings used for every database before profiles existed
+extern const CDBProfile LEGACY_DB_PROFILE;
+
+//! Profile with the given name, or NULL if there is none
+const CDBProfile* FindDBProfile(const std::string& strName);
+//! Names of all profiles, for the help message
+std::string ListDBProfiles();
+/** Parse a -dbprofile=<database>:<profile> argument. Returns false if it is malformed. */
+bool ParseDBProfileArg(const std::string& strArg, std::string& strDatabase, const CDBProfile*& profile);
+/** Profile for a database (chainstate, index or oerushield): the last -dbprofile given for it, or its default */
+const CDBProfile& GetDBProfile(const std::string& strDatabase);
+
 /** These should be considered an implementation detail of the specific database.
  */
 namespace dbwrapper_private {
@@ -192,8 +228,9 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] profile     LevelDB tuning, see GetDBProfile().
      */
-    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const CDBProfile& profile = LEGACY_DB_PROFILE);
     ~CDBWrapper();
 
     template <typename K, typename V>
@@ -11,10 +11,12 @@
 
 #include "addrman.h"
 #include "amount.h"
+#include "blockfilemap.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
+#include "crypto/scrypt.h"
 #include "consensus/validation.h"
 #include "httpserver.h"
 #include "httprpc.h"
@@ -33,6 +35,7 @@
 #include "timedata.h"
 #include "txdb.h"
 #include "txmempool.h"
+#include "stratum.h"
 #include "torcontrol.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -163,6 +166,12 @@ public:
 
 static CCoinsViewDB *pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher *pcoinscatcher = NULL;
+
+/** Write the OeruShield state prepared with a coins snapshot, once the coins are on disk */
+static bool WriteOeruPrepared()
+{
+    return !poeruDBMain || poeruDBMain->WritePrepared();
+}
 static boost::scoped_ptr<ECCVerifyHandle> globalVerifyHandle;
 
 void Interrupt(boost::thread_group& threadGroup)
@@ -172,6 +181,7 @@ void Interrupt(boost::thread_group& threadGroup)
     InterruptRPC();
     InterruptREST();
     InterruptTorControl();
+    InterruptStratum();
     threadGroup.interrupt_all();
 }
 
@@ -190,9 +200,6 @@ void Shutdown()
     RenameThread("egulden-shutoff");
     mempool.AddTransactionsUpdated(1);
 
-    // Write oeru DB data
-    poeruDBMain->WriteFile();
-
     StopHTTPRPC();
     StopREST();
     StopRPC();
@@ -203,6 +210,7 @@ void Shutdown()
 #endif
     StopNode();
     StopTorControl();
+    StopStratum();
     UnregisterNodeSignals(GetNodeSignals());
 
     if (fFeeEstimatesInitialized)
@@ -225,10 +233,14 @@ void Shutdown()
         pcoinsTip = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
+        delete pcoinsSnapshot;
+        pcoinsSnapshot = NULL;
         delete pcoinsdbview;
         pcoinsdbview = NULL;
         delete pblocktree;
         pblocktree = NULL;
+        delete poeruDBMain;
+        poeruDBMain = NULL;
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
@@ -251,6 +263,10 @@ void Shutdown()
     }
 #endif
     UnregisterAllValidationInterfaces();
+    delete poeruSignalMain;
+    poeruSignalMain = nullptr;
+    delete pblockTemplateCache;
+    pblockTemplateCache = NULL;
 #ifdef ENABLE_WALLET
     delete pwalletMain;
     pwalletMain = NULL;
@@ -288,6 +304,8 @@ bool static Bind(const CService &addr, unsigned int flags) {
 void OnRPCStopped()
 {
     cvBlockChange.notify_all();
+    if (pblockTemplateCache)
+        pblockTemplateCache->Interrupt();
     LogPrint("rpc", "RPC stopped.\n");
 }
 
@@ -310,11 +328,14 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-?", _("Print this help message and exit"));
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-backgroundflush", strprintf(_("Write the database cache to disk on a separate thread while validation continues; the cache and the part being written share -dbcache (default: %u)"), DEFAULT_BACKGROUND_FLUSH));
+    strUsage += HelpMessageOpt("-blockmmapfiles=<n>", strprintf(_("Keep up to <n> block files memory-mapped for serving blocks to peers, 0 to read them with file I/O (default: %u)"), DEFAULT_BLOCK_MMAP_FILES));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
+    strUsage += HelpMessageOpt("-checkpowonload", strprintf(_("Recompute and verify the proof of work of all block headers in parallel at startup (default: %u)"), DEFAULT_CHECKPOWONLOAD));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), BITCOIN_CONF_FILENAME));
     if (mode == HMM_BITCOIND)
     {
@@ -324,6 +345,8 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-dbprofile=<db>:<profile>", strprintf("Use a LevelDB tuning profile for chainstate, index or oerushield (%s; default: coins, index and small). This option can be specified multiple times", ListDBProfiles()));
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
@@ -402,6 +425,12 @@ std::string HelpMessage(HelpMessageMode mode)
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
     strUsage += HelpMessageOpt("-uacomment=<cmt>", _("Append comment to the user agent string"));
+    strUsage += HelpMessageOpt("-oerusignalendpoint=<host[:port]>", strprintf(_("Send OeruShield usage signals to this endpoint when -uacomment is set (default: %s)"), DEFAULT_OERUSIGNAL_ENDPOINT));
+    strUsage += HelpMessageOpt("-oerusignaltimeout=<n>", strprintf(_("Timeout in seconds for OeruShield usage signal requests (default: %u)"), DEFAULT_OERUSIGNAL_TIMEOUT));
+    if (showDebug) {
+        strUsage += HelpMessageOpt("-oerusignalqueue=<n>", strprintf("Maximum number of queued OeruShield usage signals (default: %u)", DEFAULT_OERUSIGNAL_QUEUE));
+        strUsage += HelpMessageOpt("-oerusignalretries=<n>", strprintf("Number of times a failed OeruShield usage signal is retried (default: %u)", DEFAULT_OERUSIGNAL_RETRIES));
+    }
     if (showDebug)
     {
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
@@ -411,6 +440,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-testsafemode", strprintf("Force safe mode (default: %u)", DEFAULT_TESTSAFEMODE));
         strUsage += HelpMessageOpt("-dropmessagestest=<n>", "Randomly drop 1 of every <n> network messages");
         strUsage += HelpMessageOpt("-fuzzmessagestest=<n>", "Randomly fuzz 1 of every <n> network messages");
+        strUsage += HelpMessageOpt("-reindexthreads=<n>", strprintf("Number of threads reading block files during -reindex (1 to %d, default: number of cores)", MAX_REINDEX_SCAN_THREADS));
         strUsage += HelpMessageOpt("-stopafterblockimport", strprintf("Stop running after importing blocks from disk (default: %u)", DEFAULT_STOPAFTERBLOCKIMPORT));
         strUsage += HelpMessageOpt("-limitancestorcount=<n>", strprintf("Do not accept transactions if number of in-mempool ancestors is <n> or more (default: %u)", DEFAULT_ANCESTOR_LIMIT));
         strUsage += HelpMessageOpt("-limitancestorsize=<n>", strprintf("Do not accept transactions whose size with all in-mempool ancestors exceeds <n> kilobytes (default: %u)", DEFAULT_ANCESTOR_SIZE_LIMIT));
@@ -418,7 +448,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-limitdescendantsize=<n>", strprintf("Do not accept transactions if any ancestor would have more than <n> kilobytes of in-mempool descendants (default: %u).", DEFAULT_DESCENDANT_SIZE_LIMIT));
         strUsage += HelpMessageOpt("-bip9params=deployment:start:end", "Use given start/end times for specified bip9 deployment (regtest-only)");
     }
-    string debugCategories = "addrman, alert, bench, cmpctblock, coindb, db, http, libevent, lock, mempool, mempoolrej, net, proxy, prune, rand, reindex, rpc, selectcoins, tor, zmq"; // Don't translate these and qt below
+    string debugCategories = "addrman, alert, bench, cmpctblock, coindb, db, http, libevent, lock, mempool, mempoolrej, net, proxy, prune, rand, reindex, rpc, selectcoins, stratum, tor, zmq"; // Don't translate these and qt below
     if (mode == HMM_BITCOIN_QT)
         debugCategories += ", qt";
     strUsage += HelpMessageOpt("-debug=<category>", strprintf(_("Output debugging information (default: %u, supplying <category> is optional)"), 0) + ". " +
@@ -465,6 +495,13 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug)
         strUsage += HelpMessageOpt("-blockversion=<n>", "Override block version to test forking scenarios");
 
+    strUsage += HelpMessageGroup(_("Stratum server options:"));
+    strUsage += HelpMessageOpt("-stratum", strprintf(_("Accept stratum v1 connections from miners (default: %u)"), DEFAULT_STRATUM));
+    strUsage += HelpMessageOpt("-stratumaddress=<addr>", _("Pay blocks found by stratum miners to <addr>; required with -stratum"));
+    strUsage += HelpMessageOpt("-stratumbind=<addr>", strprintf(_("Bind the stratum server to the given address (default: %s)"), DEFAULT_STRATUM_BIND));
+    strUsage += HelpMessageOpt("-stratumdifficulty=<n>", strprintf(_("Share difficulty for stratum miners (default: %g)"), DEFAULT_STRATUM_DIFFICULTY));
+    strUsage += HelpMessageOpt("-stratumport=<port>", strprintf(_("Listen for stratum connections on <port> (default: %u)"), DEFAULT_STRATUM_PORT));
+
     strUsage += HelpMessageGroup(_("RPC server options:"));
     strUsage += HelpMessageOpt("-server", _("Accept command line and JSON-RPC commands"));
     strUsage += HelpMessageOpt("-rest", strprintf(_("Accept public REST requests (default: %u)"), DEFAULT_REST_ENABLE));
@@ -596,18 +633,8 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
 
     // -reindex
     if (fReindex) {
-        int nFile = 0;
-        while (true) {
-            CDiskBlockPos pos(nFile, 0);
-            if (!boost::filesystem::exists(GetBlockPosFilename(pos, "blk")))
-                break; // No block files left to reindex
-            FILE *file = OpenBlockFile(pos, true);
-            if (!file)
-                break; // This error is logged in OpenBlockFile
-            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(chainparams, file, &pos);
-            nFile++;
-        }
+        int nScanThreads = GetArg("-reindexthreads", std::min(GetNumCores(), MAX_REINDEX_SCAN_THREADS));
+        ReindexBlockFiles(chainparams, std::max(1, std::min(nScanThreads, MAX_REINDEX_SCAN_THREADS)));
         pblocktree->WriteReindexing(false);
         fReindex = false;
         LogPrintf("Reindexing finished\n");
@@ -994,8 +1021,17 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (GetArg("-rpcserialversion", DEFAULT_RPC_SERIALIZE_VERSION) > 1)
         return InitError("unknown rpcserialversion requested.");
 
+    BOOST_FOREACH(const std::string& strArg, mapMultiArgs["-dbprofile"]) {
+        std::string strDatabase;
+        const CDBProfile* profile;
+        if (!ParseDBProfileArg(strArg, strDatabase, profile))
+            return InitError(strprintf(_("Invalid -dbprofile '%s' (profiles: %s)"), strArg, ListDBProfiles()));
+    }
+
     nMaxTipAge = GetArg("-maxtipage", DEFAULT_MAX_TIP_AGE);
 
+    mappedBlockFiles.SetMaxFiles(std::max<int64_t>(0, GetArg("-blockmmapfiles", DEFAULT_BLOCK_MMAP_FILES)));
+
     fEnableReplacement = GetBoolArg("-mempoolreplacement", DEFAULT_ENABLE_REPLACEMENT);
     if ((!fEnableReplacement) && mapArgs.count("-mempoolreplacement")) {
         // Minimal effort at forwards compatibility
@@ -1082,10 +1118,13 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i connections (%i file descriptors available)\n", nMaxConnections, nFD);
     std::ostringstream strErrors;
 
-    LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+    LogPrintf("Using %u threads for script and header proof-of-work verification and coins prefetching\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i=0; i<nScriptCheckThreads-1; i++)
+        for (int i=0; i<nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadPoWCheck);
+            threadGroup.create_thread(&ThreadCoinsPrefetch);
+        }
     }
 
     // Start the lightweight task scheduler thread
@@ -1106,9 +1145,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     int64_t nStart;
 
-#if defined(USE_SSE2)
-    scrypt_detect_sse2();
-#endif
+    LogPrintf("Using scrypt kernels: %s\n", scrypt_detect());
 
     // ********************************************************* Step 5: verify wallet database integrity
 #ifdef ENABLE_WALLET
@@ -1256,14 +1293,15 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     bool fReindexChainState = GetBoolArg("-reindex-chainstate", false);
 
     // Initialize OeruDB
-    boost::filesystem::path oeruDBPath = GetDataDir() / GetArg("-oerudb", "oeru.db");
-    COeruDB::InitOeruDB(oeruDBPath.string().c_str(), fReindex);
+    boost::filesystem::path oeruDBLegacyPath = GetDataDir() / GetArg("-oerudb", "oeru.db");
+    COeruDB::InitOeruDB(GetDataDir() / "oerushield", oeruDBLegacyPath, fReindex);
 
     // Initialize OeruSignal
     std::string strUAComment = GetArg("-uacomment", "");
     if (strUAComment != "")
     {
         COeruSignal::InitOeruSignal(strUAComment);
+        poeruSignalMain->StartDispatcher(threadGroup);
     }
 
     // Upgrading to 0.8; hard-link the old blknnnn.dat files into /blocks/
@@ -1321,14 +1359,16 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             try {
                 UnloadBlockIndex();
                 delete pcoinsTip;
-                delete pcoinsdbview;
                 delete pcoinscatcher;
+                delete pcoinsSnapshot;
+                delete pcoinsdbview;
                 delete pblocktree;
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
-                pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
-                pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                pcoinsSnapshot = new CCoinsViewSnapshot(pcoinsdbview, GetBoolArg("-backgroundflush", DEFAULT_BACKGROUND_FLUSH), WriteOeruPrepared);
+                pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsSnapshot);
+                pcoinsTip = new CCoinsViewCache(pcoinscatcher, COINS_TIP_SHARDS);
 
                 if (fReindex) {
                     pblocktree->WriteReindexing(true);
@@ -1397,7 +1437,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
-                if (poeruDBMain->ShouldReindex(chainActive.Height())) {
+                if (poeruDBMain->ShouldReindex(chainActive.Height(), pcoinsTip->GetBestBlock())) {
                     strLoadError = _("Invalid OERUShield database detected. You need to rebuild the database using -reindex.");
                     break;
                 }
@@ -1544,6 +1584,14 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     StartNode(threadGroup, scheduler);
 
+    pblockTemplateCache = new CBlockTemplateCache(chainparams);
+    RegisterValidationInterface(pblockTemplateCache);
+    threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "gbtcache",
+                                          boost::function<void()>(boost::bind(&CBlockTemplateCache::ThreadBuild, pblockTemplateCache))));
+
+    if (GetBoolArg("-stratum", DEFAULT_STRATUM) && !StartStratum())
+        return InitError(_("Unable to start the stratum server. See debug log for details."));
+
     // ********************************************************* Step 12: finished
 
     SetRPCWarmupFinished();
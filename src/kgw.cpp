@@ -8,10 +8,348 @@
 #include "chain.h"
 #include "chainparams.h"
 #include "primitives/block.h"
+#include "sync.h"
 #include "uint256.h"
 #include "util.h"
 
-unsigned int KimotoGravityWell(const CBlockIndex* pindexLast, uint64_t TargetBlockSpacingSeconds, uint64_t PastBlocksMin, uint64_t PastBlocksMax, const Consensus::Params& params)
+/**
+ * EventHorizonDeviation for PastBlocksMass 1 .. KGW_EHD_TABLE_SIZE, as given
+ * by 1 + 0.7084 * pow(PastBlocksMass / 144, -1.228). Generated once from that
+ * formula (printed with 17 significant digits, which round-trips doubles) so
+ * consensus no longer depends on the pow() of the libm a node is built with.
+ * It covers the mainnet PastBlocksMax of 7 days / 512 = 1181 blocks.
+ */
+static const unsigned int KGW_EHD_TABLE_SIZE = 1181;
+static const double KGW_EHD_TABLE[KGW_EHD_TABLE_SIZE] = {
+    317.77266098033306, 136.23305468993036, 83.194506450093527, 58.73218883275127,
+    44.894744705606143, 36.089562816367646, 30.038040034847402, 25.646382757991724,
+    22.327398866008551, 19.739055299163923, 17.669304326185994, 15.980045161429519,
+    14.577670221047267, 13.396596486477437, 12.389577830563324, 11.521759097220141,
+    10.766892718293567, 10.104855476842925, 9.5199740272307363, 8.999868682691643,
+    8.5346381267748406, 8.1162736601381074, 7.73823122962603, 7.3951139606046903,
+    7.0824333981585683, 6.7964276774463235, 6.5339214508940602, 6.2922168391573514,
+    6.0690077053535614, 5.8623116555863861, 5.6704156485769035, 5.4918321518818951,
+    5.3252635429997897, 5.1695730087189533, 5.0237606052750001, 4.8869434465503172,
+    4.7583392164755782, 4.6372523753014594, 4.5230625619879499, 4.415214797042939,
+    4.3132111693163466, 4.2166037520840138, 4.1249885423516632, 4.0380002557408687,
+    3.9553078398902652, 3.8766105937595023, 3.801634799888411, 3.7301307925575196,
+    3.6618703977037694, 3.596644690976361, 3.5342620289476092, 3.4745463155956862,
+    3.4173354720442486, 3.3624800824115244, 3.3098421926740009, 3.2592942428360945,
+    3.2107181155362525, 3.1640042866082934, 3.1190510651322758, 3.0757639122153391,
+    3.0340548291914744, 2.9938418071625179, 2.9550483308556896, 2.9176029306744535,
+    2.8814387775931931, 2.8464933162119292, 2.8127079318614827, 2.7800276481459214,
+    2.7484008517392349, 2.7177790416267169, 2.6881166003065804, 2.6593705847508096,
+    2.631500535171909, 2.6044682998590805, 2.5782378745375625, 2.5527752548720093,
+    2.5280483008819248, 2.5040266121669577, 2.4806814129544632, 2.4579854460831809,
+    2.4359128751267543, 2.4144391939406136, 2.3935411429866584, 2.3731966318533377,
+    2.3533846674450127, 2.3340852873647626, 2.3152794980597289, 2.296949217338343,
+    2.2790772209048367, 2.2616470925888166, 2.2446431779767897, 2.2280505411786899,
+    2.211854924486067, 2.1960427106998477, 2.1806008879248173, 2.1655170166453095,
+    2.1507791989123315, 2.1363760494865733, 2.1222966687946681, 2.1085306175677987,
+    2.0950678930423834, 2.0818989066122833, 2.0690144628307752, 2.0564057396685924,
+    2.0440642699416598, 2.0319819238288508, 2.0201508924062166, 2.008563672129724,
+    1.9972130502036769, 1.9860920907766886, 1.9751941219113616, 1.9645127232778061,
+    1.9540417145247384, 1.9437751442852418, 1.9337072797773427, 1.9238325969623749,
+    1.9141457712267032, 1.9046416685547864, 1.8953153371637597, 1.8861619995717649,
+    1.877177045074147, 1.8683560226033693, 1.8596946339501248, 1.851188727324605,
+    1.8428342912382796, 1.8346274486878116, 1.8265644516239341, 1.8186416756892072,
+    1.8108556152096067, 1.8032028784258389, 1.7956801829511728, 1.7882843514433899,
+    1.7810123074792314, 1.7738610716204257, 1.7668277576610487, 1.7599095690465869,
+    1.7531037954556545, 1.74640780953585, 1.7398190637857418, 1.7333350875754534,
+    1.7269534842987331, 1.7206719286498415, 1.7144881640189327, 1.7084000000000001,
+    1.702405310005775, 1.6965020289842863, 1.6906881512320888, 1.6849617282994434,
+    1.6793208669829849, 1.673763727401679, 1.6682885211520682, 1.6628935095390509,
+    1.6575770018786247, 1.6523373538692152, 1.6471729660284007, 1.6420822821919994,
+    1.6370637880726537, 1.6321160098751892, 1.6272375129661734, 1.6224269005952205,
+    1.6176828126657294, 1.6130039245528434, 1.608388945966543, 1.6038366198578848,
+    1.5993457213664932, 1.5949150568075159, 1.5905434626963308, 1.5862298048093861,
+    1.5819729772796252, 1.5777719017250278, 1.5736255264088732, 1.5695328254303844,
+    1.5654927979444926, 1.5615044674095109, 1.5575668808615624, 1.553679108214669,
+    1.5498402415854506, 1.5460493946414364, 1.5423057019720383, 1.5386083184812716,
+    1.5349564188013609, 1.531349196726399, 1.5277858646652669, 1.5242656531130603,
+    1.5207878101403001, 1.5173516008992343, 1.5139563071465734, 1.5106012267820266,
+    1.5072856734020341, 1.504008975868121, 1.5007704778893141, 1.4975695376181004,
+    1.4944055272594117, 1.4912778326921574, 1.4881858531028374, 1.4851290006307891,
+    1.4821067000246444, 1.4791183883095858, 1.4761635144650107, 1.4732415391122264,
+    1.4703519342118185, 1.467494182770342, 1.4646677785560076, 1.4618722258230434,
+    1.4591070390444241, 1.4563717426526785, 1.4536658707884889, 1.450988967056815,
+    1.448340584290281, 1.4457202843195758, 1.4431276377506264, 1.4405622237483147,
+    1.4380236298265139, 1.4355114516442324, 1.4330252928076606, 1.4305647646779209,
+    1.428129486184333, 1.4257190836430127, 1.4233331905806232, 1.4209714475631181,
+    1.4186335020293028, 1.4163190081290677, 1.4140276265661331, 1.4117590244451659,
+    1.4095128751231263, 1.4072888580647085, 1.4050866587017439, 1.4029059682964462,
+    1.4007464838083714, 1.3986079077649787, 1.3964899481356805, 1.3943923182092717,
+    1.3923147364746313, 1.3902569265046028, 1.3882186168429442, 1.3861995408942649,
+    1.3841994368168509, 1.3822180474182941, 1.3802551200538393, 1.3783104065273697,
+    1.3763836629949475, 1.3744746498708371, 1.3725831317359358, 1.3707088772485405,
+    1.3688516590573814, 1.3670112537168568, 1.3651874416044036, 1.3633800068399435,
+    1.3615887372073403, 1.3598134240778164, 1.3580538623352651, 1.3563098503034117,
+    1.3545811896747626, 1.3528676854413, 1.3511691458268653, 1.349485382221189,
+    1.3478162091155157, 1.3461614440397867, 1.344520907501328, 1.3428944229250095,
+    1.3412818165948295, 1.339682917596889, 1.3380975577637133, 1.3365255716198901,
+    1.33496679632898, 1.3334210716416748, 1.3318882398451599, 1.3303681457136558,
+    1.3288606364601026, 1.3273655616889601, 1.3258827733500902, 1.3244121256936965,
+    1.3229534752262906, 1.3215066806676594, 1.3200716029088055, 1.3186481049708374,
+    1.3172360519647839, 1.3158353110523064, 1.3144457514072903, 1.3130672441782885,
+    1.3116996624517983, 1.310342881216348, 1.3089967773273745, 1.3076612294728691,
+    1.3063361181397761, 1.3050213255811209, 1.3037167357838524, 1.3024222344373788,
+    1.3011377089027842, 1.2998630481827023, 1.2985981428918376, 1.2973428852281139,
+    1.2960971689444358, 1.2948608893210483, 1.2936339431384798, 1.2924162286510537,
+    1.2912076455609565, 1.2900080949928454, 1.2888174794689879, 1.2876357028849137,
+    1.2864626704855722, 1.2852982888419819, 1.2841424658283587, 1.2829951105997117,
+    1.281856133569899, 1.2807254463901274, 1.2796029619278886, 1.2784885942463231,
+    1.2773822585839967, 1.2762838713350859, 1.275193350029959, 1.2741106133161437,
+    1.2730355809396747, 1.2719681737268109, 1.2709083135661126, 1.2698559233908737,
+    1.2688109271618986, 1.2677732498506136, 1.2667428174225119, 1.265719556820919,
+    1.264703395951071, 1.2636942636645043, 1.2626920897437439, 1.2616968048872859,
+    1.2607083406948689, 1.2597266296530263, 1.2587516051209116, 1.2577832013163972,
+    1.2568213533024313, 1.2558659969736556, 1.2549170690432738, 1.2539745070301653,
+    1.2530382492462415, 1.2521082347840362, 1.2511844035045283, 1.2502666960251878,
+    1.2493550537082463, 1.2484494186491788, 1.2475497336654013, 1.2466559422851731,
+    1.2457679887367024, 1.2448858179374496, 1.2440093754836252, 1.2431386076398794,
+    1.2422734613291735, 1.2414138841228384, 1.2405598242308085, 1.239711230492031,
+    1.2388680523650464, 1.2380302399187375, 1.2371977438232395, 1.2363705153410158,
+    1.2355485063180853, 1.2347316691754098, 1.2339199569004271, 1.2331133230387372,
+    1.232311721685929, 1.2315151074795527, 1.2307234355912289, 1.2299366617188954,
+    1.2291547420791882, 1.2283776333999517, 1.2276052929128793, 1.2268376783462789,
+    1.2260747479179617, 1.2253164603282525, 1.2245627747531183, 1.2238136508374131,
+    1.2230690486882372, 1.2223289288684063, 1.2215932523900341, 1.2208619807082179,
+    1.2201350757148324, 1.219412499732426, 1.2186942155082185, 1.2179801862081978,
+    1.217270375411315, 1.2165647471037742, 1.2158632656734163, 1.2151658959041955,
+    1.2144726029707451, 1.2137833524330328, 1.2130981102311016, 1.2124168426798976,
+    1.21173951646418, 1.2110660986335147, 1.210396556597346, 1.2097308581201511,
+    1.2090689713166678, 1.2084108646472023, 1.207756506913009, 1.2071058672517445,
+    1.2064589151329956, 1.2058156203538737, 1.2051759530346828, 1.2045398836146537,
+    1.2039073828477447, 1.2032784217985089, 1.2026529718380263, 1.2020310046398981,
+    1.2014124921763034, 1.2007974067141181, 1.2001857208110924, 1.1995774073120882,
+    1.1989724393453733, 1.1983707903189738, 1.197772433917081, 1.1971773440965139,
+    1.1965854950832353, 1.1959968613689211, 1.1954114177075807, 1.1948291391122297,
+    1.1942500008516119, 1.1936739784469708, 1.1931010476688695, 1.1925311845340592,
+    1.1919643653023917, 1.1914005664737815, 1.1908397647852105, 1.190281937207778,
+    1.189727060943794, 1.1891751134239157, 1.1886260723043265, 1.1880799154639552,
+    1.1875366210017373, 1.1869961672339153, 1.1864585326913795, 1.1859236961170458,
+    1.1853916364632733, 1.1848623328893182, 1.1843357647588248, 1.1838119116373533,
+    1.1832907532899413, 1.1827722696787026, 1.182256440960459, 1.1817432474844061,
+    1.1812326697898121, 1.1807246886037506, 1.1802192848388635, 1.1797164395911577,
+    1.1792161341378313, 1.178718349935131, 1.1782230686162403, 1.1777302719891953,
+    1.177239942034833, 1.1767520609047639, 1.1762666109193769, 1.17578357456587,
+    1.175302934496308, 1.1748246735257075, 1.1743487746301491, 1.1738752209449148,
+    1.1734039957626503, 1.1729350825315545, 1.1724684648535924, 1.1720041264827317,
+    1.1715420513232051, 1.171082223427796, 1.1706246269961453, 1.1701692463730851,
+    1.1697160660469901, 1.1692650706481551, 1.1688162449471926, 1.1683695738534523,
+    1.1679250424134617, 1.1674826358093866, 1.1670423393575147, 1.166604138506756,
+    1.1661680188371659, 1.1657339660584864, 1.1653019660087072, 1.1648720046526446,
+    1.1644440680805417, 1.1640181425066836, 1.1635942142680338, 1.1631722698228861,
+    1.1627522957495362, 1.1623342787449689, 1.1619182056235622, 1.1615040633158107,
+    1.161091838867063, 1.1606815194362754, 1.1602730922947839, 1.15986654482509,
+    1.1594618645196622, 1.1590590389797544, 1.1586580559142374, 1.1582589031384467,
+    1.1578615685730445, 1.157466040242896, 1.1570723062759607, 1.156680354902196,
+    1.1562901744524772, 1.1559017533575291, 1.1555150801468712, 1.1551301434477776,
+    1.1547469319842483, 1.1543654345759939, 1.1539856401374335, 1.1536075376767045,
+    1.1532311162946847, 1.1528563651840269, 1.1524832736282051, 1.1521118310005729,
+    1.1517420267634326, 1.1513738504671172, 1.1510072917490821, 1.1506423403330097,
+    1.1502789860279226, 1.1499172187273099, 1.1495570284082635, 1.149198405130623,
+    1.1488413390361352, 1.1484858203476185, 1.1481318393681419, 1.1477793864802117,
+    1.1474284521449678, 1.1470790269013906, 1.1467311013655177, 1.1463846662296682,
+    1.1460397122616783, 1.1456962303041447, 1.1453542112736776, 1.1450136461601628,
+    1.1446745260260307, 1.1443368420055378, 1.1440005853040522, 1.1436657471973508,
+    1.143332319030923, 1.1430002922192837, 1.1426696582452933, 1.142340408659487,
+    1.1420125350794106, 1.1416860291889639, 1.1413608827377542, 1.1410370875404536,
+    1.1407146354761677, 1.1403935184878073, 1.1400737285814722, 1.139755257825837,
+    1.1394380983515484, 1.1391222423506271, 1.1388076820758761, 1.1384944098402985,
+    1.1381824180165183, 1.1378716990362105, 1.1375622453895371, 1.1372540496245884,
+    1.1369471043468324, 1.1366414022185691, 1.1363369359583912, 1.1360336983406509,
+    1.1357316821949339, 1.1354308804055371, 1.1351312859109537, 1.1348328917033641,
+    1.1345356908281319, 1.1342396763833051, 1.1339448415191244, 1.1336511794375359,
+    1.1333586833917086, 1.1330673466855585, 1.1327771626732777, 1.1324881247588681,
+    1.1322002263956805, 1.1319134610859596, 1.1316278223803924, 1.1313433038776628,
+    1.1310598992240104, 1.1307776021127949, 1.130496406284065, 1.1302163055241303,
+    1.1299372936651408, 1.1296593645846693, 1.1293825122052974, 1.1291067304942082,
+    1.1288320134627816, 1.1285583551661955, 1.1282857497030294, 1.1280141912148733,
+    1.1277436738859414, 1.1274741919426896, 1.127205739653435, 1.1269383113279832,
+    1.1266719013172568, 1.1264065040129283, 1.1261421138470578, 1.1258787252917337,
+    1.1256163328587176, 1.1253549310990927, 1.1250945146029163, 1.1248350779988752,
+    1.1245766159539454, 1.1243191231730558, 1.1240625943987534, 1.1238070244108751,
+    1.1235524080262198, 1.1232987400982259, 1.1230460155166515, 1.1227942292072581,
+    1.1225433761314976, 1.1222934512862017, 1.1220444497032764, 1.1217963664493971,
+    1.1215491966257094, 1.1213029353675308, 1.1210575778440572, 1.1208131192580717,
+    1.1205695548456551, 1.1203268798759023, 1.1200850896506385, 1.1198441795041403,
+    1.1196041448028589, 1.119364980945146, 1.1191266833609834, 1.1188892475117131,
+    1.1186526688897733, 1.1184169430184345, 1.1181820654515393, 1.117948031773244,
+    1.1177148375977648, 1.1174824785691246, 1.1172509503609025, 1.1170202486759861,
+    1.1167903692463275, 1.1165613078326995, 1.1163330602244559, 1.1161056222392933,
+    1.1158789897230161, 1.1156531585493024, 1.1154281246194742, 1.1152038838622673,
+    1.114980432233607, 1.1147577657163819, 1.1145358803202228, 1.1143147720812834,
+    1.1140944370620216, 1.1138748713509852, 1.1136560710625973, 1.1134380323369457,
+    1.1132207513395738, 1.1130042242612721, 1.1127884473178746, 1.1125734167500547,
+    1.1123591288231236, 1.1121455798268316, 1.1119327660751703, 1.1117206839061771,
+    1.1115093296817415, 1.1112986997874135, 1.1110887906322136, 1.1108795986484441,
+    1.1106711202915034, 1.1104633520397014, 1.1102562903940758, 1.1100499318782122,
+    1.1098442730380638, 1.1096393104417741, 1.1094350406795008, 1.1092314603632418,
+    1.1090285661266619, 1.1088263546249215, 1.1086248225345088, 1.1084239665530695,
+    1.1082237833992425, 1.108024269812494, 1.1078254225529549, 1.1076272384012587,
+    1.1074297141583811, 1.1072328466454822, 1.1070366327037484, 1.1068410691942372,
+    1.1066461529977221, 1.1064518810145405, 1.1062582501644418, 1.1060652573864376,
+    1.1058728996386527, 1.1056811738981771, 1.105490077160922, 1.1052996064414726,
+    1.105109758772947, 1.1049205312068522, 1.1047319208129451, 1.1045439246790918,
+    1.1043565399111301, 1.1041697636327319, 1.1039835929852688, 1.1037980251276758,
+    1.1036130572363194, 1.1034286865048653, 1.1032449101441473, 1.1030617253820374,
+    1.102879129463318, 1.1026971196495543, 1.102515693218967, 1.1023348474663093,
+    1.1021545797027408, 1.101974887255706, 1.1017957674688121, 1.1016172177017081,
+    1.1014392353299653, 1.1012618177449593, 1.1010849623537515, 1.1009086665789733,
+    1.1007329278587108, 1.1005577436463896, 1.1003831114106624, 1.100209028635295,
+    1.1000354928190574, 1.0998625014756107, 1.099690052133399, 1.0995181423355413,
+    1.0993467696397223, 1.0991759316180876, 1.0990056258571361, 1.0988358499576176,
+    1.0986666015344262, 1.0984978782164994, 1.0983296776467149, 1.09816199748179,
+    1.0979948353921811, 1.0978281890619839, 1.0976620561888348, 1.0974964344838143,
+    1.0973313216713478, 1.0971667154891123, 1.0970026136879385, 1.0968390140317181,
+    1.0966759142973097, 1.0965133122744455, 1.0963512057656397, 1.0961895925860972,
+    1.0960284705636227, 1.0958678375385318, 1.0957076913635608, 1.0955480299037801,
+    1.0953888510365051, 1.09523015265121, 1.0950719326494427, 1.0949141889447382,
+    1.0947569194625351, 1.0946001221400905, 1.0944437949263988, 1.0942879357821069,
+    1.0941325426794342, 1.0939776136020909, 1.0938231465451973, 1.0936691395152047,
+    1.093515590529816, 1.0933624976179068, 1.0932098588194485, 1.0930576721854308,
+    1.0929059357777848, 1.0927546476693084, 1.0926038059435892, 1.0924534086949311,
+    1.092303454028281, 1.0921539400591531, 1.0920048649135587, 1.0918562267279324,
+    1.0917080236490606, 1.0915602538340112, 1.0914129154500629, 1.0912660066746351,
+    1.0911195256952182, 1.0909734707093064, 1.0908278399243276, 1.0906826315575773,
+    1.0905378438361508, 1.0903934749968767, 1.0902495232862512, 1.0901059869603722,
+    1.0899628642848749, 1.0898201535348671, 1.0896778529948652, 1.089535960958731,
+    1.0893944757296088, 1.0892533956198631, 1.0891127189510166, 1.0889724440536888,
+    1.0888325692675351, 1.0886930929411871, 1.0885540134321912, 1.0884153291069505,
+    1.0882770383406655, 1.0881391395172753, 1.0880016310293992, 1.0878645112782803,
+    1.0877277786737276, 1.0875914316340591, 1.0874554685860462, 1.0873198879648576,
+    1.0871846882140033, 1.0870498677852809, 1.0869154251387207, 1.0867813587425312,
+    1.0866476670730454, 1.0865143486146684, 1.0863814018598241, 1.0862488253089024,
+    1.0861166174702079, 1.085984776859908, 1.0858533020019816, 1.0857221914281687,
+    1.0855914436779197, 1.0854610572983454, 1.0853310308441673, 1.0852013628776689,
+    1.0850720519686459, 1.0849430966943587, 1.0848144956394836, 1.0846862473960655,
+    1.0845583505634704, 1.0844308037483379, 1.0843036055645352, 1.0841767546331107,
+    1.0840502495822479, 1.0839240890472197, 1.0837982716703431, 1.0836727961009349,
+    1.0835476609952666, 1.0834228650165196, 1.0832984068347433, 1.0831742851268089,
+    1.0830504985763685, 1.0829270458738103, 1.0828039257162176, 1.0826811368073259,
+    1.0825586778574801, 1.0824365475835944, 1.0823147447091102, 1.0821932679639548,
+    1.0820721160845008, 1.0819512878135271, 1.0818307819001762, 1.0817105970999168,
+    1.0815907321745031, 1.0814711858919357, 1.0813519570264227, 1.0812330443583418,
+    1.0811144466742004, 1.0809961627665994, 1.0808781914341936, 1.0807605314816562,
+    1.0806431817196391, 1.0805261409647389, 1.0804094080394571, 1.0802929817721663,
+    1.0801768609970728, 1.0800610445541803, 1.0799455312892556, 1.0798303200537922,
+    1.0797154097049761, 1.0796007991056495, 1.0794864871242777, 1.0793724726349143,
+    1.0792587545171666, 1.0791453316561623, 1.0790322029425161, 1.0789193672722956,
+    1.0788068235469888, 1.078694570673471, 1.0785826075639724, 1.0784709331360451,
+    1.0783595463125319, 1.0782484460215336, 1.0781376311963773, 1.0780271007755851,
+    1.0779168537028434, 1.077806888926971, 1.0776972054018887, 1.077587802086589,
+    1.0774786779451049, 1.0773698319464804, 1.0772612630647407, 1.0771529702788618,
+    1.0770449525727421, 1.0769372089351716, 1.076829738359804, 1.0767225398451272,
+    1.0766156123944353, 1.0765089550157989, 1.0764025667220383, 1.0762964465306941,
+    1.0761905934640004, 1.0760850065488561, 1.0759796848167984, 1.0758746273039745,
+    1.0757698330511156, 1.0756653011035089, 1.0755610305109715, 1.0754570203278238,
+    1.0753532696128629, 1.0752497774293366, 1.0751465428449176, 1.0750435649316772,
+    1.0749408427660598, 1.074838375428858, 1.0747361620051865, 1.0746342015844577,
+    1.0745324932603559, 1.074431036130814, 1.0743298292979873, 1.0742288718682298,
+    1.0741281629520703, 1.0740277016641875, 1.073927487123387, 1.0738275184525767,
+    1.0737277947787436, 1.0736283152329305, 1.0735290789502125, 1.0734300850696743,
+    1.0733313327343861, 1.0732328210913824, 1.073134549291638, 1.0730365164900464,
+    1.0729387218453974, 1.0728411645203537, 1.0727438436814309, 1.0726467584989741,
+    1.0725499081471364, 1.0724532918038574, 1.0723569086508424, 1.0722607578735401,
+    1.0721648386611224, 1.0720691502064623, 1.0719736917061138, 1.0718784623602913,
+    1.0717834613728483, 1.0716886879512573, 1.0715941413065899, 1.0714998206534958,
+    1.0714057252101836, 1.0713118541983999, 1.0712182068434106, 1.0711247823739805,
+    1.0710315800223538, 1.0709385990242353, 1.0708458386187703, 1.0707532980485266,
+    1.0706609765594741, 1.0705688734009668, 1.0704769878257241, 1.0703853190898118,
+    1.0702938664526238, 1.0702026291768632, 1.070111606528525, 1.070020797776877,
+    1.0699302021944426, 1.069839819056982, 1.0697496476434754, 1.0696596872361042,
+    1.0695699371202343, 1.0694803965843984, 1.0693910649202791, 1.0693019414226903,
+    1.0692130253895615, 1.0691243161219208, 1.0690358129238766, 1.0689475151026022,
+    1.068859421968319, 1.0687715328342793, 1.0686838470167499, 1.0685963638349965,
+    1.0685090826112669, 1.0684220026707747, 1.0683351233416838, 1.0682484439550919,
+    1.0681619638450151, 1.0680756823483721, 1.0679895988049686, 1.0679037125574808,
+    1.0678180229514425, 1.0677325293352262, 1.0676472310600313, 1.067562127479867,
+    1.0674772179515373, 1.0673925018346269, 1.0673079784914856, 1.0672236472872147,
+    1.0671395075896504, 1.0670555587693511, 1.066971800199582, 1.0668882312563011,
+    1.0668048513181441, 1.0667216597664115, 1.0666386559850536, 1.0665558393606565,
+    1.0664732092824287, 1.0663907651421864, 1.0663085063343409, 1.0662264322558839,
+    1.066144542306374, 1.0660628358879243, 1.0659813124051873, 1.0658999712653432,
+    1.0658188118780854, 1.065737833655608, 1.0656570360125928, 1.0655764183661955,
+    1.0654959801360335, 1.0654157207441735, 1.065335639615117, 1.0652557361757897,
+    1.0651760098555274, 1.0650964600860644, 1.0650170863015203, 1.0649378879383882,
+    1.0648588644355219, 1.0647800152341245, 1.0647013397777352, 1.064622837512218,
+    1.0645445078857494, 1.0644663503488065, 1.0643883643541556, 1.0643105493568392,
+    1.0642329048141659, 1.0641554301856972, 1.0640781249332378, 1.0640009885208221,
+    1.0639240204147038, 1.0638472200833449, 1.0637705869974037, 1.0636941206297237,
+    1.063617820455323, 1.0635416859513827, 1.0634657165972357, 1.0633899118743564,
+    1.0633142712663495, 1.063238794258939, 1.0631634803399581, 1.0630883289993374,
+    1.0630133397290955, 1.0629385120233277, 1.0628638453781956, 1.062789339291917,
+    1.0627149932647548, 1.0626408067990083, 1.0625667793990006, 1.0624929105710703,
+    1.062419199823561, 1.0623456466668106, 1.0622722506131419, 1.0621990111768527,
+    1.062125927874205, 1.0620530002234168, 1.0619802277446508, 1.0619076099600053,
+    1.0618351463935052, 1.0617628365710912, 1.0616906800206107, 1.0616186762718094,
+    1.0615468248563198, 1.0614751253076538, 1.0614035771611923, 1.0613321799541762,
+    1.0612609332256975, 1.0611898365166896, 1.0611188893699188, 1.0610480913299745,
+    1.0609774419432609, 1.0609069407579883, 1.060836587324163, 1.0607663811935795,
+    1.060696321919812, 1.0606264090582045, 1.0605566421658628, 1.0604870208016461,
+    1.0604175445261583, 1.060348212901739, 1.0602790254924555, 1.060209981864094,
+    1.0601410815841521, 1.0600723242218293, 1.0600037093480195, 1.0599352365353023,
+    1.0598669053579355, 1.059798715391846, 1.0597306662146226, 1.0596627574055075,
+    1.0595949885453884, 1.0595273592167904, 1.0594598690038681, 1.0593925174923986,
+    1.0593253042697721, 1.0592582289249857, 1.0591912910486343, 1.059124490232904,
+    1.0590578260715642, 1.0589912981599596, 1.058924906095003, 1.0588586494751675,
+    1.0587925279004795, 1.0587265409725111, 1.0586606882943723, 1.0585949694707042,
+    1.0585293841076717, 1.0584639318129558, 1.0583986121957469, 1.0583334248667369,
+    1.0582683694381128, 1.0582034455235496, 1.0581386527382026, 1.0580739906987013,
+    1.0580094590231415, 1.0579450573310787, 1.0578807852435217, 1.0578166423829249,
+    1.0577526283731822, 1.0576887428396202, 1.0576249854089905, 1.0575613557094643,
+    1.057497853370625, 1.0574344780234612, 1.0573712293003619, 1.0573081068351069,
+    1.0572451102628637, 1.0571822392201782, 1.0571194933449701, 1.0570568722765257,
+    1.0569943756554911, 1.0569320031238671, 1.0568697543250021, 1.0568076289035855,
+    1.0567456265056423, 1.0566837467785262, 1.0566219893709141, 1.0565603539327995,
+    1.056498840115486, 1.0564374475715825, 1.0563761759549961, 1.0563150249209263,
+    1.0562539941258593, 1.0561930832275617, 1.0561322918850753, 1.0560716197587103,
+    1.0560110665100402, 1.0559506318018956, 1.0558903152983588, 1.0558301166647572,
+    1.0557700355676587, 1.0557100716748657, 1.0556502246554091, 1.0555904941795424,
+    1.0555308799187375, 1.0554713815456773, 1.0554119987342518, 1.0553527311595516,
+    1.0552935784978632, 1.0552345404266621, 1.0551756166246096, 1.0551168067715455,
+    1.055058110548484, 1.0549995276376072, 1.0549410577222611, 1.0548827004869494,
+    1.0548244556173292, 1.054766322800204, 1.0547083017235208, 1.0546503920763635,
+    1.054592593548948, 1.0545349058326177, 1.0544773286198372, 1.0544198616041891,
+    1.0543625044803668, 1.0543052569441718, 1.0542481186925066, 1.0541910894233715,
+    1.0541341688358583, 1.0540773566301467, 1.0540206525074984, 1.053964056170253,
+    1.0539075673218226, 1.0538511856666875, 1.0537949109103912, 1.0537387427595357,
+    1.053682680921777, 1.05362672510582, 1.0535708750214146, 1.0535151303793497,
+    1.0534594908914505
+};
+
+double KGWEventHorizonDeviation(uint64_t PastBlocksMass)
+{
+    if (PastBlocksMass >= 1 && PastBlocksMass <= KGW_EHD_TABLE_SIZE)
+        return KGW_EHD_TABLE[PastBlocksMass - 1];
+    return 1 + (0.7084 * pow((double(PastBlocksMass) / double(144)), -1.228));
+}
+
+/**
+ * Recent results, keyed by the hash of the last block. The walk starts at the
+ * tip and its truncated running average can't be carried over to a child, so
+ * every new tip is computed once; repeated calls for the same tip (header and
+ * block checks, UpdateTime in CreateNewBlock, getblocktemplate polling) are
+ * answered from here.
+ */
+struct KGWCacheEntry
+{
+    uint256 hashBlock;
+    uint64_t TargetBlockSpacingSeconds;
+    uint64_t PastBlocksMin;
+    uint64_t PastBlocksMax;
+    uint256 powLimit;
+    unsigned int nBits;
+};
+
+static const unsigned int KGW_CACHE_SIZE = 8;
+
+static CCriticalSection cs_kgwcache;
+static KGWCacheEntry kgwCache[KGW_CACHE_SIZE];
+static unsigned int nKGWCacheNext = 0;
+
+static unsigned int KimotoGravityWellCompute(const CBlockIndex* pindexLast, uint64_t TargetBlockSpacingSeconds, uint64_t PastBlocksMin, uint64_t PastBlocksMax, const Consensus::Params& params)
 {
     const CBlockIndex *BlockLastSolved = pindexLast;
     const CBlockIndex *BlockReading    = pindexLast;
@@ -36,9 +374,11 @@ unsigned int KimotoGravityWell(const CBlockIndex* pindexLast, uint64_t TargetBlo
 
         if(i > 1) {
             if(PastDifficultyAverage >= PastDifficultyAveragePrev) {
-                PastDifficultyAverage = ((PastDifficultyAverage - PastDifficultyAveragePrev) / i) + PastDifficultyAveragePrev;
+                arith_uint256 delta = PastDifficultyAverage - PastDifficultyAveragePrev;
+                PastDifficultyAverage = delta.DivideUint32(i) + PastDifficultyAveragePrev;
             } else {
-                PastDifficultyAverage = PastDifficultyAveragePrev - ((PastDifficultyAveragePrev - PastDifficultyAverage) / i);
+                arith_uint256 delta = PastDifficultyAveragePrev - PastDifficultyAverage;
+                PastDifficultyAverage = PastDifficultyAveragePrev - delta.DivideUint32(i);
             }
         }
 
@@ -52,7 +392,7 @@ unsigned int KimotoGravityWell(const CBlockIndex* pindexLast, uint64_t TargetBlo
             ? double(PastRateTargetSeconds) / double(PastRateActualSeconds)
             : double(1);
 
-        EventHorizonDeviation     = 1 + (0.7084 * pow((double(PastBlocksMass) / double(144)), -1.228));
+        EventHorizonDeviation     = KGWEventHorizonDeviation(PastBlocksMass);
         EventHorizonDeviationFast = EventHorizonDeviation;
         EventHorizonDeviationSlow = 1 / EventHorizonDeviation;
 
@@ -88,3 +428,34 @@ unsigned int KimotoGravityWell(const CBlockIndex* pindexLast, uint64_t TargetBlo
 
     return bnNew.GetCompact();
 }
+
+unsigned int KimotoGravityWell(const CBlockIndex* pindexLast, uint64_t TargetBlockSpacingSeconds, uint64_t PastBlocksMin, uint64_t PastBlocksMax, const Consensus::Params& params)
+{
+    // Index entries without a hash (unit tests) are never cached
+    if (pindexLast == NULL || pindexLast->phashBlock == NULL)
+        return KimotoGravityWellCompute(pindexLast, TargetBlockSpacingSeconds, PastBlocksMin, PastBlocksMax, params);
+
+    const uint256 hashBlock = pindexLast->GetBlockHash();
+    {
+        LOCK(cs_kgwcache);
+        for (unsigned int i = 0; i < KGW_CACHE_SIZE; i++) {
+            const KGWCacheEntry& entry = kgwCache[i];
+            if (entry.hashBlock == hashBlock && entry.TargetBlockSpacingSeconds == TargetBlockSpacingSeconds &&
+                entry.PastBlocksMin == PastBlocksMin && entry.PastBlocksMax == PastBlocksMax && entry.powLimit == params.powLimit)
+                return entry.nBits;
+        }
+    }
+
+    unsigned int nBits = KimotoGravityWellCompute(pindexLast, TargetBlockSpacingSeconds, PastBlocksMin, PastBlocksMax, params);
+
+    LOCK(cs_kgwcache);
+    KGWCacheEntry& entry = kgwCache[nKGWCacheNext];
+    entry.hashBlock = hashBlock;
+    entry.TargetBlockSpacingSeconds = TargetBlockSpacingSeconds;
+    entry.PastBlocksMin = PastBlocksMin;
+    entry.PastBlocksMax = PastBlocksMax;
+    entry.powLimit = params.powLimit;
+    entry.nBits = nBits;
+    nKGWCacheNext = (nKGWCacheNext + 1) % KGW_CACHE_SIZE;
+    return nBits;
+}
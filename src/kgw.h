@@ -9,6 +9,9 @@
 
 class CBlockIndex;
 
+/** 1 + 0.7084 * pow(PastBlocksMass / 144, -1.228), from a table for the masses mainnet uses */
+double KGWEventHorizonDeviation(uint64_t PastBlocksMass);
+
 unsigned int KimotoGravityWell(const CBlockIndex* pindexLast, uint64_t TargetBlockSpacingSeconds, uint64_t PastBlocksMin, uint64_t PastBlocksMax, const Consensus::Params& params);
 
 #endif
@@ -8,6 +8,7 @@
 #include "addrman.h"
 #include "arith_uint256.h"
 #include "blockencodings.h"
+#include "blockfilemap.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
@@ -43,6 +44,7 @@
 
 #include <atomic>
 #include <sstream>
+#include <unordered_set>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/join.hpp>
@@ -88,6 +90,7 @@ CFeeRate minRelayTxFee = CFeeRate(DEFAULT_MIN_RELAY_TX_FEE);
 CAmount maxTxFee = DEFAULT_TRANSACTION_MAXFEE;
 
 CTxMemPool mempool(::minRelayTxFee);
+CBlockFileMap mappedBlockFiles;
 FeeFilterRounder filterRounder(::minRelayTxFee);
 
 struct IteratorComparator
@@ -710,6 +713,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache *pcoinsTip = NULL;
+CCoinsViewSnapshot *pcoinsSnapshot = NULL;
 CBlockTreeDB *pblocktree = NULL;
 
 //////////////////////////////////////////////////////////////////////////////
@@ -1699,25 +1703,34 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+/** Files before the one being appended to are complete and never written again, so they can be read through a mapping instead of a fresh FILE* */
+static bool IsFinalizedBlockFile(int nFile)
 {
-    block.SetNull();
+    LOCK(cs_LastBlockFile);
+    return nFile < nLastBlockFile;
+}
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPOW)
+{
+    block.SetNull();
 
-    // Read block
     try {
-        filein >> block;
+        if (!IsFinalizedBlockFile(pos.nFile) || !mappedBlockFiles.ReadBlock(pos, block)) {
+            // Open history file to read
+            CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+            // Read block
+            filein >> block;
+        }
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
     }
 
     // Check the header
-    if (!CheckProofOfWork(block.GetPoWHash(), block.nBits, consensusParams))
+    if (fCheckPOW && !CheckProofOfWork(block.GetPoWHash(), block.nBits, consensusParams))
         return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
 
     return true;
@@ -1725,14 +1738,60 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
 
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
-    if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), consensusParams))
+    // The proof of work of entries that reached BLOCK_VALID_TREE was checked when they were accepted, and
+    // matching the block hash below ties the data read back to that header, so scrypt only runs for entries
+    // that were never validated. A stored scrypt hash is still checked against nBits, which is cheap.
+    bool fHavePoWHash = pindex->nStatus & BLOCK_HAVE_POWHASH;
+    bool fTrusted = fHavePoWHash || pindex->IsValid(BLOCK_VALID_TREE);
+    if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), consensusParams, !fTrusted))
         return false;
     if (block.GetHash() != pindex->GetBlockHash())
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
                 pindex->ToString(), pindex->GetBlockPos().ToString());
+    if (fHavePoWHash) {
+        if (!CheckProofOfWork(pindex->hashPoW, block.nBits, consensusParams))
+            return error("ReadBlockFromDisk: Errors in block header at %s", pindex->GetBlockPos().ToString());
+        block.SetCachedPoWHash(pindex->hashPoW);
+    }
     return true;
 }
 
+bool ReadRawBlockFromDisk(CMappedBlock& block, std::vector<char>& vchBuffer, const CBlockIndex* pindex)
+{
+    CDiskBlockPos pos = pindex->GetBlockPos();
+    if (!IsFinalizedBlockFile(pos.nFile) || !mappedBlockFiles.GetBlock(pos, block)) {
+        // Read the size stored in front of the block, then the block itself
+        if (pos.nPos < 4)
+            return error("%s: Invalid position %s", __func__, pos.ToString());
+        CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - 4), true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadRawBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+        try {
+            unsigned int nSize;
+            filein >> nSize;
+            if (nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                return error("%s: Invalid block size %u at %s", __func__, nSize, pos.ToString());
+            vchBuffer.resize(nSize);
+            filein.read(begin_ptr(vchBuffer), nSize);
+        }
+        catch (const std::exception& e) {
+            return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+        block = CMappedBlock();
+        block.pbegin = begin_ptr(vchBuffer);
+        block.pend = end_ptr(vchBuffer);
+    }
+    if (block.pend - block.pbegin < 80 || Hash(block.pbegin, block.pbegin + 80) != pindex->GetBlockHash())
+        return error("ReadRawBlockFromDisk: header doesn't match index for %s at %s", pindex->ToString(), pos.ToString());
+    return true;
+}
+
+bool CanSendRawBlock(const CBlockIndex* pindex, bool fPeerWantsWitness, const Consensus::Params& consensusParams)
+{
+    // Blocks before segwit activation carry no witness, so stripping it changes nothing
+    return fPeerWantsWitness || !IsWitnessEnabled(pindex->pprev, consensusParams);
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     CAmount nSubsidy = 25 * COIN;
@@ -2292,6 +2351,224 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CPoWCheck> powcheckqueue(1);
+/** Serializes users of powcheckqueue, which supports only one master at a time */
+static CCriticalSection cs_powcheckqueue;
+
+void ThreadPoWCheck() {
+    RenameThread("egulden-powcheck");
+    powcheckqueue.Thread();
+}
+
+bool CCoinsPrefetchQueue::Add(const std::vector<CCoinsPrefetch>& vPrefetch)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (queue.size() > nMaxQueued)
+        return false;
+    queue.insert(queue.end(), vPrefetch.begin(), vPrefetch.end());
+    condWorker.notify_all();
+    return true;
+}
+
+void CCoinsPrefetchQueue::Wait()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (!queue.empty() || nBusy)
+        condDone.wait(lock);
+}
+
+void CCoinsPrefetchQueue::Thread()
+{
+    while (true) {
+        CCoinsPrefetch prefetch;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queue.empty())
+                condWorker.wait(lock);
+            prefetch = queue.front();
+            queue.pop_front();
+            nBusy++;
+        }
+        prefetch();
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nBusy--;
+            if (queue.empty() && !nBusy)
+                condDone.notify_all();
+        }
+    }
+}
+
+static CCoinsPrefetchQueue coinsprefetchqueue(MAX_COINS_PREFETCH_QUEUED);
+
+void ThreadCoinsPrefetch() {
+    RenameThread("egulden-prefetch");
+    coinsprefetchqueue.Thread();
+}
+
+/**
+ * The ordered queue between the -reindex indexer and the thread connecting
+ * the best chain. Blocks are queued decoded as they are added to the index,
+ * which is in height order along a chain, and taken by ConnectTip instead of
+ * being read back from disk.
+ */
+class CReindexConnectQueue
+{
+private:
+    struct CQueuedBlock
+    {
+        const CBlockIndex* pindex;
+        std::shared_ptr<const CBlock> pblock;
+        unsigned int nSize;
+    };
+
+    boost::mutex mutex;
+    //! Signalled when blocks were added to the index, or when stopping
+    boost::condition_variable condIndexed;
+    //! Signalled when blocks are taken, or when the chain is caught up
+    boost::condition_variable condConnected;
+    std::deque<CQueuedBlock> queue;
+    size_t nSize;
+    const size_t nMaxSize;
+    //! Whether blocks were added to the index since the chain was last connected
+    bool fPending;
+    bool fConnecting;
+    bool fStopping;
+
+public:
+    CReindexConnectQueue(size_t nMaxSizeIn) : nSize(0), nMaxSize(nMaxSizeIn), fPending(false), fConnecting(false), fStopping(false) {}
+
+    /**
+     * Queue a block just added to the index. While the queue is full and the
+     * chain is being connected, wait for room. The blocks still queued once the
+     * chain is caught up are not on it, and are dropped.
+     */
+    void Push(const CBlockIndex* pindex, const std::shared_ptr<const CBlock>& pblock, unsigned int nBlockSize)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fPending = true;
+        condIndexed.notify_one();
+        while (nSize >= nMaxSize && (fPending || fConnecting))
+            condConnected.wait(lock);
+        if (nSize >= nMaxSize) {
+            queue.clear();
+            nSize = 0;
+        }
+        CQueuedBlock block;
+        block.pindex = pindex;
+        block.pblock = pblock;
+        block.nSize = nBlockSize;
+        queue.push_back(block);
+        nSize += nBlockSize;
+    }
+
+    /** Take the block of pindex, dropping the queued blocks it supersedes. Returns NULL if it is not at the front. */
+    std::shared_ptr<const CBlock> Take(const CBlockIndex* pindex)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        std::shared_ptr<const CBlock> pblock;
+        size_t nSizeBefore = nSize;
+        while (!queue.empty() && queue.front().pindex->nHeight <= pindex->nHeight) {
+            if (queue.front().pindex == pindex)
+                pblock = queue.front().pblock;
+            nSize -= queue.front().nSize;
+            queue.pop_front();
+        }
+        if (nSize != nSizeBefore)
+            condConnected.notify_all();
+        return pblock;
+    }
+
+    /** Look up the block of pindex near the front of the queue, without taking it. */
+    std::shared_ptr<const CBlock> Find(const CBlockIndex* pindex)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (std::deque<CQueuedBlock>::const_iterator it = queue.begin(); it != queue.end() && it->pindex->nHeight <= pindex->nHeight; it++) {
+            if (it->pindex == pindex)
+                return it->pblock;
+        }
+        return std::shared_ptr<const CBlock>();
+    }
+
+    /** Wait until blocks were added to the index since the last call. Returns false once stopped and caught up. */
+    bool Wait()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fConnecting = false;
+        condConnected.notify_all();
+        while (!fPending && !fStopping)
+            condIndexed.wait(lock);
+        fConnecting = fPending;
+        fPending = false;
+        return fConnecting;
+    }
+
+    void Stop()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStopping = true;
+        condIndexed.notify_one();
+    }
+};
+
+/** The blocks queued for connection during -reindex, when it runs. Protected by cs_main. */
+static CReindexConnectQueue* preindexconnect = NULL;
+
+/** The last block whose inputs were queued for prefetching. Protected by cs_main. */
+static const CBlockIndex* pindexPrefetched = NULL;
+/** The next block to connect, read ahead from disk. Protected by cs_main. */
+static CBlockReadAhead blockreadahead;
+
+bool CBlockReadAhead::Read(const CBlockIndex* pindexIn, const Consensus::Params& consensusParams)
+{
+    pindex = NULL;
+    if (!ReadBlockFromDisk(block, pindexIn, consensusParams)) {
+        block.SetNull();
+        return false;
+    }
+    pindex = pindexIn;
+    return true;
+}
+
+bool CBlockReadAhead::Take(const CBlockIndex* pindexIn, CBlock& blockOut)
+{
+    bool fMatch = pindex != NULL && pindex == pindexIn;
+    if (fMatch)
+        std::swap(blockOut, block);
+    Clear();
+    return fMatch;
+}
+
+void CBlockReadAhead::Clear()
+{
+    pindex = NULL;
+    block.SetNull();
+}
+
+/** Queue the coins a block spends from earlier blocks for loading into pcoinsTip. */
+static void PrefetchBlockInputs(const CBlock& block, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (pindex == pindexPrefetched)
+        return;
+    pindexPrefetched = pindex;
+
+    std::vector<CCoinsPrefetch> vPrefetch;
+    std::unordered_set<uint256, SaltedTxidHasher> setSeen;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        setSeen.insert(tx.GetHash()); // Outputs of the block itself are not in the database
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        if (tx.IsCoinBase())
+            continue;
+        BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+            if (setSeen.insert(txin.prevout.hash).second)
+                vPrefetch.push_back(CCoinsPrefetch(*pcoinsTip, txin.prevout.hash));
+        }
+    }
+    if (!coinsprefetchqueue.Add(vPrefetch))
+        LogPrint("bench", "    - Prefetch queue full, not prefetching block %s\n", pindex->GetBlockHash().ToString());
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -2644,17 +2921,24 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     if (nLastSetChain == 0) {
         nLastSetChain = nNow;
     }
+    if (pcoinsSnapshot && pcoinsSnapshot->Failed())
+        return AbortNode(state, "Failed to write to coin database");
     size_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+    // A snapshot still being written in the background shares the space with the cache.
+    size_t snapshotSize = pcoinsSnapshot ? pcoinsSnapshot->DynamicMemoryUsage() : 0;
     // The cache is large and close to the limit, but we have time now (not in the middle of a block processing).
     bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize * (10.0/9) > nCoinCacheUsage;
     // The cache is over the limit, we have to write now.
-    bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nCoinCacheUsage;
+    bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize + snapshotSize > nCoinCacheUsage;
+    // Handing the cache over to an idle background writer is cheap, so it is done at half
+    // the limit, leaving the other half to fill while the snapshot is written.
+    bool fCacheHandOver = mode != FLUSH_STATE_NONE && pcoinsSnapshot && pcoinsSnapshot->IsBackground() && snapshotSize == 0 && cacheSize > nCoinCacheUsage / 2;
     // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
     bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
     // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
     bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
     // Combine all conditions that result in a full cache flush.
-    bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
+    bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fCacheHandOver || fPeriodicFlush || fFlushForPrune;
     // Write blocks and block index to disk.
     if (fDoFullFlush || fPeriodicWrite) {
         // Depend on nMinDiskSpace to ensure we can write block index
@@ -2694,9 +2978,30 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         // overwrite one. Still, use a conservative safety factor of 2.
         if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
+        int64_t nFlushStart = GetTimeMicros();
+        // The previous snapshot, and the OeruShield state written after it, must be
+        // on disk before the next one is taken.
+        if (pcoinsSnapshot && !pcoinsSnapshot->Sync())
+            return AbortNode(state, "Failed to write to coin database");
+        // The OeruShield state follows the chainstate: it is written once the coins are.
+        if (poeruDBMain)
+            poeruDBMain->PrepareFlush(pcoinsTip->GetBestBlock());
         // Flush the chainstate (which may refer to block index entries).
         if (!pcoinsTip->Flush())
             return AbortNode(state, "Failed to write to coin database");
+        // That emptied pcoinsTip, including what was prefetched for the next block
+        if (blockreadahead.GetIndex()) {
+            pindexPrefetched = NULL;
+            PrefetchBlockInputs(blockreadahead.GetBlock(), blockreadahead.GetIndex());
+        }
+        if (pcoinsSnapshot) {
+            // Callers flushing explicitly expect the chainstate on disk on return
+            if (mode == FLUSH_STATE_ALWAYS && !pcoinsSnapshot->Sync())
+                return AbortNode(state, "Failed to write to coin database");
+        } else if (poeruDBMain && !poeruDBMain->WritePrepared()) {
+            return AbortNode(state, "Failed to write to OeruShield database");
+        }
+        LogPrint("bench", "- Flush coins: %.2fms [%.2fMiB]\n", 0.001 * (GetTimeMicros() - nFlushStart), cacheSize * (1.0 / 1024 / 1024));
         nLastFlush = nNow;
     }
     if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
@@ -2793,11 +3098,17 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
     if (!ReadBlockFromDisk(block, pindexDelete, chainparams.GetConsensus()))
         return AbortNode(state, "Failed to read block");
 
-    COeruShield oeruShield(poeruDBMain);
-    // Scan for OERU master transactions and revert them
-    BOOST_FOREACH(const CTransaction& tx, block.vtx)
-    {
-        oeruShield.CheckMasterTx(tx, pindexDelete->nHeight, true);
+    // Revert the block's OERU master transactions. Blocks connected before
+    // undo records were kept are reverted by rescanning them.
+    if (poeruDBMain) {
+        if (!poeruDBMain->UndoBlock(pindexDelete->GetBlockHash())) {
+            COeruShield oeruShield(poeruDBMain);
+            BOOST_FOREACH(const CTransaction& tx, block.vtx)
+            {
+                oeruShield.CheckMasterTx(tx, pindexDelete->nHeight, true);
+            }
+        }
+        poeruDBMain->PublishSnapshot();
     }
 
 
@@ -2869,6 +3180,10 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
 
     // Check whether block is OERU valid
     COeruShield oeruShield(poeruDBMain);
+    if (!(pindexNew->nStatus & BLOCK_OERU_CHECKED)) {
+        oeruShield.IndexBlock(pblock, pindexNew);
+        setDirtyBlockIndex.insert(pindexNew);
+    }
     if (oeruShield.IsActive() && ! oeruShield.AcceptBlock(pblock, pindexNew)) {
         state.Invalid(false, REJECT_INVALID, "oeru-invalid", "OeruShield denied block");
         InvalidBlockFound(pindexNew, state);
@@ -2876,9 +3191,14 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     }
 
     // Scan for OERU master transactions
+    COeruBlockUndo oeruUndo;
     BOOST_FOREACH(const CTransaction& tx, pblock->vtx)
     {
-        oeruShield.CheckMasterTx(tx, pindexNew->nHeight);
+        oeruShield.CheckMasterTx(tx, pindexNew->nHeight, false, &oeruUndo);
+    }
+    if (poeruDBMain) {
+        poeruDBMain->WriteBlockUndo(pindexNew->GetBlockHash(), oeruUndo);
+        poeruDBMain->PublishSnapshot();
     }
 
     // Apply the block atomically to the chain state.
@@ -3001,6 +3321,50 @@ static void PruneBlockIndexCandidates() {
  * Try to make some progress towards making pindexMostWork the active block.
  * pblock is either NULL or a pointer to a CBlock corresponding to pindexMostWork.
  */
+/**
+ * Prefetch stage ahead of ConnectTip: queue the coins pindexConnect's block
+ * spends, then read the block after it and queue its coins too, so they are
+ * loaded while this one connects. Returns the block to connect, or NULL to
+ * leave reading it to ConnectTip. During -reindex, blocks still queued
+ * decoded by the indexer are used instead of reading them, and
+ * pblockReindexed keeps the one returned alive.
+ */
+static const CBlock* PrefetchBlocks(const CChainParams& chainparams, CBlockIndex* pindexConnect, CBlockIndex* pindexMostWork, const CBlock* pblock, CBlock& blockConnect, std::shared_ptr<const CBlock>& pblockReindexed)
+{
+    AssertLockHeld(cs_main);
+    const CBlock* pblockConnect = pindexConnect == pindexMostWork ? pblock : NULL;
+    if (!pblockConnect && preindexconnect) {
+        pblockReindexed = preindexconnect->Take(pindexConnect);
+        pblockConnect = pblockReindexed.get();
+    }
+    if (!nScriptCheckThreads)
+        return pblockConnect;
+
+    if (!pblockConnect) {
+        if (blockreadahead.Take(pindexConnect, blockConnect)) {
+            pblockConnect = &blockConnect;
+        } else if (ReadBlockFromDisk(blockConnect, pindexConnect, chainparams.GetConsensus())) {
+            pblockConnect = &blockConnect;
+        }
+    }
+    blockreadahead.Clear();
+    if (pblockConnect)
+        PrefetchBlockInputs(*pblockConnect, pindexConnect);
+
+    if (pindexConnect != pindexMostWork) {
+        CBlockIndex* pindexNext = pindexMostWork->GetAncestor(pindexConnect->nHeight + 1);
+        std::shared_ptr<const CBlock> pblockNext = preindexconnect ? preindexconnect->Find(pindexNext) : std::shared_ptr<const CBlock>();
+        if (pindexNext == pindexMostWork && pblock) {
+            PrefetchBlockInputs(*pblock, pindexNext);
+        } else if (pblockNext) {
+            PrefetchBlockInputs(*pblockNext, pindexNext);
+        } else if (blockreadahead.Read(pindexNext, chainparams.GetConsensus())) {
+            PrefetchBlockInputs(blockreadahead.GetBlock(), pindexNext);
+        }
+    }
+    return pblockConnect;
+}
+
 static bool ActivateBestChainStep(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const CBlock* pblock, bool& fInvalidFound)
 {
     AssertLockHeld(cs_main);
@@ -3034,7 +3398,10 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
 
         // Connect new blocks.
         BOOST_REVERSE_FOREACH(CBlockIndex *pindexConnect, vpindexToConnect) {
-            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : NULL)) {
+            CBlock blockConnect;
+            std::shared_ptr<const CBlock> pblockReindexed;
+            const CBlock* pblockConnect = PrefetchBlocks(chainparams, pindexConnect, pindexMostWork, pblock, blockConnect, pblockReindexed);
+            if (!ConnectTip(state, chainparams, pindexConnect, pblockConnect)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (!state.CorruptionPossible())
@@ -3267,6 +3634,9 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
     // Construct new block index object
     CBlockIndex* pindexNew = new CBlockIndex(block);
     assert(pindexNew);
+    // Normally memoized by CheckBlockHeader() already; kept so it is never recomputed
+    pindexNew->hashPoW = block.GetPoWHash();
+    pindexNew->nStatus |= BLOCK_HAVE_POWHASH;
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -3436,6 +3806,46 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const
     return true;
 }
 
+bool CPoWCheck::operator()()
+{
+    uint256 hashes[POW_CHECK_BATCH_SIZE];
+    uint256 *pout = phashes ? phashes : hashes;
+    assert(nCount <= POW_CHECK_BATCH_SIZE);
+    GetPoWHashes(pheaders, nCount, pout);
+    for (unsigned int i = 0; i < nCount; i++) {
+        if (!CheckProofOfWork(pout[i], pheaders[i].nBits, *pconsensusParams))
+            return false;
+    }
+    return true;
+}
+
+/** Hash and check headers on the PoW worker threads, optionally returning the hashes. */
+static bool RunPoWChecks(const std::vector<CBlockHeader>& headers, const Consensus::Params& consensusParams, uint256* phashes = NULL)
+{
+    std::vector<CPoWCheck> vChecks;
+    for (size_t i = 0; i < headers.size(); i += POW_CHECK_BATCH_SIZE)
+        vChecks.push_back(CPoWCheck(&headers[i], std::min((size_t)POW_CHECK_BATCH_SIZE, headers.size() - i), consensusParams, phashes ? &phashes[i] : NULL));
+
+    bool fOk = true;
+    if (nScriptCheckThreads && vChecks.size() > 1) {
+        LOCK(cs_powcheckqueue);
+        CCheckQueueControl<CPoWCheck> control(&powcheckqueue);
+        control.Add(vChecks);
+        fOk = control.Wait();
+    } else {
+        for (size_t i = 0; i < vChecks.size() && fOk; i++)
+            fOk = vChecks[i]();
+    }
+    return fOk;
+}
+
+bool CheckBlockHeadersPoW(const std::vector<CBlockHeader>& headers, CValidationState& state, const Consensus::Params& consensusParams)
+{
+    if (!RunPoWChecks(headers, consensusParams))
+        return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
+    return true;
+}
+
 bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot)
 {
     // These are checks that are independent of context.
@@ -3722,7 +4132,7 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL)
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL, bool fCheckPOW=true)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3741,7 +4151,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3959,6 +4369,7 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
 {
     for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        mappedBlockFiles.Release(*it);
         boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -4080,6 +4491,76 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
     return pindexNew;
 }
 
+/** Number of headers handed to the PoW worker threads at once by CheckBlockIndexPoW */
+static const size_t POW_LOAD_CHUNK_SIZE = 4096;
+
+/**
+ * Check the proof of work of the loaded block index. Stored scrypt hashes are
+ * always checked against nBits, which is cheap. With fRecompute, every header
+ * is hashed again on the PoW worker threads, stored hashes must match, and
+ * missing ones are filled in and written back on the next flush.
+ */
+static bool CheckBlockIndexPoW(const Consensus::Params& consensusParams, bool fRecompute)
+{
+    std::vector<CBlockIndex*> vIndex;
+    vIndex.reserve(fRecompute ? mapBlockIndex.size() : 0);
+    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+    {
+        CBlockIndex* pindex = item.second;
+        if ((pindex->nStatus & BLOCK_HAVE_POWHASH) && !CheckProofOfWork(pindex->hashPoW, pindex->nBits, consensusParams))
+            return error("%s: stored proof of work invalid: %s", __func__, pindex->ToString());
+        if (fRecompute)
+            vIndex.push_back(pindex);
+    }
+    if (!fRecompute)
+        return true;
+
+    LogPrintf("Verifying proof of work of %u block headers...\n", vIndex.size());
+    uiInterface.ShowProgress(_("Verifying proof of work..."), 0);
+    int64_t nStart = GetTimeMillis();
+    int nReportedPercent = 0;
+    unsigned int nFilled = 0;
+    std::vector<CBlockHeader> vHeaders;
+    std::vector<uint256> vHashes;
+    for (size_t nOffset = 0; nOffset < vIndex.size(); nOffset += POW_LOAD_CHUNK_SIZE) {
+        boost::this_thread::interruption_point();
+        size_t nChunk = std::min(POW_LOAD_CHUNK_SIZE, vIndex.size() - nOffset);
+        vHeaders.resize(nChunk);
+        vHashes.resize(nChunk);
+        for (size_t i = 0; i < nChunk; i++)
+            vHeaders[i] = vIndex[nOffset + i]->GetBlockHeader();
+        if (!RunPoWChecks(vHeaders, consensusParams, &vHashes[0])) {
+            // Rare; find the offending entry serially so it can be reported
+            for (size_t i = 0; i < nChunk; i++) {
+                if (!CheckProofOfWork(vHeaders[i].GetPoWHash(), vHeaders[i].nBits, consensusParams))
+                    return error("%s: CheckProofOfWork failed: %s", __func__, vIndex[nOffset + i]->ToString());
+            }
+            return error("%s: CheckProofOfWork failed", __func__);
+        }
+        for (size_t i = 0; i < nChunk; i++) {
+            CBlockIndex* pindex = vIndex[nOffset + i];
+            if (pindex->nStatus & BLOCK_HAVE_POWHASH) {
+                if (pindex->hashPoW != vHashes[i])
+                    return error("%s: stored proof-of-work hash mismatch: %s", __func__, pindex->ToString());
+            } else {
+                pindex->hashPoW = vHashes[i];
+                pindex->nStatus |= BLOCK_HAVE_POWHASH;
+                setDirtyBlockIndex.insert(pindex);
+                nFilled++;
+            }
+        }
+        int nPercent = (int)((nOffset + nChunk) * 100 / vIndex.size());
+        if (nPercent >= nReportedPercent + 10) {
+            LogPrintf("[%d%%]...", nPercent);
+            uiInterface.ShowProgress(_("Verifying proof of work..."), nPercent);
+            nReportedPercent = nPercent;
+        }
+    }
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("\n%s: verified %u headers (%u hashes newly stored) in %dms\n", __func__, vIndex.size(), nFilled, GetTimeMillis() - nStart);
+    return true;
+}
+
 bool static LoadBlockIndexDB()
 {
     const CChainParams& chainparams = Params();
@@ -4088,6 +4569,9 @@ bool static LoadBlockIndexDB()
 
     boost::this_thread::interruption_point();
 
+    if (!CheckBlockIndexPoW(chainparams.GetConsensus(), GetBoolArg("-checkpowonload", DEFAULT_CHECKPOWONLOAD)))
+        return false;
+
     // Calculate nChainWork
     vector<pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
@@ -4391,10 +4875,13 @@ void UnloadBlockIndex()
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
+    mappedBlockFiles.Clear();
     nBlockSequenceId = 1;
     mapBlockSource.clear();
     mapBlocksInFlight.clear();
     nPreferredDownload = 0;
+    pindexPrefetched = NULL;
+    blockreadahead.Clear();
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
     mapNodeState.clear();
@@ -4460,113 +4947,312 @@ bool InitBlockIndex(const CChainParams& chainparams)
     return true;
 }
 
-bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
+namespace {
+
+/** A block read from a block file */
+struct CImportBlock
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
+    std::shared_ptr<CBlock> pblock;
+    CDiskBlockPos pos;
+    unsigned int nSize;
 
-    int nLoaded = 0;
-    try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
+    CImportBlock() : nSize(0) {}
+};
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, chainparams.MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
+/** A block with unknown parent met during reindex. Only its position is kept once too many are held decoded. */
+struct CUnknownParentBlock
+{
+    CDiskBlockPos pos;
+    std::shared_ptr<const CBlock> pblock;
+    unsigned int nSize;
+};
+
+/** Blocks with unknown parent by parent hash (only used for reindex) */
+std::multimap<uint256, CUnknownParentBlock> mapBlocksUnknownParent;
+/** Serialized size of the decoded blocks in mapBlocksUnknownParent */
+size_t nBlocksUnknownParentSize = 0;
+
+/**
+ * Hands the blocks decoded by the -reindex scanner threads to the indexer in
+ * file order. Each scanner claims a whole file, and may queue a bounded amount
+ * of its blocks ahead of the indexer.
+ */
+class CReindexQueue
+{
+private:
+    struct CFileQueue
+    {
+        std::deque<CImportBlock> blocks;
+        size_t nSize;
+        bool fScanned;
+
+        CFileQueue() : nSize(0), fScanned(false) {}
+    };
+
+    boost::mutex mutex;
+    //! Signalled when blocks are queued, a file is scanned or the last file is found
+    boost::condition_variable condQueued;
+    //! Signalled when the indexer takes blocks or the last file is found
+    boost::condition_variable condTaken;
+    //! Claimed files that are not completely indexed yet
+    std::map<int, CFileQueue> mapFiles;
+    int nNextFile;
+    //! The first file found missing, after which nothing is reindexed
+    int nEndFile;
+    int nIndexFile;
+
+public:
+    CReindexQueue() : nNextFile(0), nEndFile(std::numeric_limits<int>::max()), nIndexFile(0) {}
+
+    /** Claim the next file to scan. Returns false once there are no files left. */
+    bool Claim(int& nFile)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nNextFile >= nEndFile)
+            return false;
+        nFile = nNextFile++;
+        mapFiles[nFile];
+        return true;
+    }
+
+    /** Record that a claimed file does not exist. */
+    void End(int nFile)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nEndFile = std::min(nEndFile, nFile);
+        condQueued.notify_all();
+        condTaken.notify_all();
+    }
+
+    /** Queue a block of a claimed file, waiting for room. Returns false if the file will not be indexed. */
+    bool Push(const CImportBlock& block)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CFileQueue& file = mapFiles[block.pos.nFile];
+        while (file.nSize >= REINDEX_SCAN_QUEUE_SIZE && block.pos.nFile < nEndFile)
+            condTaken.wait(lock);
+        if (block.pos.nFile >= nEndFile)
+            return false;
+        file.blocks.push_back(block);
+        file.nSize += block.nSize;
+        condQueued.notify_all();
+        return true;
+    }
+
+    /** Record that all blocks of a claimed file are queued. */
+    void Finish(int nFile)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        mapFiles[nFile].fScanned = true;
+        condQueued.notify_all();
+    }
+
+    /** Take the next block in file order, waiting for it to be scanned. Returns false after the last file. */
+    bool Pop(CImportBlock& block)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (nIndexFile < nEndFile) {
+            std::map<int, CFileQueue>::iterator it = mapFiles.find(nIndexFile);
+            if (it != mapFiles.end() && !it->second.blocks.empty()) {
+                block = it->second.blocks.front();
+                it->second.blocks.pop_front();
+                it->second.nSize -= block.nSize;
+                condTaken.notify_all();
+                return true;
             }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
+            if (it != mapFiles.end() && it->second.fScanned) {
+                mapFiles.erase(it);
+                nIndexFile++;
+                continue;
+            }
+            condQueued.wait(lock);
+        }
+        return false;
+    }
+};
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    LOCK(cs_main);
-                    CValidationState state;
-                    if (AcceptBlock(block, state, chainparams, NULL, true, dbp, NULL))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
+} // anon namespace
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
-                    }
+/**
+ * Deserialize the blocks of a block file in order, passing each to importer,
+ * until the end of the file or until importer returns false. Takes over
+ * fileIn, and throws std::runtime_error on I/O errors.
+ */
+template <typename Importer>
+static void ScanBlockFile(const CChainParams& chainparams, FILE* fileIn, int nFile, Importer& importer)
+{
+    // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+    CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
+    uint64_t nRewind = blkdat.GetPos();
+    while (!blkdat.eof()) {
+        boost::this_thread::interruption_point();
+
+        blkdat.SetPos(nRewind);
+        nRewind++; // start one byte further next time, in case of failure
+        blkdat.SetLimit(); // remove former limit
+        unsigned int nSize = 0;
+        try {
+            // locate a header
+            unsigned char buf[MESSAGE_START_SIZE];
+            blkdat.FindByte(chainparams.MessageStart()[0]);
+            nRewind = blkdat.GetPos()+1;
+            blkdat >> FLATDATA(buf);
+            if (memcmp(buf, chainparams.MessageStart(), MESSAGE_START_SIZE))
+                continue;
+            // read size
+            blkdat >> nSize;
+            if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                continue;
+        } catch (const std::exception&) {
+            // no valid block header found; don't complain
+            break;
+        }
+        try {
+            // read block
+            uint64_t nBlockPos = blkdat.GetPos();
+            blkdat.SetLimit(nBlockPos + nSize);
+            blkdat.SetPos(nBlockPos);
+            CImportBlock block;
+            block.pblock.reset(new CBlock());
+            blkdat >> *block.pblock;
+            nRewind = blkdat.GetPos();
+            block.pos = CDiskBlockPos(nFile, nBlockPos);
+            block.nSize = nSize;
+            if (!importer(block))
+                break;
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+        }
+    }
+}
+
+/**
+ * Add a block read from a block file to the block index, followed by the
+ * out-of-order blocks waiting for it. dbp is set when reindexing, which also
+ * keeps blocks with unknown parent for later, decoded up to
+ * nMaxUnknownParentSize, and pconnect then receives the blocks added.
+ * Returns false if the rest of the file should be skipped.
+ */
+static bool ImportBlock(const CChainParams& chainparams, const std::shared_ptr<const CBlock>& pblock, unsigned int nSize, const CDiskBlockPos* dbp, size_t nMaxUnknownParentSize, CReindexConnectQueue* pconnect, int& nLoaded)
+{
+    const CBlock& block = *pblock;
+    uint256 hash = block.GetHash();
+    CBlockIndex* pindex = NULL;
+    {
+        LOCK(cs_main);
+        // detect out of order blocks, and store them for later
+        if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+            LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                    block.hashPrevBlock.ToString());
+            if (dbp) {
+                CUnknownParentBlock child;
+                child.pos = *dbp;
+                child.nSize = nSize;
+                if (nBlocksUnknownParentSize + nSize <= nMaxUnknownParentSize) {
+                    child.pblock = pblock;
+                    nBlocksUnknownParentSize += nSize;
                 }
+                mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, child));
+            }
+            return true;
+        }
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrint("reindex", "%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (AcceptBlock(block, dummy, chainparams, NULL, true, &it->second, NULL))
-                            {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
-                    }
+        // process in case the block isn't known yet
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end() || (mi->second->nStatus & BLOCK_HAVE_DATA) == 0) {
+            CValidationState state;
+            if (AcceptBlock(block, state, chainparams, &pindex, true, dbp, NULL))
+                nLoaded++;
+            else
+                pindex = NULL;
+            if (state.IsError())
+                return false;
+        } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mi->second->nHeight % 1000 == 0) {
+            LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(), mi->second->nHeight);
+        }
+    }
+    if (pindex && pconnect)
+        pconnect->Push(pindex, pblock, nSize);
+
+    // Activate the genesis block so normal node progress can continue
+    if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+        CValidationState state;
+        if (!ActivateBestChain(state, chainparams)) {
+            return false;
+        }
+    }
+
+    NotifyHeaderTip();
+
+    // Recursively process earlier encountered successors of this block
+    deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, CUnknownParentBlock>::iterator, std::multimap<uint256, CUnknownParentBlock>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, CUnknownParentBlock>::iterator it = range.first;
+            std::shared_ptr<const CBlock> pchild = it->second.pblock;
+            if (pchild) {
+                nBlocksUnknownParentSize -= it->second.nSize;
+            } else {
+                std::shared_ptr<CBlock> pread(new CBlock());
+                if (ReadBlockFromDisk(*pread, it->second.pos, chainparams.GetConsensus()))
+                    pchild = pread;
+            }
+            if (pchild)
+            {
+                LogPrint("reindex", "%s: Processing out of order child %s of %s\n", __func__, pchild->GetHash().ToString(),
+                        head.ToString());
+                CBlockIndex* pindexChild = NULL;
+                {
+                    LOCK(cs_main);
+                    CValidationState dummy;
+                    if (!AcceptBlock(*pchild, dummy, chainparams, &pindexChild, true, &it->second.pos, NULL))
+                        pindexChild = NULL;
+                }
+                if (pindexChild) {
+                    nLoaded++;
+                    queue.push_back(pchild->GetHash());
+                    if (pconnect)
+                        pconnect->Push(pindexChild, pchild, it->second.nSize);
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+            NotifyHeaderTip();
         }
+    }
+    return true;
+}
+
+/** Imports the blocks of one file as they are read, for LoadExternalBlockFile */
+class CBlockFileImporter
+{
+private:
+    const CChainParams& chainparams;
+    bool fReindexing;
+    int& nLoaded;
+
+public:
+    CBlockFileImporter(const CChainParams& chainparamsIn, bool fReindexingIn, int& nLoadedIn) :
+        chainparams(chainparamsIn), fReindexing(fReindexingIn), nLoaded(nLoadedIn) {}
+
+    bool operator()(const CImportBlock& block)
+    {
+        return ImportBlock(chainparams, block.pblock, block.nSize, fReindexing ? &block.pos : NULL, MAX_REINDEX_UNKNOWN_PARENT_SIZE, NULL, nLoaded);
+    }
+};
+
+bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
+{
+    int64_t nStart = GetTimeMillis();
+
+    int nLoaded = 0;
+    try {
+        CBlockFileImporter importer(chainparams, dbp != NULL, nLoaded);
+        ScanBlockFile(chainparams, fileIn, dbp ? dbp->nFile : 0, importer);
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
@@ -4575,6 +5261,145 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
     return nLoaded > 0;
 }
 
+/**
+ * Context-free checks of scanned blocks ahead of AcceptBlock: their scrypt
+ * hashes are computed in one batch and cached on them, and the blocks passing
+ * CheckBlock are marked as checked.
+ */
+static void CheckScannedBlocks(const std::vector<CImportBlock>& vBlocks, const Consensus::Params& consensusParams)
+{
+    std::vector<CBlockHeader> vHeaders;
+    vHeaders.reserve(vBlocks.size());
+    for (size_t i = 0; i < vBlocks.size(); i++)
+        vHeaders.push_back(vBlocks[i].pblock->GetBlockHeader());
+    std::vector<uint256> vHashes(vHeaders.size());
+    GetPoWHashes(&vHeaders[0], vHeaders.size(), &vHashes[0]);
+    for (size_t i = 0; i < vBlocks.size(); i++) {
+        vBlocks[i].pblock->SetCachedPoWHash(vHashes[i]);
+        // Failures are left to AcceptBlock, which marks the block invalid
+        CValidationState state;
+        CheckBlock(*vBlocks[i].pblock, state, consensusParams);
+    }
+}
+
+/** Checks and queues the blocks of one file in batches, for the -reindex scanner threads */
+class CBlockFileScanner
+{
+private:
+    const Consensus::Params& consensusParams;
+    CReindexQueue& queue;
+    std::vector<CImportBlock> vBatch;
+
+public:
+    CBlockFileScanner(const Consensus::Params& consensusParamsIn, CReindexQueue& queueIn) :
+        consensusParams(consensusParamsIn), queue(queueIn) {}
+
+    bool operator()(const CImportBlock& block)
+    {
+        vBatch.push_back(block);
+        return vBatch.size() < POW_CHECK_BATCH_SIZE || Flush();
+    }
+
+    bool Flush()
+    {
+        if (vBatch.empty())
+            return true;
+        CheckScannedBlocks(vBatch, consensusParams);
+        bool fOk = true;
+        for (size_t i = 0; i < vBatch.size() && fOk; i++)
+            fOk = queue.Push(vBatch[i]);
+        vBatch.clear();
+        return fOk;
+    }
+};
+
+static void ThreadScanBlockFiles(const CChainParams& chainparams, CReindexQueue* pqueue)
+{
+    int nFile;
+    while (pqueue->Claim(nFile)) {
+        CDiskBlockPos pos(nFile, 0);
+        if (!boost::filesystem::exists(GetBlockPosFilename(pos, "blk"))) {
+            pqueue->End(nFile); // No block files left to reindex
+            break;
+        }
+        FILE *file = OpenBlockFile(pos, true);
+        if (!file) {
+            pqueue->End(nFile); // This error is logged in OpenBlockFile
+            break;
+        }
+        LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
+        CBlockFileScanner scanner(chainparams.GetConsensus(), *pqueue);
+        try {
+            ScanBlockFile(chainparams, file, nFile, scanner);
+            scanner.Flush();
+        } catch (const std::runtime_error& e) {
+            AbortNode(std::string("System error: ") + e.what());
+        }
+        pqueue->Finish(nFile);
+    }
+}
+
+static void ThreadReindexConnect(const CChainParams& chainparams, CReindexConnectQueue* pconnect)
+{
+    while (pconnect->Wait()) {
+        {
+            LOCK(cs_main);
+            // The genesis block is activated by the indexer
+            if (chainActive.Tip() == NULL)
+                continue;
+        }
+        CValidationState state;
+        if (!ActivateBestChain(state, chainparams))
+            LogPrintf("%s: failed to connect best block (%s)\n", __func__, FormatStateMessage(state));
+    }
+}
+
+bool ReindexBlockFiles(const CChainParams& chainparams, int nScanThreads, size_t nMaxUnknownParentSize, size_t nMaxConnectQueueSize)
+{
+    int64_t nStart = GetTimeMillis();
+
+    CReindexQueue queue;
+    CReindexConnectQueue connect(nMaxConnectQueueSize);
+    {
+        LOCK(cs_main);
+        preindexconnect = &connect;
+    }
+    boost::thread_group threads;
+    for (int i = 0; i < std::max(nScanThreads, 1); i++)
+        threads.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "reindexscan",
+            boost::function<void()>(boost::bind(&ThreadScanBlockFiles, boost::cref(chainparams), &queue))));
+    threads.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "reindexconnect",
+        boost::function<void()>(boost::bind(&ThreadReindexConnect, boost::cref(chainparams), &connect))));
+
+    // Blocks are added to the index in file order, as when reading the files one by one
+    int nLoaded = 0;
+    try {
+        CImportBlock block;
+        int nSkipFile = -1;
+        while (queue.Pop(block)) {
+            if (block.pos.nFile == nSkipFile)
+                continue;
+            if (!ImportBlock(chainparams, block.pblock, block.nSize, &block.pos, nMaxUnknownParentSize, &connect, nLoaded))
+                nSkipFile = block.pos.nFile;
+        }
+        connect.Stop();
+        threads.join_all();
+    } catch (...) {
+        threads.interrupt_all();
+        threads.join_all();
+        LOCK(cs_main);
+        preindexconnect = NULL;
+        throw;
+    }
+    {
+        LOCK(cs_main);
+        preindexconnect = NULL;
+    }
+
+    LogPrintf("Reindexed %i blocks in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    return nLoaded > 0;
+}
+
 void static CheckBlockIndex(const Consensus::Params& consensusParams)
 {
     if (!fCheckBlockIndex) {
@@ -4900,52 +5725,63 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block);
-                    else if (inv.type == MSG_WITNESS_BLOCK)
-                        pfrom->PushMessage(NetMsgType::BLOCK, block);
-                    else if (inv.type == MSG_FILTERED_BLOCK)
-                    {
-                        bool send = false;
-                        CMerkleBlock merkleBlock;
+                    // Blocks are stored in their network serialization with witness data. Unless the
+                    // witness has to be stripped, or a merkleblock or compact block has to be built,
+                    // send the stored bytes as they are.
+                    bool fPeerWantsWitness = inv.type == MSG_WITNESS_BLOCK || (inv.type == MSG_CMPCT_BLOCK && State(pfrom->GetId())->fWantsCmpctWitness);
+                    bool fCmpctBlock = inv.type == MSG_CMPCT_BLOCK && CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH;
+                    bool fRaw = inv.type != MSG_FILTERED_BLOCK && !fCmpctBlock && CanSendRawBlock(mi->second, fPeerWantsWitness, consensusParams);
+                    CMappedBlock rawBlock;
+                    std::vector<char> vchRawBlock;
+                    if (fRaw && ReadRawBlockFromDisk(rawBlock, vchRawBlock, mi->second)) {
+                        pfrom->PushMessage(NetMsgType::BLOCK, CFlatData((void*)rawBlock.pbegin, (void*)rawBlock.pend));
+                    } else {
+                        // Send block from disk
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
+                            assert(!"cannot load block from disk");
+                        if (inv.type == MSG_BLOCK)
+                            pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block);
+                        else if (inv.type == MSG_WITNESS_BLOCK)
+                            pfrom->PushMessage(NetMsgType::BLOCK, block);
+                        else if (inv.type == MSG_FILTERED_BLOCK)
                         {
-                            LOCK(pfrom->cs_filter);
-                            if (pfrom->pfilter) {
-                                send = true;
-                                merkleBlock = CMerkleBlock(block, *pfrom->pfilter);
+                            bool send = false;
+                            CMerkleBlock merkleBlock;
+                            {
+                                LOCK(pfrom->cs_filter);
+                                if (pfrom->pfilter) {
+                                    send = true;
+                                    merkleBlock = CMerkleBlock(block, *pfrom->pfilter);
+                                }
+                            }
+                            if (send) {
+                                pfrom->PushMessage(NetMsgType::MERKLEBLOCK, merkleBlock);
+                                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                                // This avoids hurting performance by pointlessly requiring a round-trip
+                                // Note that there is currently no way for a node to request any single transactions we didn't send here -
+                                // they must either disconnect and retry or request the full block.
+                                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                                // however we MUST always provide at least what the remote peer needs
+                                typedef std::pair<unsigned int, uint256> PairType;
+                                BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
+                                    pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, block.vtx[pair.first]);
                             }
+                            // else
+                                // no response
                         }
-                        if (send) {
-                            pfrom->PushMessage(NetMsgType::MERKLEBLOCK, merkleBlock);
-                            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                            // This avoids hurting performance by pointlessly requiring a round-trip
-                            // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                            // they must either disconnect and retry or request the full block.
-                            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                            // however we MUST always provide at least what the remote peer needs
-                            typedef std::pair<unsigned int, uint256> PairType;
-                            BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
-                                pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, block.vtx[pair.first]);
+                        else if (inv.type == MSG_CMPCT_BLOCK)
+                        {
+                            // If a peer is asking for old blocks, we're almost guaranteed
+                            // they wont have a useful mempool to match against a compact block,
+                            // and we don't feel like constructing the object for them, so
+                            // instead we respond with the full, non-compact block.
+                            if (fCmpctBlock) {
+                                CBlockHeaderAndShortTxIDs cmpctblock(block, fPeerWantsWitness);
+                                pfrom->PushMessageWithFlag(fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::CMPCTBLOCK, cmpctblock);
+                            } else
+                                pfrom->PushMessageWithFlag(fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block);
                         }
-                        // else
-                            // no response
-                    }
-                    else if (inv.type == MSG_CMPCT_BLOCK)
-                    {
-                        // If a peer is asking for old blocks, we're almost guaranteed
-                        // they wont have a useful mempool to match against a compact block,
-                        // and we don't feel like constructing the object for them, so
-                        // instead we respond with the full, non-compact block.
-                        bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
-                        if (CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
-                            CBlockHeaderAndShortTxIDs cmpctblock(block, fPeerWantsWitness);
-                            pfrom->PushMessageWithFlag(fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::CMPCTBLOCK, cmpctblock);
-                        } else
-                            pfrom->PushMessageWithFlag(fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block);
                     }
 
                     // Trigger the peer node to send a getblocks request for the next batch of inventory
@@ -6013,14 +6849,16 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
-        {
-        LOCK(cs_main);
-
         if (nCount == 0) {
             // Nothing interesting. Stop asking this peers for more headers.
             return true;
         }
 
+        // Headers we already know were checked when they were accepted.
+        size_t nFirstUnknown = 0;
+        {
+        LOCK(cs_main);
+
         CNodeState *nodestate = State(pfrom->GetId());
 
         // If this looks like it could be a block announcement (nCount <
@@ -6049,15 +6887,55 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             }
             return true;
         }
+        if (mapBlockIndex.find(headers[0].hashPrevBlock) == mapBlockIndex.end()) {
+            Misbehaving(pfrom->GetId(), 10);
+            return error("headers message: prev block not found");
+        }
+
+        // The sequence must be continuous before any proof of work is hashed,
+        // so junk headers cost the sender as much as they cost us.
+        for (size_t n = 1; n < headers.size(); n++) {
+            if (headers[n].hashPrevBlock != headers[n - 1].GetHash()) {
+                Misbehaving(pfrom->GetId(), 20);
+                return error("non-continuous headers sequence");
+            }
+        }
+
+        while (nFirstUnknown < headers.size() && mapBlockIndex.count(headers[nFirstUnknown].GetHash()))
+            nFirstUnknown++;
+        }
+
+        // Check the proof of work of the unknown headers as a batch before
+        // taking cs_main again, so only the contextual checks run under the lock.
+        if (nFirstUnknown < headers.size()) {
+            CValidationState state;
+            std::vector<CBlockHeader> vUnknown(headers.begin() + nFirstUnknown, headers.end());
+            if (!CheckBlockHeadersPoW(vUnknown, state, chainparams.GetConsensus())) {
+                int nDoS;
+                if (state.IsInvalid(nDoS) && nDoS > 0) {
+                    LOCK(cs_main);
+                    Misbehaving(pfrom->GetId(), nDoS);
+                }
+                return error("invalid header received");
+            }
+            // Carry the memoized PoW hashes over to the index entries
+            std::copy(vUnknown.begin(), vUnknown.end(), headers.begin() + nFirstUnknown);
+        }
+
+        {
+        LOCK(cs_main);
+
+        CNodeState *nodestate = State(pfrom->GetId());
 
         CBlockIndex *pindexLast = NULL;
-        BOOST_FOREACH(const CBlockHeader& header, headers) {
+        for (size_t n = 0; n < headers.size(); n++) {
+            const CBlockHeader& header = headers[n];
             CValidationState state;
             if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
                 Misbehaving(pfrom->GetId(), 20);
                 return error("non-continuous headers sequence");
             }
-            if (!AcceptBlockHeader(header, state, chainparams, &pindexLast)) {
+            if (!AcceptBlockHeader(header, state, chainparams, &pindexLast, n < nFirstUnknown)) {
                 int nDoS;
                 if (state.IsInvalid(nDoS)) {
                     if (nDoS > 0)
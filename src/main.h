@@ -19,6 +19,7 @@
 #include "versionbits.h"
 
 #include <algorithm>
+#include <deque>
 #include <exception>
 #include <map>
 #include <set>
@@ -27,10 +28,15 @@
 #include <utility>
 #include <vector>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/unordered_map.hpp>
 
+class CBlockFileMap;
+struct CMappedBlock;
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsViewSnapshot;
 class CBloomFilter;
 class CChainParams;
 class CInv;
@@ -82,6 +88,20 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Number of separately locked shards in pcoinsTip, so inputs can be prefetched in parallel */
+static const unsigned int COINS_TIP_SHARDS = 16;
+/** Default for -backgroundflush, writing the coins cache to disk on a separate thread */
+static const bool DEFAULT_BACKGROUND_FLUSH = true;
+/** Prefetches queued, beyond which the inputs of further blocks are not queued */
+static const size_t MAX_COINS_PREFETCH_QUEUED = 100000;
+/** Maximum number of threads scanning block files in parallel during -reindex */
+static const int MAX_REINDEX_SCAN_THREADS = 4;
+/** Serialized size of the blocks a -reindex scanner may decode ahead of the indexer, per file */
+static const size_t REINDEX_SCAN_QUEUE_SIZE = 16 << 20;
+/** Serialized size of the out-of-order blocks kept decoded during -reindex; further ones are read again from disk */
+static const size_t MAX_REINDEX_UNKNOWN_PARENT_SIZE = 32 << 20;
+/** Serialized size of the blocks kept decoded during -reindex between adding them to the index and connecting them */
+static const size_t REINDEX_CONNECT_QUEUE_SIZE = 32 << 20;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -156,6 +176,8 @@ struct BlockHasher
 extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
+/** Finalized block files mapped for reading blocks back */
+extern CBlockFileMap mappedBlockFiles;
 typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
 extern uint64_t nLastBlockTx;
@@ -199,6 +221,7 @@ static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
 
 static const signed int DEFAULT_CHECKBLOCKS = 6 * 4;
 static const unsigned int DEFAULT_CHECKLEVEL = 3;
+static const bool DEFAULT_CHECKPOWONLOAD = false;
 
 // Require that user allocate at least 550MB for block & undo files (blk???.dat and rev???.dat)
 // At 1MB per block, 288 blocks = 288MB.
@@ -238,6 +261,15 @@ FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = NULL);
+/**
+ * Rebuild the block index from all blk?????.dat files. nScanThreads threads
+ * read the files and check blocks ahead of the index, while the best chain is
+ * connected on another thread as it grows. The last two arguments bound the
+ * out-of-order and the indexed but not yet connected blocks kept decoded.
+ */
+bool ReindexBlockFiles(const CChainParams& chainparams, int nScanThreads,
+                       size_t nMaxUnknownParentSize = MAX_REINDEX_UNKNOWN_PARENT_SIZE,
+                       size_t nMaxConnectQueueSize = REINDEX_CONNECT_QUEUE_SIZE);
 /** Initialize a new block tree database + block data on disk */
 bool InitBlockIndex(const CChainParams& chainparams);
 /** Load the block tree and coins database from disk */
@@ -254,6 +286,10 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header proof-of-work checking thread */
+void ThreadPoWCheck();
+/** Run an instance of the coins prefetch thread */
+void ThreadCoinsPrefetch();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Format a string that describes several potential problems detected by the core.
@@ -437,16 +473,133 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/** Number of headers hashed together by one CPoWCheck, matching the widest scrypt kernel */
+static const unsigned int POW_CHECK_BATCH_SIZE = 16;
+
+/**
+ * Closure representing the context-free proof-of-work check of a run of
+ * headers. The headers must outlive the check. If phashes is set, the scrypt
+ * hashes are also written there.
+ */
+class CPoWCheck
+{
+private:
+    const CBlockHeader *pheaders;
+    unsigned int nCount;
+    const Consensus::Params *pconsensusParams;
+    uint256 *phashes;
+
+public:
+    CPoWCheck(): pheaders(NULL), nCount(0), pconsensusParams(NULL), phashes(NULL) {}
+    CPoWCheck(const CBlockHeader* pheadersIn, unsigned int nCountIn, const Consensus::Params& consensusParamsIn, uint256* phashesIn = NULL) :
+        pheaders(pheadersIn), nCount(nCountIn), pconsensusParams(&consensusParamsIn), phashes(phashesIn) { }
+
+    bool operator()();
+
+    void swap(CPoWCheck &check) {
+        std::swap(pheaders, check.pheaders);
+        std::swap(nCount, check.nCount);
+        std::swap(pconsensusParams, check.pconsensusParams);
+        std::swap(phashes, check.phashes);
+    }
+};
+
+/**
+ * Load the coins of one txid into a cache from a worker thread, so the
+ * database reads for a block's inputs overlap with connecting it.
+ */
+class CCoinsPrefetch
+{
+private:
+    const CCoinsViewCache *pcoins;
+    uint256 txid;
+
+public:
+    CCoinsPrefetch(): pcoins(NULL) {}
+    CCoinsPrefetch(const CCoinsViewCache& coinsIn, const uint256& txidIn) : pcoins(&coinsIn), txid(txidIn) { }
+
+    void operator()() {
+        pcoins->PrefetchCoins(txid);
+    }
+};
+
+/**
+ * Prefetches worked off in order by a set of worker threads. Unlike a
+ * CCheckQueue it has no master that waits for the work, so the inputs of a
+ * block can be queued well before it is connected, and the inputs of later
+ * blocks never overtake those of the block being connected.
+ */
+class CCoinsPrefetchQueue
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    boost::condition_variable condDone;
+    std::deque<CCoinsPrefetch> queue;
+    //! Prefetches taken off the queue but not finished
+    unsigned int nBusy;
+    const size_t nMaxQueued;
+
+public:
+    CCoinsPrefetchQueue(size_t nMaxQueuedIn) : nBusy(0), nMaxQueued(nMaxQueuedIn) {}
+
+    //! Queue prefetches, unless the workers are already nMaxQueued behind
+    bool Add(const std::vector<CCoinsPrefetch>& vPrefetch);
+
+    //! Block until all queued prefetches are done; needs running workers
+    void Wait();
+
+    //! Worker thread loop, until interrupted
+    void Thread();
+};
+
+/**
+ * The next block to connect, read ahead from disk by the prefetch stage in
+ * front of ConnectTip. It is only handed out for the index it was read for.
+ */
+class CBlockReadAhead
+{
+private:
+    const CBlockIndex* pindex;
+    CBlock block;
+
+public:
+    CBlockReadAhead() : pindex(NULL) {}
+
+    //! Read the block of pindexIn, replacing the one held
+    bool Read(const CBlockIndex* pindexIn, const Consensus::Params& consensusParams);
+    //! Move the held block into blockOut if it was read for pindexIn. It is dropped either way.
+    bool Take(const CBlockIndex* pindexIn, CBlock& blockOut);
+    void Clear();
+
+    const CBlockIndex* GetIndex() const { return pindex; }
+    const CBlock& GetBlock() const { return block; }
+};
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPOW = true);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/**
+ * Find the serialized block of pindex, as stored on disk: this is also its network serialization,
+ * with witness data. It is located in the mapped block file when possible, otherwise it is copied
+ * into vchBuffer and block points there. Only the header is checked against the index.
+ */
+bool ReadRawBlockFromDisk(CMappedBlock& block, std::vector<char>& vchBuffer, const CBlockIndex* pindex);
+/** Whether the stored bytes of pindex can be sent as they are to a peer that does or doesn't want witness data */
+bool CanSendRawBlock(const CBlockIndex* pindex, bool fPeerWantsWitness, const Consensus::Params& consensusParams);
 
 /** Functions for validating blocks and updating the block tree */
 
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true);
+/**
+ * Check the proof of work of a batch of headers, spread over the -par worker
+ * threads and the multi-lane scrypt kernels. Does not need cs_main, so callers
+ * can run it before taking the lock and skip the PoW check in
+ * CheckBlockHeader afterwards.
+ */
+bool CheckBlockHeadersPoW(const std::vector<CBlockHeader>& headers, CValidationState& state, const Consensus::Params& consensusParams);
 bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
 
 /** Context-dependent validity checks.
@@ -505,6 +658,9 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
+/** Layer below pcoinsTip holding its last flush while that is written to disk (protected by cs_main) */
+extern CCoinsViewSnapshot *pcoinsSnapshot;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
@@ -6,12 +6,14 @@
 #include "miner.h"
 
 #include "amount.h"
+#include "arith_uint256.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "coins.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
 #include "hash.h"
 #include "crypto/scrypt.h"
 #include "main.h"
@@ -32,8 +34,11 @@
 #include "wallet/wallet.h"
 
 #include <algorithm>
+#include <atomic>
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
+#include <limits>
 #include <queue>
 
 using namespace std;
@@ -126,16 +131,36 @@ void BlockAssembler::resetBlock()
 
     lastFewTxs = 0;
     blockFinished = false;
+
+    fResourceLimited = false;
+    nMinPackageFees = 0;
+    nMinPackageSize = 0;
 }
 
 CBlockTemplate* BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
+{
+    LOCK2(cs_main, mempool.cs);
+    CBlockIndex* pindexPrev = chainActive.Tip();
+
+    StartBlock(pindexPrev);
+    if(!pblocktemplate.get())
+        return NULL;
+
+    addPriorityTxs();
+    addPackageTxs();
+
+    FinishBlock(scriptPubKeyIn, pindexPrev, true);
+    return pblocktemplate.release();
+}
+
+void BlockAssembler::StartBlock(CBlockIndex* pindexPrev)
 {
     resetBlock();
 
     pblocktemplate.reset(new CBlockTemplate());
 
     if(!pblocktemplate.get())
-        return NULL;
+        return;
     pblock = &pblocktemplate->block; // pointer for convenience
 
     // Add dummy coinbase tx as first transaction
@@ -143,8 +168,6 @@ CBlockTemplate* BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
     pblocktemplate->vTxFees.push_back(-1); // updated at end
     pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
 
-    LOCK2(cs_main, mempool.cs);
-    CBlockIndex* pindexPrev = chainActive.Tip();
     nHeight = pindexPrev->nHeight + 1;
 
     pblock->nVersion = ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
@@ -167,10 +190,10 @@ CBlockTemplate* BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
     // TODO: replace this with a call to main to assess validity of a mempool
     // transaction (which in most cases can be a no-op).
     fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus());
+}
 
-    addPriorityTxs();
-    addPackageTxs();
-
+void BlockAssembler::FinishBlock(const CScript& scriptPubKeyIn, CBlockIndex* pindexPrev, bool fTestValidity)
+{
     nLastBlockTx = nBlockTx;
     nLastBlockSize = nBlockSize;
     nLastBlockWeight = nBlockWeight;
@@ -195,6 +218,7 @@ CBlockTemplate* BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
 
     pblock->vtx[0] = coinbaseTx;
     pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
+    pblocktemplate->vCoinbaseMerkleBranch = BlockMerkleBranch(*pblock, 0);
     pblocktemplate->vTxFees[0] = -nFees;
 
     uint64_t nSerializeSize = GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION);
@@ -208,11 +232,9 @@ CBlockTemplate* BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
     pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(pblock->vtx[0]);
 
     CValidationState state;
-    if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+    if (fTestValidity && !TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
     }
-
-    return pblocktemplate.release();
 }
 
 bool BlockAssembler::isStillDependent(CTxMemPool::txiter iter)
@@ -265,6 +287,7 @@ bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& packa
         if (fNeedSizeAccounting) {
             uint64_t nTxSize = ::GetSerializeSize(it->GetTx(), SER_NETWORK, PROTOCOL_VERSION);
             if (nPotentialBlockSize + nTxSize >= nBlockMaxSize) {
+                fResourceLimited = true;
                 return false;
             }
             nPotentialBlockSize += nTxSize;
@@ -418,20 +441,36 @@ void BlockAssembler::addPackageTxs()
     // mapModifiedTx will store sorted packages after they are modified
     // because some of their txs are already in the block
     indexed_modified_transaction_set mapModifiedTx;
-    // Keep track of entries that failed inclusion, to avoid duplicate work
-    CTxMemPool::setEntries failedTx;
 
     // Start by adding all descendants of previously added txs to mapModifiedTx
     // and modifying them for their already included ancestors
     UpdatePackagesForAdded(inBlock, mapModifiedTx);
 
-    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = mempool.mapTx.get<ancestor_score>().begin();
+    addPackageTxs(mempool.mapTx.get<ancestor_score>().begin(), mempool.mapTx.get<ancestor_score>().end(), mapModifiedTx);
+}
+
+static inline CTxMemPool::txiter ScoreEntry(CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi)
+{
+    return mempool.mapTx.project<0>(mi);
+}
+
+static inline CTxMemPool::txiter ScoreEntry(std::vector<CTxMemPool::txiter>::iterator mi)
+{
+    return *mi;
+}
+
+template<typename ScoreIter>
+void BlockAssembler::addPackageTxs(ScoreIter mi, ScoreIter miEnd, indexed_modified_transaction_set& mapModifiedTx)
+{
+    // Keep track of entries that failed inclusion, to avoid duplicate work
+    CTxMemPool::setEntries failedTx;
+
     CTxMemPool::txiter iter;
-    while (mi != mempool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty())
+    while (mi != miEnd || !mapModifiedTx.empty())
     {
         // First try to find a new transaction in mapTx to evaluate.
-        if (mi != mempool.mapTx.get<ancestor_score>().end() &&
-                SkipMapTxEntry(mempool.mapTx.project<0>(mi), mapModifiedTx, failedTx)) {
+        if (mi != miEnd &&
+                SkipMapTxEntry(ScoreEntry(mi), mapModifiedTx, failedTx)) {
             ++mi;
             continue;
         }
@@ -441,13 +480,13 @@ void BlockAssembler::addPackageTxs()
         bool fUsingModified = false;
 
         modtxscoreiter modit = mapModifiedTx.get<ancestor_score>().begin();
-        if (mi == mempool.mapTx.get<ancestor_score>().end()) {
+        if (mi == miEnd) {
             // We're out of entries in mapTx; use the entry from mapModifiedTx
             iter = modit->iter;
             fUsingModified = true;
         } else {
             // Try to compare the mapTx entry to the mapModifiedTx entry
-            iter = mempool.mapTx.project<0>(mi);
+            iter = ScoreEntry(mi);
             if (modit != mapModifiedTx.get<ancestor_score>().end() &&
                     CompareModifiedEntry()(*modit, CTxMemPoolModifiedEntry(iter))) {
                 // The best entry in mapModifiedTx has higher score
@@ -481,6 +520,7 @@ void BlockAssembler::addPackageTxs()
         }
 
         if (!TestPackage(packageSize, packageSigOpsCost)) {
+            fResourceLimited = true;
             if (fUsingModified) {
                 // Since we always look at the best entry in mapModifiedTx,
                 // we must erase failed entries so that we can consider the
@@ -518,6 +558,11 @@ void BlockAssembler::addPackageTxs()
             mapModifiedTx.erase(sortedEntries[i]);
         }
 
+        if (nMinPackageSize == 0 || (double)packageFees * nMinPackageSize < (double)nMinPackageFees * packageSize) {
+            nMinPackageFees = packageFees;
+            nMinPackageSize = packageSize;
+        }
+
         // Update transactions that depend on each of these
         UpdatePackagesForAdded(ancestors, mapModifiedTx);
     }
@@ -649,7 +694,396 @@ bool BlockAssembler::createOeruBaseOutput(const int nHeight, CTxOut &oeruBaseOut
 }
 #endif
 
-void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
+BlockTemplateEngine::BlockTemplateEngine(const CChainParams& _chainparams)
+    : BlockAssembler(_chainparams), fStale(true)
+{
+    // Priority transactions are picked by a separate pass that can't be extended
+    fIncremental = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE) == 0;
+
+    LOCK(mempool.cs);
+    connAdded = mempool.NotifyEntryAdded.connect(boost::bind(&BlockTemplateEngine::TransactionAdded, this, _1));
+    connRemoved = mempool.NotifyEntryRemoved.connect(boost::bind(&BlockTemplateEngine::TransactionRemoved, this, _1));
+    connPrioritised = mempool.NotifyEntryPrioritised.connect(boost::bind(&BlockTemplateEngine::TransactionPrioritised, this, _1));
+}
+
+BlockTemplateEngine::~BlockTemplateEngine()
+{
+    LOCK(mempool.cs);
+    connAdded.disconnect();
+    connRemoved.disconnect();
+    connPrioritised.disconnect();
+}
+
+CBlockTemplate* BlockTemplateEngine::CreateNewBlock(const CScript& scriptPubKeyIn)
+{
+    LOCK2(cs_main, mempool.cs);
+    CBlockIndex* pindexPrev = chainActive.Tip();
+
+    if (!UpdateSelection(pindexPrev)) {
+        // Only transactions from the mempool were appended, after the same
+        // checks as in a full assembly, to a selection that passed
+        // TestBlockValidity already
+        FinishBlock(scriptPubKeyIn, pindexPrev, false);
+        return new CBlockTemplate(*pblocktemplate);
+    }
+    if(!pblocktemplate.get())
+        return NULL;
+
+    // Don't build on a selection that failed validation
+    fStale = true;
+    FinishBlock(scriptPubKeyIn, pindexPrev, true);
+    fStale = false;
+    return new CBlockTemplate(*pblocktemplate);
+}
+
+bool BlockTemplateEngine::UpdateSelection(CBlockIndex* pindexPrev)
+{
+    LOCK(mempool.cs);
+
+    if (fIncremental && !fStale && pblocktemplate.get() && pindexPrev->GetBlockHash() == hashSelectionPrev) {
+        std::vector<CTxMemPool::txiter> vCandidates;
+        indexed_modified_transaction_set mapModifiedTx;
+        bool fAppend = GetCandidates(vCandidates, mapModifiedTx);
+        vAdded.clear();
+        if (fAppend) {
+            addPackageTxs(vCandidates.begin(), vCandidates.end(), mapModifiedTx);
+            LogPrint("bench", "BlockTemplateEngine: offered %u transactions, %u in block\n", vCandidates.size(), nBlockTx);
+            return false;
+        }
+    }
+
+    vAdded.clear();
+    StartBlock(pindexPrev);
+    addPriorityTxs();
+    addPackageTxs();
+    hashSelectionPrev = pindexPrev->GetBlockHash();
+    fStale = false;
+    return true;
+}
+
+bool BlockTemplateEngine::GetCandidates(std::vector<CTxMemPool::txiter>& vCandidates, indexed_modified_transaction_set& mapModifiedTx)
+{
+    vCandidates.reserve(vAdded.size());
+    BOOST_FOREACH(const uint256& hash, vAdded) {
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it != mempool.mapTx.end() && !inBlock.count(it))
+            vCandidates.push_back(it);
+    }
+    std::sort(vCandidates.begin(), vCandidates.end(), CompareTxIterByAncestorFee());
+    vCandidates.erase(std::unique(vCandidates.begin(), vCandidates.end()), vCandidates.end());
+
+    bool fOutscores = false;
+    uint64_t nTotalSize = 0;
+    int64_t nTotalSigOpsCost = 0;
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    BOOST_FOREACH(CTxMemPool::txiter it, vCandidates) {
+        // Take selected ancestors out of the package, as UpdatePackagesForAdded
+        // does for descendants of transactions added to the block
+        CTxMemPool::setEntries ancestors;
+        mempool.CalculateMemPoolAncestors(*it, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        CTxMemPoolModifiedEntry modEntry(it);
+        bool fModified = false;
+        BOOST_FOREACH(CTxMemPool::txiter parent, ancestors) {
+            if (inBlock.count(parent)) {
+                modEntry.nSizeWithAncestors -= parent->GetTxSize();
+                modEntry.nModFeesWithAncestors -= parent->GetModifiedFee();
+                modEntry.nSigOpCostWithAncestors -= parent->GetSigOpCost();
+                fModified = true;
+            }
+        }
+        if (fModified)
+            mapModifiedTx.insert(modEntry);
+
+        if (nMinPackageSize != 0 &&
+                (double)modEntry.nModFeesWithAncestors * nMinPackageSize > (double)nMinPackageFees * modEntry.nSizeWithAncestors)
+            fOutscores = true;
+        nTotalSize += modEntry.nSizeWithAncestors;
+        nTotalSigOpsCost += modEntry.nSigOpCostWithAncestors;
+    }
+
+    // Appending gives the block a full assembly would unless a package that
+    // outscores one already selected misses out for lack of room: a full
+    // assembly would have added it first. Assume that whenever the block is
+    // already out of room or the new packages might not all fit.
+    if (!fOutscores)
+        return true;
+    if (fResourceLimited || !TestPackage(nTotalSize, nTotalSigOpsCost))
+        return false;
+    if (fNeedSizeAccounting && nBlockSize + nTotalSize >= nBlockMaxSize)
+        return false;
+    return true;
+}
+
+void BlockTemplateEngine::SetStale()
+{
+    LOCK(mempool.cs);
+    fStale = true;
+    vAdded.clear();
+}
+
+void BlockTemplateEngine::TransactionAdded(const CTxMemPoolEntry& entry)
+{
+    if (fStale || !fIncremental)
+        return;
+    if (vAdded.size() >= BLOCK_TEMPLATE_MAX_PENDING) {
+        fStale = true;
+        vAdded.clear();
+        return;
+    }
+    vAdded.push_back(entry.GetTx().GetHash());
+}
+
+void BlockTemplateEngine::TransactionRemoved(const CTxMemPoolEntry& entry)
+{
+    // Drop it now: inBlock must not keep iterators to removed entries
+    if (inBlock.erase(mempool.mapTx.iterator_to(entry)))
+        fStale = true;
+}
+
+void BlockTemplateEngine::TransactionPrioritised(const CTxMemPoolEntry& entry)
+{
+    fStale = true;
+    vAdded.clear();
+}
+
+CBlockTemplateCache* pblockTemplateCache = NULL;
+
+CBlockTemplateCache::CWaiter::CWaiter(CBlockTemplateCache& cacheIn) : cache(cacheIn)
+{
+    boost::unique_lock<boost::mutex> lock(cache.mutex);
+    cache.nWaiters++;
+}
+
+CBlockTemplateCache::CWaiter::~CWaiter()
+{
+    boost::unique_lock<boost::mutex> lock(cache.mutex);
+    cache.nWaiters--;
+}
+
+CBlockTemplateCache::CBlockTemplateCache(const CChainParams& chainparams)
+    : engine(chainparams), fActive(false), fTipChanged(false), nWaiters(0)
+{
+}
+
+CCachedBlockTemplateRef CBlockTemplateCache::Get()
+{
+    AssertLockHeld(cs_main);
+    CCachedBlockTemplateRef pcached;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fActive = true;
+        pcached = plast;
+    }
+    if (IsUpToDate(pcached))
+        return pcached;
+    return Build();
+}
+
+CCachedBlockTemplateRef CBlockTemplateCache::GetLatest()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return plast;
+}
+
+bool CBlockTemplateCache::WaitForNew(const CCachedBlockTemplateRef& pcurrent, const boost::system_time& deadline)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (plast != pcurrent)
+        return true;
+    nWaiters++;
+    bool fPublished = condPublished.timed_wait(lock, deadline);
+    nWaiters--;
+    return fPublished;
+}
+
+void CBlockTemplateCache::Interrupt()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    condPublished.notify_all();
+}
+
+void CBlockTemplateCache::UpdatedBlockTip(const CBlockIndex *pindex)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fTipChanged = true;
+    condTip.notify_one();
+}
+
+bool CBlockTemplateCache::IsUpToDate(const CCachedBlockTemplateRef& pcached) const
+{
+    AssertLockHeld(cs_main);
+    if (!pcached || pcached->pindexPrev != chainActive.Tip())
+        return false;
+    return pcached->nTransactionsUpdated == mempool.GetTransactionsUpdated() ||
+           GetTime() - pcached->nTime <= BLOCK_TEMPLATE_REFRESH_SECONDS;
+}
+
+CCachedBlockTemplateRef CBlockTemplateCache::Build()
+{
+    AssertLockHeld(cs_main);
+    std::shared_ptr<CCachedBlockTemplate> pcached(new CCachedBlockTemplate());
+    // Store the state used before CreateNewBlock, to avoid races
+    pcached->pindexPrev = chainActive.Tip();
+    pcached->nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    pcached->nTime = GetTime();
+
+    int64_t nStart = GetTimeMicros();
+    CScript scriptDummy = CScript() << OP_TRUE;
+    pcached->pblocktemplate.reset(engine.CreateNewBlock(scriptDummy));
+    if (!pcached->pblocktemplate)
+        return CCachedBlockTemplateRef();
+    LogPrint("bench", "CBlockTemplateCache: built template on %s in %.2fms\n",
+             pcached->pindexPrev->GetBlockHash().ToString(), (GetTimeMicros() - nStart) * 0.001);
+
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        plast = pcached;
+        condPublished.notify_all();
+    }
+    // Longpolls wait on the tip; wake them so they pick up the new template
+    cvBlockChange.notify_all();
+    return pcached;
+}
+
+void CBlockTemplateCache::ThreadBuild()
+{
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            // Wait for a new tip; while templates are asked for, also look
+            // for mempool changes every BLOCK_TEMPLATE_REFRESH_SECONDS
+            while (!fTipChanged) {
+                if (!fActive) {
+                    condTip.wait(lock);
+                } else if (!condTip.timed_wait(lock, boost::posix_time::seconds(BLOCK_TEMPLATE_REFRESH_SECONDS))) {
+                    if (nWaiters > 0)
+                        break;
+                    // Nobody waits for the next template; Get builds it when asked
+                    fActive = false;
+                }
+            }
+            fTipChanged = false;
+            if (!fActive)
+                continue;
+        }
+
+        LOCK(cs_main);
+        if (IsUpToDate(GetLatest()))
+            continue;
+        try {
+            Build();
+        } catch (const std::exception& e) {
+            // The next getblocktemplate call reports it
+            LogPrintf("CBlockTemplateCache: %s\n", e.what());
+        }
+    }
+}
+
+namespace {
+
+/** Nonce search shared by the ScanNonces threads */
+struct CNonceScan
+{
+    char header[80];
+    uint32_t nNonceBegin;
+    //! Number of nonces to try, and how many each thread claims at a time
+    uint64_t nLimit;
+    uint32_t nBatch;
+    const Consensus::Params* params;
+
+    std::atomic<uint64_t> nNext;
+    std::atomic<uint64_t> nHashes;
+    std::atomic<bool> fFound;
+
+    boost::mutex mutex;
+    uint32_t nFoundNonce;
+    uint256 hashFound;
+};
+
+void ScanNoncesThread(CNonceScan& scan)
+{
+    CScryptContext& context = CScryptContext::ThreadLocal();
+    // Only the last 16 bytes (nTime, nBits, nNonce) differ between inputs
+    CScryptMidstate midstate(scan.header);
+    std::vector<char> vTails(16 * scan.nBatch);
+    std::vector<uint256> vHashes(scan.nBatch);
+    for (uint32_t i = 0; i < scan.nBatch; i++)
+        memcpy(&vTails[16 * i], &scan.header[64], 16);
+
+    while (!scan.fFound) {
+        uint64_t nOffset = scan.nNext.fetch_add(scan.nBatch);
+        if (nOffset >= scan.nLimit)
+            break;
+        uint32_t nCount = std::min<uint64_t>(scan.nBatch, scan.nLimit - nOffset);
+        for (uint32_t i = 0; i < nCount; i++)
+            WriteLE32((unsigned char*)&vTails[16 * i + 12], scan.nNonceBegin + nOffset + i);
+
+        context.HashMulti(midstate, &vTails[0], BEGIN(vHashes[0]), nCount);
+        scan.nHashes += nCount;
+
+        for (uint32_t i = 0; i < nCount; i++) {
+            if (!CheckProofOfWork(vHashes[i], ReadLE32((const unsigned char*)&scan.header[72]), *scan.params))
+                continue;
+            // Keep the lowest nonce found, so one thread's result doesn't depend on timing
+            boost::unique_lock<boost::mutex> lock(scan.mutex);
+            uint32_t nNonce = scan.nNonceBegin + nOffset + i;
+            if (!scan.fFound || nNonce < scan.nFoundNonce) {
+                scan.nFoundNonce = nNonce;
+                scan.hashFound = vHashes[i];
+            }
+            scan.fFound = true;
+            break;
+        }
+    }
+}
+
+} // anon namespace
+
+bool ScanNonces(CBlockHeader& header, uint32_t nNonceBegin, uint32_t nNonceEnd, int nThreads, uint64_t& nMaxTries, const Consensus::Params& consensusParams)
+{
+    if (nNonceEnd <= nNonceBegin || nMaxTries == 0)
+        return false;
+    nThreads = std::max(nThreads, 1);
+
+    CNonceScan scan;
+    memcpy(scan.header, BEGIN(header.nVersion), 80);
+    scan.nNonceBegin = nNonceBegin;
+    scan.nLimit = std::min<uint64_t>(nNonceEnd - nNonceBegin, nMaxTries);
+    scan.params = &consensusParams;
+    scan.nNext = 0;
+    scan.nHashes = 0;
+    scan.fFound = false;
+    scan.nFoundNonce = 0;
+
+    // Batches wider than the expected number of hashes per thread only waste
+    // work on easy targets, such as regtest where every other hash is a block
+    arith_uint256 bnTarget;
+    bnTarget.SetCompact(header.nBits);
+    uint64_t nExpected = std::numeric_limits<uint64_t>::max();
+    if (bnTarget != 0) {
+        arith_uint256 bnExpected = ~bnTarget / (bnTarget + 1) + 1;
+        if (bnExpected.bits() <= 64)
+            nExpected = bnExpected.GetLow64();
+    }
+    scan.nBatch = std::max<uint64_t>(1, std::min<uint64_t>(scrypt_multi_lanes(), nExpected / nThreads));
+
+    boost::thread_group threads;
+    for (int i = 1; i < nThreads; i++)
+        threads.create_thread(boost::bind(&ScanNoncesThread, boost::ref(scan)));
+    ScanNoncesThread(scan);
+    threads.join_all();
+
+    nMaxTries -= std::min<uint64_t>(nMaxTries, scan.nHashes);
+    if (!scan.fFound)
+        return false;
+
+    header.nNonce = scan.nFoundNonce;
+    header.SetCachedPoWHash(scan.hashFound);
+    return true;
+}
+
+static void UpdateExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
     static uint256 hashPrevBlock;
@@ -665,5 +1099,16 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     assert(txCoinbase.vin[0].scriptSig.size() <= 100);
 
     pblock->vtx[0] = txCoinbase;
+}
+
+void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
+{
+    UpdateExtraNonce(pblock, pindexPrev, nExtraNonce);
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce, const std::vector<uint256>& vCoinbaseMerkleBranch)
+{
+    UpdateExtraNonce(pblock, pindexPrev, nExtraNonce);
+    pblock->hashMerkleRoot = ComputeMerkleRootFromBranch(pblock->vtx[0].GetHash(), vCoinbaseMerkleBranch, 0);
+}
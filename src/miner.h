@@ -8,12 +8,16 @@
 
 #include "primitives/block.h"
 #include "txmempool.h"
+#include "validationinterface.h"
 
 #include <stdint.h>
 #include <memory>
 #include "boost/multi_index_container.hpp"
 #include "boost/multi_index/ordered_index.hpp"
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
 class CBlockIndex;
 class CChainParams;
 class CReserveKey;
@@ -30,6 +34,8 @@ struct CBlockTemplate
     std::vector<CAmount> vTxFees;
     std::vector<int64_t> vTxSigOpsCost;
     std::vector<unsigned char> vchCoinbaseCommitment;
+    //! Merkle branch of the coinbase: extranonce changes only rehash this path to the root
+    std::vector<uint256> vCoinbaseMerkleBranch;
 };
 
 // Container for tracking updates to ancestor feerate as we include (parent)
@@ -96,6 +102,14 @@ struct CompareTxIterByAncestorCount {
     }
 };
 
+// Orders mempool entries as the ancestor_score index of mapTx does.
+struct CompareTxIterByAncestorFee {
+    bool operator()(const CTxMemPool::txiter &a, const CTxMemPool::txiter &b)
+    {
+        return CompareTxMemPoolEntryByAncestorFee()(*a, *b);
+    }
+};
+
 typedef boost::multi_index_container<
     CTxMemPoolModifiedEntry,
     boost::multi_index::indexed_by<
@@ -133,7 +147,7 @@ struct update_for_parent_inclusion
 /** Generate a new block, without valid proof-of-work */
 class BlockAssembler
 {
-private:
+protected:
     // The constructed block template
     std::unique_ptr<CBlockTemplate> pblocktemplate;
     // A convenience pointer that always refers to the CBlock in pblocktemplate
@@ -161,15 +175,26 @@ private:
     int lastFewTxs;
     bool blockFinished;
 
+    // Whether a package was left out for lack of room, and the lowest
+    // feerate package included (nMinPackageSize is 0 until one is)
+    bool fResourceLimited;
+    CAmount nMinPackageFees;
+    uint64_t nMinPackageSize;
+
 public:
     BlockAssembler(const CChainParams& chainparams);
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn);
 
-private:
+protected:
     // utility functions
     /** Clear the block's state and prepare for assembling a new block */
     void resetBlock();
+    /** Start a new block template on top of pindexPrev */
+    void StartBlock(CBlockIndex* pindexPrev);
+    /** Add the coinbase and fill in the header of the selected block. Throws if
+      * fTestValidity is set and the result fails TestBlockValidity. */
+    void FinishBlock(const CScript& scriptPubKeyIn, CBlockIndex* pindexPrev, bool fTestValidity);
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
 
@@ -180,6 +205,10 @@ private:
     void addPriorityTxs();
     /** Add transactions based on feerate including unconfirmed ancestors */
     void addPackageTxs();
+    /** Add packages from the mempool entries [mi, miEnd), which must be in
+      * ancestor_score order, and from mapModifiedTx */
+    template<typename ScoreIter>
+    void addPackageTxs(ScoreIter mi, ScoreIter miEnd, indexed_modified_transaction_set& mapModifiedTx);
 
     // helper function for addPriorityTxs
     /** Test if tx will still "fit" in the block */
@@ -207,8 +236,147 @@ private:
     void UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
 };
 
+/** Transactions queued for an incremental template update before falling back to a full one */
+static const size_t BLOCK_TEMPLATE_MAX_PENDING = 20000;
+
+/**
+ * BlockAssembler that keeps its transaction selection between templates.
+ * While the tip stays the same, transactions that entered the mempool since
+ * the last template are offered to the existing selection instead of
+ * assembling the block from scratch. It falls back to a full assembly when
+ * that could give a different block: a selected transaction left the
+ * mempool, a fee was prioritised, or a new package outscores one already
+ * included in a block that is out of room.
+ *
+ * The selection is guarded by mempool.cs.
+ */
+class BlockTemplateEngine : public BlockAssembler
+{
+public:
+    BlockTemplateEngine(const CChainParams& chainparams);
+    ~BlockTemplateEngine();
+
+    /** As BlockAssembler::CreateNewBlock, updating the kept selection */
+    CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn);
+
+    /** Bring the selection up to date for a block on pindexPrev. Returns
+      * true if it was assembled from scratch. */
+    bool UpdateSelection(CBlockIndex* pindexPrev);
+
+    /** Make the next update assemble from scratch */
+    void SetStale();
+
+private:
+    //! Whether -blockprioritysize allows incremental updates at all
+    bool fIncremental;
+    //! Tip the selection was made on; null if there is none
+    uint256 hashSelectionPrev;
+    bool fStale;
+    //! Transactions added to the mempool since the last update
+    std::vector<uint256> vAdded;
+
+    boost::signals2::connection connAdded;
+    boost::signals2::connection connRemoved;
+    boost::signals2::connection connPrioritised;
+
+    /** Collect the queued transactions not yet selected, in ancestor_score
+      * order, with those that have selected ancestors in mapModifiedTx.
+      * Returns false if they can't be added to the selection as is. */
+    bool GetCandidates(std::vector<CTxMemPool::txiter>& vCandidates, indexed_modified_transaction_set& mapModifiedTx);
+
+    void TransactionAdded(const CTxMemPoolEntry& entry);
+    void TransactionRemoved(const CTxMemPoolEntry& entry);
+    void TransactionPrioritised(const CTxMemPoolEntry& entry);
+};
+
+//! Seconds a cached block template is served after the mempool changed
+static const int64_t BLOCK_TEMPLATE_REFRESH_SECONDS = 5;
+
+/** A block template shared between getblocktemplate calls, with the state it was built on */
+struct CCachedBlockTemplate
+{
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    CBlockIndex* pindexPrev;
+    unsigned int nTransactionsUpdated;
+    int64_t nTime;
+};
+typedef std::shared_ptr<const CCachedBlockTemplate> CCachedBlockTemplateRef;
+
+/**
+ * Latest block template for getblocktemplate. Once one was asked for, a
+ * thread builds the next one as soon as the tip changes, and after mempool
+ * changes once the current one is BLOCK_TEMPLATE_REFRESH_SECONDS old, so all
+ * longpoll waiters are answered from one build instead of each building
+ * their own while holding cs_main. It stops when no longpolls are left.
+ */
+class CBlockTemplateCache final : public CValidationInterface
+{
+public:
+    /** Keeps the build thread going while a longpoll waits for the next template */
+    class CWaiter
+    {
+    public:
+        explicit CWaiter(CBlockTemplateCache& cacheIn);
+        ~CWaiter();
+
+    private:
+        CBlockTemplateCache& cache;
+    };
+
+    CBlockTemplateCache(const CChainParams& chainparams);
+
+    /** Template for the current tip, built first if the cached one is out
+      * of date. Null if it couldn't be built. Requires cs_main. */
+    CCachedBlockTemplateRef Get();
+    /** Latest template built, which may be out of date. Null if there is none. */
+    CCachedBlockTemplateRef GetLatest();
+    /** Wait until a template other than pcurrent is published, or until
+      * deadline. Returns false on timeout; may return early when interrupted. */
+    bool WaitForNew(const CCachedBlockTemplateRef& pcurrent, const boost::system_time& deadline);
+    /** Wake up the threads in WaitForNew */
+    void Interrupt();
+
+    /** Thread body: build templates as the chain and mempool change */
+    void ThreadBuild();
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindex);
+
+private:
+    BlockTemplateEngine engine;
+
+    boost::mutex mutex;
+    //! Signals the build thread about a new tip
+    boost::condition_variable condTip;
+    //! Signals WaitForNew about a new template
+    boost::condition_variable condPublished;
+    CCachedBlockTemplateRef plast;
+    //! Whether a template was asked for, so the build thread has to keep it up to date
+    bool fActive;
+    bool fTipChanged;
+    //! Number of longpolls and WaitForNew calls waiting
+    int nWaiters;
+
+    /** Whether pcached can still be served. Requires cs_main. */
+    bool IsUpToDate(const CCachedBlockTemplateRef& pcached) const;
+    /** Build and publish a template for the current tip. Requires cs_main. */
+    CCachedBlockTemplateRef Build();
+};
+
+extern CBlockTemplateCache* pblockTemplateCache;
+
+/**
+ * Search the nonces [nNonceBegin, nNonceEnd) of header for valid proof of
+ * work, on nThreads threads that each hash batches of headers at once. On
+ * success header.nNonce is set and true is returned. At most nMaxTries hashes
+ * are tried; nMaxTries is decreased by the number of hashes done.
+ */
+bool ScanNonces(CBlockHeader& header, uint32_t nNonceBegin, uint32_t nNonceEnd, int nThreads, uint64_t& nMaxTries, const Consensus::Params& consensusParams);
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
+/** As above for an unmodified template block, taking O(log n) hashes with its coinbase merkle branch */
+void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce, const std::vector<uint256>& vCoinbaseMerkleBranch);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
 
 #endif // BITCOIN_MINER_H
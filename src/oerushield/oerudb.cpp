@@ -5,34 +5,74 @@
 #include "oerushield/oerudb.h"
 
 #include "base58.h"
-#include "crypto/sha256.h"
+#include "chainparams.h"
+#include "util.h"
 
-#include <iostream>
+#include <algorithm>
 #include <fstream>
 #include <string>
 
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+
+static const char DB_CERTIFIED = 'a';
+static const char DB_BLOCK_UNDO = 'u';
+static const char DB_BEST_BLOCK = 'B';
+
 COeruDB* poeruDBMain = NULL;
 
-void COeruDB::InitOeruDB(std::string oeruPath, bool reindex)
+void COeruDB::InitOeruDB(const boost::filesystem::path& path, const boost::filesystem::path& legacyPath, bool reindex)
 {
-    COeruDB* oeruDBInstance = new COeruDB(oeruPath);
-    assert(oeruDBInstance->ReadFile());
+    delete poeruDBMain;
+    poeruDBMain = new COeruDB(path, OERUDB_CACHE_SIZE, false, reindex);
 
-    poeruDBMain = oeruDBInstance;
+    if (!reindex && poeruDBMain->GetBestBlock().IsNull() && poeruDBMain->NumCertifiedAddresses() == 0 &&
+        boost::filesystem::exists(legacyPath))
+    {
+        poeruDBMain->ImportLegacyFile(legacyPath.string());
+        LogPrintf("%s: imported %d certified addresses from %s\n", __func__, poeruDBMain->NumCertifiedAddresses(), legacyPath.string());
+    }
+}
 
-    if (reindex) {
-        poeruDBMain->ClearCertifiedAddresses();
-        poeruDBMain->WriteFile();
+bool COeruDB::GetDestinationKey(const CTxDestination& dest, COeruCertifiedKey& key)
+{
+    if (const CKeyID* pkeyID = boost::get<CKeyID>(&dest)) {
+        key = std::make_pair((char)OERU_CERTIFIED_KEY, *pkeyID);
+    } else if (const CScriptID* pscriptID = boost::get<CScriptID>(&dest)) {
+        key = std::make_pair((char)OERU_CERTIFIED_SCRIPT, CKeyID(*pscriptID));
+    } else {
+        return false;
     }
+    return true;
 }
 
-COeruDB::COeruDB(std::string oeruDBFileName)
+COeruDB::COeruDB(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe) :
+    db(path, nCacheSize, fMemory, fWipe, false, GetDBProfile("oerushield")),
+    fSnapshotStale(true)
 {
-    strOeruDBFileName = oeruDBFileName;
+    db.Read(DB_BEST_BLOCK, hashBestBlock);
+
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::make_pair(DB_CERTIFIED, COeruCertifiedKey()));
+    while (pcursor->Valid())
+    {
+        std::pair<char, COeruCertifiedKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_CERTIFIED)
+            break;
+        if (key.second.first == OERU_CERTIFIED_KEY || key.second.first == OERU_CERTIFIED_SCRIPT)
+            setCertified.insert(key.second);
+        pcursor->Next();
+    }
+
+    PublishSnapshot();
 }
 
-bool COeruDB::ShouldReindex(int ChainHeight)
+bool COeruDB::ShouldReindex(int ChainHeight, const uint256& hashBestChain) const
 {
+    // State flushed at another block than the chainstate can't be trusted
+    if (!hashBestChain.IsNull() && !hashBestBlock.IsNull() && hashBestChain != hashBestBlock)
+        return true;
+
     int OeruStartHeight = Params().OeruShieldFirstMasterTXHeight();
     bool OeruIsEmpty = (NumCertifiedAddresses() == 0);
     bool IsAfterStartHeight = ChainHeight > OeruStartHeight;
@@ -40,89 +80,190 @@ bool COeruDB::ShouldReindex(int ChainHeight)
     return IsAfterStartHeight && OeruIsEmpty;
 }
 
-void COeruDB::AddCertifiedAddress(CBitcoinAddress addr)
+void COeruDB::SetCertified(const COeruCertifiedKey& key, bool fCertified, COeruBlockUndo* pundo)
 {
-    vOeruCertifiedAddresses.insert(addr);
+    bool fPrevCertified = setCertified.count(key) > 0;
+    if (pundo != NULL)
+        pundo->vPrevState.push_back(std::make_pair(key, fPrevCertified));
+    if (fPrevCertified == fCertified)
+        return;
+
+    if (fCertified)
+        setCertified.insert(key);
+    else
+        setCertified.erase(key);
+    mapDirty[key] = fCertified;
+    fSnapshotStale = true;
 }
 
-void COeruDB::ClearCertifiedAddresses()
+void COeruDB::AddCertifiedAddress(const CTxDestination& dest, COeruBlockUndo* pundo)
 {
-    vOeruCertifiedAddresses.clear();
+    COeruCertifiedKey key;
+    if (GetDestinationKey(dest, key))
+        SetCertified(key, true, pundo);
 }
 
-void COeruDB::GetCertifiedAddresses(std::vector<CBitcoinAddress> &vAddresses) const
+void COeruDB::ClearCertifiedAddresses()
 {
-    vAddresses.resize(vOeruCertifiedAddresses.size());
-    vAddresses.insert(
-        vAddresses.begin(),
-        vOeruCertifiedAddresses.begin(),
-        vOeruCertifiedAddresses.end()
-    );
+    while (!setCertified.empty())
+        SetCertified(*setCertified.begin(), false, NULL);
 }
 
-bool COeruDB::IsAddressCertified(CBitcoinAddress addr) const
+void COeruDB::GetCertifiedAddresses(std::vector<CTxDestination> &vAddresses) const
 {
-    for (auto it = vOeruCertifiedAddresses.begin(); it != vOeruCertifiedAddresses.end(); ++it)
+    vAddresses.clear();
+    vAddresses.reserve(setCertified.size());
+    for (CertifiedSet::const_iterator it = setCertified.begin(); it != setCertified.end(); ++it)
     {
-        if (*it == addr)
-        {
-            return true;
-        }
+        if (it->first == OERU_CERTIFIED_SCRIPT)
+            vAddresses.push_back(CScriptID(it->second));
+        else
+            vAddresses.push_back(it->second);
     }
+    std::sort(vAddresses.begin(), vAddresses.end());
+}
 
-    return false;
+bool COeruDB::IsAddressCertified(const CTxDestination& dest) const
+{
+    COeruCertifiedKey key;
+    return GetDestinationKey(dest, key) && setCertified.count(key) > 0;
 }
 
 int COeruDB::NumCertifiedAddresses() const
 {
-    return vOeruCertifiedAddresses.size();
+    return setCertified.size();
 }
 
-void COeruDB::RemoveCertifiedAddress(CBitcoinAddress addr)
+void COeruDB::RemoveCertifiedAddress(const CTxDestination& dest, COeruBlockUndo* pundo)
 {
-    for (auto it = vOeruCertifiedAddresses.begin(); it != vOeruCertifiedAddresses.end(); )
-    {
-        if (*it == addr)
-        {
-            it = vOeruCertifiedAddresses.erase(it);
-        }
-        else
-        {
-            ++it;
-        }
+    COeruCertifiedKey key;
+    if (GetDestinationKey(dest, key))
+        SetCertified(key, false, pundo);
+}
+
+void COeruDB::PublishSnapshot()
+{
+    if (!fSnapshotStale)
+        return;
+
+    std::shared_ptr<std::vector<CTxDestination> > next = std::make_shared<std::vector<CTxDestination> >();
+    GetCertifiedAddresses(*next);
+    std::atomic_store(&snapshot, CertifiedSnapshotRef(next));
+    fSnapshotStale = false;
+}
+
+CertifiedSnapshotRef COeruDB::GetCertifiedSnapshot() const
+{
+    return std::atomic_load(&snapshot);
+}
+
+void COeruDB::WriteBlockUndo(const uint256& hashBlock, const COeruBlockUndo& undo)
+{
+    // Blocks without valid master transactions need no record; rescanning
+    // them on disconnect finds nothing to revert either
+    if (undo.vPrevState.empty())
+        return;
+
+    setUndoErased.erase(hashBlock);
+    mapUndoPending[hashBlock] = undo;
+}
+
+bool COeruDB::UndoBlock(const uint256& hashBlock)
+{
+    COeruBlockUndo undo;
+    std::map<uint256, COeruBlockUndo>::iterator it = mapUndoPending.find(hashBlock);
+    if (it != mapUndoPending.end()) {
+        undo.vPrevState.swap(it->second.vPrevState);
+        mapUndoPending.erase(it);
+    } else {
+        boost::unique_lock<boost::mutex> lock(csPrepared);
+        std::map<uint256, COeruBlockUndo>::const_iterator itPrepared = mapUndoPrepared.find(hashBlock);
+        if (itPrepared != mapUndoPrepared.end())
+            undo = itPrepared->second;
+        else if (!db.Read(std::make_pair(DB_BLOCK_UNDO, hashBlock), undo))
+            return false;
     }
+    setUndoErased.insert(hashBlock);
+
+    for (std::vector<std::pair<COeruCertifiedKey, bool> >::reverse_iterator rit = undo.vPrevState.rbegin(); rit != undo.vPrevState.rend(); ++rit)
+        SetCertified(rit->first, rit->second, NULL);
+    return true;
 }
 
-bool COeruDB::ReadFile()
+uint256 COeruDB::GetBestBlock() const
 {
-    std::ifstream dbfile(strOeruDBFileName);
+    boost::unique_lock<boost::mutex> lock(csPrepared);
+    return hashBestBlock;
+}
 
-    std::string strAddress;
-    while (dbfile >> strAddress)
-    {
-        CBitcoinAddress addr(strAddress);
+bool COeruDB::Flush(const uint256& hashBlock)
+{
+    PrepareFlush(hashBlock);
+    return WritePrepared();
+}
 
-        if (addr.IsValid())
-        {
-            AddCertifiedAddress(addr);
-        }
+void COeruDB::PrepareFlush(const uint256& hashBlock)
+{
+    boost::unique_lock<boost::mutex> lock(csPrepared);
+    // A batch that is still waiting is extended; later entries override earlier ones
+    if (!batchPrepared)
+        batchPrepared.reset(new CDBBatch(db));
+    for (std::map<COeruCertifiedKey, bool>::const_iterator it = mapDirty.begin(); it != mapDirty.end(); ++it)
+    {
+        if (it->second)
+            batchPrepared->Write(std::make_pair(DB_CERTIFIED, it->first), '1');
+        else
+            batchPrepared->Erase(std::make_pair(DB_CERTIFIED, it->first));
     }
+    for (std::set<uint256>::const_iterator it = setUndoErased.begin(); it != setUndoErased.end(); ++it)
+    {
+        batchPrepared->Erase(std::make_pair(DB_BLOCK_UNDO, *it));
+        mapUndoPrepared.erase(*it);
+    }
+    for (std::map<uint256, COeruBlockUndo>::const_iterator it = mapUndoPending.begin(); it != mapUndoPending.end(); ++it)
+    {
+        batchPrepared->Write(std::make_pair(DB_BLOCK_UNDO, it->first), it->second);
+        mapUndoPrepared[it->first] = it->second;
+    }
+    batchPrepared->Write(DB_BEST_BLOCK, hashBlock);
+    hashPrepared = hashBlock;
 
-    dbfile.close();
+    mapDirty.clear();
+    mapUndoPending.clear();
+    setUndoErased.clear();
+}
 
+bool COeruDB::WritePrepared()
+{
+    boost::unique_lock<boost::mutex> lock(csPrepared);
+    if (!batchPrepared)
+        return true;
+    if (!db.WriteBatch(*batchPrepared))
+        return false;
+
+    batchPrepared.reset();
+    mapUndoPrepared.clear();
+    hashBestBlock = hashPrepared;
     return true;
 }
 
-bool COeruDB::WriteFile()
+bool COeruDB::ImportLegacyFile(const std::string& strFileName)
 {
-    std::ofstream dbfile(strOeruDBFileName, std::ios::out | std::ios::trunc);
+    std::ifstream dbfile(strFileName);
 
-    for (auto it = vOeruCertifiedAddresses.begin(); it != vOeruCertifiedAddresses.end(); ++it)
+    std::string strAddress;
+    while (dbfile >> strAddress)
     {
-        dbfile << it->ToString() << std::endl;
+        CBitcoinAddress addr(strAddress);
+
+        if (addr.IsValid())
+        {
+            AddCertifiedAddress(addr.Get());
+        }
     }
 
     dbfile.close();
+    PublishSnapshot();
 
     return true;
 }
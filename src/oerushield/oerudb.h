@@ -5,39 +5,142 @@
 #ifndef BITCOIN_OERUSHIELD_OERUDB_H
 #define BITCOIN_OERUSHIELD_OERUDB_H
 
+#include "crypto/common.h"
+#include "dbwrapper.h"
+#include "pubkey.h"
+#include "script/standard.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
 
-class CBitcoinAddress;
+#include <boost/filesystem/path.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_set.hpp>
+
+//! LevelDB cache for the OeruShield database; it holds little more than the certified key IDs
+static const size_t OERUDB_CACHE_SIZE = 1 << 20;
+
+//! How an address is certified, as the first half of its COeruCertifiedKey
+enum OeruCertifiedType
+{
+    OERU_CERTIFIED_KEY = 1,    //!< as a pay-to-pubkey-hash address
+    OERU_CERTIFIED_SCRIPT = 2, //!< as a pay-to-script-hash address
+};
+
+//! A certified address as stored: its OeruCertifiedType and hash160
+typedef std::pair<char, CKeyID> COeruCertifiedKey;
+
+struct CertifiedKeyHasher
+{
+    // Key IDs are hash160s and only enter the set through master-signed
+    // transactions, so 64 bits of the key itself make a fine hash
+    size_t operator()(const COeruCertifiedKey& key) const { return ReadLE64(key.second.begin()) + key.first; }
+};
+
+typedef boost::unordered_set<COeruCertifiedKey, CertifiedKeyHasher> CertifiedSet;
+
+/** Sorted, immutable copy of the certified addresses for readers that don't hold cs_main */
+typedef std::shared_ptr<const std::vector<CTxDestination> > CertifiedSnapshotRef;
+
+/** Certification changes made by one block, so they can be undone on disconnect */
+class COeruBlockUndo
+{
+public:
+    //! Whether each changed address was certified before the change, in the order of the changes
+    std::vector<std::pair<COeruCertifiedKey, bool> > vPrevState;
+
+    ADD_SERIALIZE_METHODS;
 
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(vPrevState);
+    }
+};
+
+/**
+ * Certified miner addresses, keyed by address type and hash160.
+ * The set is held in memory; changes and per-block undo records are buffered
+ * and written to LevelDB in one batch by Flush(), which FlushStateToDisk calls with the coins flush.
+ * With a background coins flush the batch is prepared with the coins
+ * snapshot and written by WritePrepared() once the coins are on disk.
+ *
+ * All methods except GetCertifiedSnapshot() and WritePrepared() require cs_main. Writers publish
+ * a new snapshot with PublishSnapshot() once a block's changes are applied;
+ * readers load it atomically and never block validation.
+ */
 class COeruDB
 {
 public:
-    static void InitOeruDB(std::string oeruDBPath, bool reindex);
+    /**
+     * Open the database at path (wiping it on reindex) and, if it has never
+     * been written, import the text file used by older versions.
+     */
+    static void InitOeruDB(const boost::filesystem::path& path, const boost::filesystem::path& legacyPath, bool reindex);
+
+    /**
+     * The key an address is stored under. Script addresses can never
+     * identify a block but still count towards activation, so they are kept too.
+     */
+    static bool GetDestinationKey(const CTxDestination& dest, COeruCertifiedKey& key);
 
-    COeruDB(std::string oeruDBFileName);
+    COeruDB(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
-    bool ShouldReindex(int ChainHeight);
-    void AddCertifiedAddress(CBitcoinAddress addr);
+    bool ShouldReindex(int ChainHeight, const uint256& hashBestChain = uint256()) const;
+    void AddCertifiedAddress(const CTxDestination& dest, COeruBlockUndo* pundo = NULL);
     void ClearCertifiedAddresses();
-    void GetCertifiedAddresses(std::vector<CBitcoinAddress> &vAddresses) const;
-    bool IsAddressCertified(CBitcoinAddress addr) const;
+    void GetCertifiedAddresses(std::vector<CTxDestination> &vAddresses) const;
+    bool IsAddressCertified(const CTxDestination& dest) const;
     int NumCertifiedAddresses() const;
-    void RemoveCertifiedAddress(CBitcoinAddress addr);
+    void RemoveCertifiedAddress(const CTxDestination& dest, COeruBlockUndo* pundo = NULL);
 
-    // Reads the data from the file
-    bool ReadFile();
+    /** Make the current certified set visible to GetCertifiedSnapshot(), if it changed */
+    void PublishSnapshot();
+    /** Last published certified set; safe to call without cs_main */
+    CertifiedSnapshotRef GetCertifiedSnapshot() const;
 
-    // Writes the data to the file
-    bool WriteFile();
+    /** Store the undo record of a connected block, if it changed anything */
+    void WriteBlockUndo(const uint256& hashBlock, const COeruBlockUndo& undo);
+    /** Revert the changes of a disconnected block. Returns false if it has no undo record. */
+    bool UndoBlock(const uint256& hashBlock);
+
+    /** Block the flushed state corresponds to, or null if never flushed */
+    uint256 GetBestBlock() const;
+    /** Atomically write all buffered changes, recording hashBlock as the best block */
+    bool Flush(const uint256& hashBlock);
+    /** Move all buffered changes into a batch recording hashBlock as the best block */
+    void PrepareFlush(const uint256& hashBlock);
+    /** Write the batch of PrepareFlush(), if any. Safe to call without cs_main. */
+    bool WritePrepared();
+
+    /** Import a certified address list in the text format of older versions */
+    bool ImportLegacyFile(const std::string& strFileName);
 
 private:
-    // Use a set to guarantee unique entries
-    std::set<CBitcoinAddress> vOeruCertifiedAddresses;
+    CDBWrapper db;
+
+    CertifiedSet setCertified;
+
+    CertifiedSnapshotRef snapshot;
+    bool fSnapshotStale;
+
+    //! Buffered until Flush(): changed keys, new undo records and undo records to erase
+    std::map<COeruCertifiedKey, bool> mapDirty;
+    std::map<uint256, COeruBlockUndo> mapUndoPending;
+    std::set<uint256> setUndoErased;
+
+    //! Prepared for WritePrepared(), with the undo records in it for UndoBlock()
+    mutable boost::mutex csPrepared;
+    std::unique_ptr<CDBBatch> batchPrepared;
+    std::map<uint256, COeruBlockUndo> mapUndoPrepared;
+    uint256 hashPrepared;
+    uint256 hashBestBlock;
 
-    // Database path
-    std::string strOeruDBFileName;
+    void SetCertified(const COeruCertifiedKey& key, bool fCertified, COeruBlockUndo* pundo);
 };
 
 extern COeruDB* poeruDBMain;
@@ -34,18 +34,20 @@ bool COeruShield::AcceptBlock(const CBlock *pblock, const CBlockIndex *pindex) c
         return true;
 
     int blocksSinceLastCertified = GetBlocksSinceLastCertified(pblock, pindex);
-    LogPrint("OeruShield", "OERU @ Block %d:\n\t- Active: %d\n\t- Identified: %d\n\t- Certified: %d\n\t- Last certified: %d\n",
-            pindex->nHeight,
-            IsActive(),
-            IsBlockIdentified(pblock, pindex->nHeight),
-            IsBlockCertified(pblock, pindex->nHeight),
-            blocksSinceLastCertified);
+    if (LogAcceptCategory("OeruShield")) {
+        LogPrint("OeruShield", "OERU @ Block %d:\n\t- Active: %d\n\t- Identified: %d\n\t- Certified: %d\n\t- Last certified: %d\n",
+                pindex->nHeight,
+                IsActive(),
+                IsBlockIdentified(pblock, pindex->nHeight),
+                IsBlockCertified(pblock, pindex->nHeight),
+                blocksSinceLastCertified);
+    }
 
     return (blocksSinceLastCertified >= 0 &&
             blocksSinceLastCertified <  Params().OeruShieldMaxBlocksSinceLastCertified());
 }
 
-bool COeruShield::CheckMasterTx(const CTransaction tx, const int nHeight, const bool revert) const
+bool COeruShield::CheckMasterTx(const CTransaction tx, const int nHeight, const bool revert, COeruBlockUndo* pundo) const
 {
     if (tx.IsCoinBase())
         return false;
@@ -104,11 +106,9 @@ bool COeruShield::CheckMasterTx(const CTransaction tx, const int nHeight, const
         enable = !enable;
 
     if (enable)
-        oeruDB->AddCertifiedAddress(miner);
+        oeruDB->AddCertifiedAddress(miner.Get(), pundo);
     else
-        oeruDB->RemoveCertifiedAddress(miner);
-
-    oeruDB->WriteFile();
+        oeruDB->RemoveCertifiedAddress(miner.Get(), pundo);
 
     return true;
 }
@@ -130,23 +130,19 @@ bool COeruShield::FindOeruVOut(const CTransaction& coinbaseTx, COeruTxOut& oeruT
     return false;
 }
 
-int COeruShield::GetBlocksSinceLastCertified(const CBlock *pblock, const CBlockIndex *pindex, int i) const
+int COeruShield::GetBlocksSinceLastCertified(const CBlock *pblock, const CBlockIndex *pindex) const
 {
+    int i = 0;
     // Pretend that the genesis block was certified
-    if (pindex == NULL || pindex->pprev == NULL)
-        return i;
-
-    if (IsBlockCertified(pblock, pindex->nHeight))
-        return i;
-
-    // Don't read further back than we need to
-    if (i > Params().OeruShieldMaxBlocksSinceLastCertified())
-        return -1;
+    for (; pindex != NULL && pindex->pprev != NULL; pindex = pindex->pprev, i++) {
+        if (IsIndexCertified(i == 0 ? pblock : NULL, pindex))
+            return i;
 
-    CBlock prevblock;
-    ReadBlockFromDisk(prevblock, pindex->pprev, Params().GetConsensus());
-
-    return GetBlocksSinceLastCertified(&prevblock, pindex->pprev, i + 1);
+        // Don't read further back than we need to
+        if (i > Params().OeruShieldMaxBlocksSinceLastCertified())
+            return -1;
+    }
+    return i;
 }
 
 bool COeruShield::GetCoinbaseAddress(const CTransaction& coinbaseTx, CBitcoinAddress& coinbaseAddress) const
@@ -192,7 +188,7 @@ bool COeruShield::IsActive() const
     return oeruDB->NumCertifiedAddresses() >= minAddresses;
 }
 
-bool COeruShield::IsBlockIdentified(const CBlock *pblock, const int nHeight) const
+bool COeruShield::GetIdentifiedMiner(const CBlock *pblock, const int nHeight, CKeyID& minerKey) const
 {
     CTransaction coinbaseTx;
     if ( ! GetCoinbaseTx(pblock, coinbaseTx))
@@ -224,7 +220,8 @@ bool COeruShield::IsBlockIdentified(const CBlock *pblock, const int nHeight) con
     if (signatureChecker.VerifySignature(strMessage, vchSig, coinbaseAddress)) {
         LogPrint("OeruShield", "%s: Valid OERU signature on block %d\n",
                 __FUNCTION__, nHeight);
-        return true;
+        // VerifySignature only accepts key addresses
+        return coinbaseAddress.GetKeyID(minerKey);
     } else {
         LogPrint("OeruShield", "%s: No valid OERU signature on block %d\n",
                 __FUNCTION__, nHeight);
@@ -232,20 +229,53 @@ bool COeruShield::IsBlockIdentified(const CBlock *pblock, const int nHeight) con
     }
 }
 
+void COeruShield::IndexBlock(const CBlock *pblock, CBlockIndex *pindex) const
+{
+    CKeyID minerKey;
+    pindex->nStatus &= ~BLOCK_OERU_IDENTIFIED;
+    if (GetIdentifiedMiner(pblock, pindex->nHeight, minerKey) && pblock->vtx[0].vout.size() >= 2) {
+        pindex->hashOeruMiner = minerKey;
+        pindex->nStatus |= BLOCK_OERU_IDENTIFIED;
+    }
+    pindex->nStatus |= BLOCK_OERU_CHECKED;
+}
+
+bool COeruShield::IsBlockIdentified(const CBlock *pblock, const int nHeight) const
+{
+    CKeyID minerKey;
+    return GetIdentifiedMiner(pblock, nHeight, minerKey);
+}
+
 bool COeruShield::IsBlockCertified(const CBlock *pblock, const int nHeight) const
 {
-    if ( ! IsBlockIdentified(pblock, nHeight))
+    CKeyID minerKey;
+    if ( ! GetIdentifiedMiner(pblock, nHeight, minerKey))
         return false;
 
-    CTransaction coinbaseTx;
-    if ( ! GetCoinbaseTx(pblock, coinbaseTx) || coinbaseTx.vout.size() < 2)
+    if (pblock->vtx[0].vout.size() < 2)
         return false;
 
-    CBitcoinAddress coinbaseAddress;
-    if ( ! GetCoinbaseAddress(coinbaseTx, coinbaseAddress))
-        return false;
+    // Only a key address can sign the coinbase, so only its certification counts
+    return oeruDB->IsAddressCertified(CTxDestination(minerKey));
+}
+
+bool COeruShield::IsIndexCertified(const CBlock *pblock, const CBlockIndex *pindex) const
+{
+    // Certification is checked against the current OeruDB state, only the
+    // identification of the block is taken from the index
+    if (pindex->nStatus & BLOCK_OERU_CHECKED) {
+        if (!(pindex->nStatus & BLOCK_OERU_IDENTIFIED))
+            return false;
+        return oeruDB->IsAddressCertified(CTxDestination(CKeyID(pindex->hashOeruMiner)));
+    }
 
-    return oeruDB->IsAddressCertified(coinbaseAddress);
+    // Entries connected before the index tracked identification
+    CBlock block;
+    if (pblock == NULL) {
+        ReadBlockFromDisk(block, pindex, Params().GetConsensus());
+        pblock = &block;
+    }
+    return IsBlockCertified(pblock, pindex->nHeight);
 }
 
 bool COeruShield::IsMasterKey(std::vector<unsigned char> addrHash) const
@@ -13,6 +13,7 @@
 
 class CBlock;
 class CBlockIndex;
+class COeruBlockUndo;
 class COeruDB;
 class COeruTxOut;
 
@@ -28,9 +29,25 @@ public:
 
     bool AcceptBlock(const CBlock *pblock, const CBlockIndex *pindex) const;
 
-    bool CheckMasterTx(const CTransaction tx, const int nHeight, const bool revert = false) const;
+    /**
+     * Apply tx to the OeruDB if it is a valid master transaction, recording
+     * the change in pundo. With revert, the enable flag is inverted instead;
+     * that is only used for blocks connected before undo records existed.
+     */
+    bool CheckMasterTx(const CTransaction tx, const int nHeight, const bool revert = false, COeruBlockUndo* pundo = NULL) const;
 
-    int GetBlocksSinceLastCertified(const CBlock *pblock, const CBlockIndex *pindex, const int i = 0) const;
+    /**
+     * Walk back from pindex (whose block is pblock) to the last certified
+     * block, using the identification stored in the block index. Blocks are
+     * only read from disk for entries that IndexBlock() has not seen.
+     */
+    int GetBlocksSinceLastCertified(const CBlock *pblock, const CBlockIndex *pindex) const;
+
+    /**
+     * Store in pindex whether pblock is identified, and by which miner, so
+     * later certification checks need neither the block nor its signature.
+     */
+    void IndexBlock(const CBlock *pblock, CBlockIndex *pindex) const;
 
     bool IsActive() const;
 
@@ -44,6 +61,8 @@ private:
     bool GetCoinbaseAddress(const CTransaction& coinbaseTx, CBitcoinAddress& coinbaseAddress) const;
     bool GetCoinbaseTx(const CBlock *pblock, CTransaction& coinbaseTx) const;
     bool GetDestinationAddress(const CTxOut txOut, CBitcoinAddress& destination) const;
+    bool GetIdentifiedMiner(const CBlock *pblock, const int nHeight, CKeyID& minerKey) const;
+    bool IsIndexCertified(const CBlock *pblock, const CBlockIndex *pindex) const;
 
     COeruDB* oeruDB = nullptr;
 };
@@ -4,33 +4,52 @@
 
 #include "oerushield/oerusignal.h"
 
+#include <algorithm>
 #include <string>
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
 #include <event2/event.h>
 #include <event2/http.h>
 #include <event2/http_compat.h>
 #include <event2/buffer.h>
 #include <event2/keyvalq_struct.h>
 
+#include "netbase.h"
 #include "util.h"
+#include "utiltime.h"
+
+//! How often a request in flight checks for shutdown
+static const int OERUSIGNAL_INTERRUPT_CHECK_MS = 200;
 
 /** Reply structure for request_done to fill in */
 struct HTTPReply
 {
+    struct event_base *base;
     int status;
-    std::string body;
 };
 
 COeruSignal *poeruSignalMain = nullptr;
 
 void COeruSignal::InitOeruSignal(std::string strUAComment)
 {
-    poeruSignalMain = new COeruSignal(strUAComment);
+    poeruSignalMain = new COeruSignal(strUAComment,
+        GetArg("-oerusignalendpoint", DEFAULT_OERUSIGNAL_ENDPOINT),
+        GetArg("-oerusignaltimeout", DEFAULT_OERUSIGNAL_TIMEOUT),
+        GetArg("-oerusignalqueue", DEFAULT_OERUSIGNAL_QUEUE),
+        GetArg("-oerusignalretries", DEFAULT_OERUSIGNAL_RETRIES));
 }
 
-COeruSignal::COeruSignal(std::string strUAComment)
+COeruSignal::COeruSignal(std::string strUAComment, const std::string& strEndpoint, int nTimeout,
+                         unsigned int nMaxQueue, int nMaxRetries) :
+    port(80),
+    nTimeout(std::max(nTimeout, 1)),
+    nMaxQueue(std::max(nMaxQueue, 1u)),
+    nMaxRetries(std::max(nMaxRetries, 0))
 {
     this->strUAComment = strUAComment;
+    SplitHostPort(strEndpoint, this->port, this->hostname);
 }
 
 std::string COeruSignal::CreateSignalPath(int nBlockHeight)
@@ -45,7 +64,17 @@ std::string COeruSignal::CreateSignalPath(int nBlockHeight)
 
 static void http_request_done(struct evhttp_request *req, void *ctx)
 {
-    // Do nothing
+    HTTPReply *reply = static_cast<HTTPReply*>(ctx);
+
+    // req is NULL on timeouts and connection errors
+    reply->status = req ? evhttp_request_get_response_code(req) : 0;
+    event_base_loopbreak(reply->base);
+}
+
+static void http_interrupt_check(evutil_socket_t, short, void *ctx)
+{
+    if (boost::this_thread::interruption_requested())
+        event_base_loopbreak(static_cast<struct event_base*>(ctx));
 }
 
 bool COeruSignal::ExecuteOeruSignal(int nBlockHeight)
@@ -70,53 +99,137 @@ bool COeruSignal::ExecuteOeruSignal(int nBlockHeight)
 
         this->tLastRequestTime = now;
 
-        struct event_base *base = event_base_new();
-        if (!base) {
-            LogPrint("OeruSignal", "cannot create event_base\n");
-            return false;
-        }
-
-        int port = 80;
-        struct evhttp_connection *evcon = evhttp_connection_base_new(base, NULL, this->hostname.c_str(), port);
+        return QueueSignal(strPath);
+    } else {
+        return false;
+    }
+}
 
-        if (evcon == NULL) {
-            LogPrint("OeruSignal", "create connection failed\n");
+bool COeruSignal::QueueSignal(const std::string& strPath)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (queue.size() >= nMaxQueue) {
+            stats.nDropped++;
+            LogPrint("OeruSignal", "Signal queue full, dropping signal to path %s\n", strPath);
             return false;
         }
+        queue.push_back(strPath);
+        stats.nQueued++;
+    }
+    cond.notify_one();
+    return true;
+}
 
-        HTTPReply response;
-        struct evhttp_request *req = evhttp_request_new(http_request_done, (void*)&response);
+void COeruSignal::StartDispatcher(boost::thread_group& threadGroup)
+{
+    threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "oerusignal",
+                                          boost::function<void()>(boost::bind(&COeruSignal::ThreadDispatch, this))));
+}
 
-        if (req == NULL) {
-            LogPrint("OeruSignal", "create request failed\n");
-            return false;
+void COeruSignal::ThreadDispatch()
+{
+    while (true) {
+        std::string strPath;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queue.empty())
+                cond.wait(lock);
+            strPath = queue.front();
+            queue.pop_front();
         }
 
-        struct evkeyvalq *output_headers = evhttp_request_get_output_headers(req);
-        assert(output_headers);
-
-        evhttp_add_header(output_headers, "Host", this->hostname.c_str());
+        for (int nAttempt = 0; ; nAttempt++) {
+            int64_t nStart = GetTimeMillis();
+            int nStatus = SendRequest(strPath);
+            boost::this_thread::interruption_point();
+            int64_t nLatency = GetTimeMillis() - nStart;
+            bool fSuccess = nStatus >= 200 && nStatus < 300;
+
+            LogPrint("OeruSignal", "Signal to path %s: status %d after %dms (attempt %d)\n",
+                strPath, nStatus, nLatency, nAttempt + 1);
+
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                stats.nLastLatencyMs = nLatency;
+                stats.nLastStatus = nStatus;
+                if (fSuccess)
+                    stats.nSent++;
+                else if (nAttempt >= nMaxRetries)
+                    stats.nFailed++;
+                else
+                    stats.nRetries++;
+            }
+
+            if (fSuccess || nAttempt >= nMaxRetries)
+                break;
+            MilliSleep(OERUSIGNAL_RETRY_BASE_MS << std::min(nAttempt, 10));
+        }
+    }
+}
 
-        LogPrint("OeruSignal", "Preparing to send signal to path %s\n",
-            strPath.c_str());
+int COeruSignal::SendRequest(const std::string& strPath)
+{
+    struct event_base *base = event_base_new();
+    if (!base) {
+        LogPrint("OeruSignal", "cannot create event_base\n");
+        return 0;
+    }
 
-        int r = evhttp_make_request(evcon, req, EVHTTP_REQ_GET, strPath.c_str());
-        if (r != 0) {
-            evhttp_connection_free(evcon);
-            event_base_free(base);
+    struct evhttp_connection *evcon = evhttp_connection_base_new(base, NULL, this->hostname.c_str(), this->port);
+    if (evcon == NULL) {
+        LogPrint("OeruSignal", "create connection failed\n");
+        event_base_free(base);
+        return 0;
+    }
+    evhttp_connection_set_timeout(evcon, this->nTimeout);
+
+    HTTPReply response;
+    response.base = base;
+    response.status = 0;
+    struct evhttp_request *req = evhttp_request_new(http_request_done, (void*)&response);
+    if (req == NULL) {
+        LogPrint("OeruSignal", "create request failed\n");
+        evhttp_connection_free(evcon);
+        event_base_free(base);
+        return 0;
+    }
 
-            LogPrint("OeruSignal", "send request failed\n");
-            return false;
-        }
+    struct evkeyvalq *output_headers = evhttp_request_get_output_headers(req);
+    assert(output_headers);
 
-        LogPrint("OeruSignal", "Sent uasignal successfully!\n");
+    evhttp_add_header(output_headers, "Host", this->hostname.c_str());
 
-        event_base_dispatch(base);
+    int r = evhttp_make_request(evcon, req, EVHTTP_REQ_GET, strPath.c_str());
+    if (r != 0) {
+        // evhttp_make_request frees the request on failure
         evhttp_connection_free(evcon);
         event_base_free(base);
 
-        return true;
-    } else {
-        return false;
+        LogPrint("OeruSignal", "send request failed\n");
+        return 0;
     }
+
+    // Wake up regularly so shutdown doesn't wait for the request timeout
+    struct event *interruptCheck = event_new(base, -1, EV_PERSIST, http_interrupt_check, base);
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = OERUSIGNAL_INTERRUPT_CHECK_MS * 1000;
+    event_add(interruptCheck, &tv);
+
+    event_base_dispatch(base);
+
+    event_free(interruptCheck);
+    evhttp_connection_free(evcon);
+    event_base_free(base);
+
+    return response.status;
+}
+
+COeruSignalStats COeruSignal::GetStats() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    COeruSignalStats result = stats;
+    result.nQueueSize = queue.size();
+    return result;
 }
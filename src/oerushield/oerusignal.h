@@ -6,22 +6,86 @@
 #define BITCOIN_OERUSHIELD_OERUSIGNAL_H
 
 #include <ctime>
+#include <deque>
+#include <stdint.h>
 #include <string>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace boost {
+    class thread_group;
+} // namespace boost
+
+static const char* const DEFAULT_OERUSIGNAL_ENDPOINT = "uasignal.e-gulden.org:80";
+//! Seconds to wait for the signal endpoint to connect and reply
+static const int DEFAULT_OERUSIGNAL_TIMEOUT = 10;
+//! Signals waiting to be sent; new signals are dropped when full
+static const unsigned int DEFAULT_OERUSIGNAL_QUEUE = 16;
+//! Additional attempts after a failed request, with doubling delays
+static const int DEFAULT_OERUSIGNAL_RETRIES = 3;
+static const int64_t OERUSIGNAL_RETRY_BASE_MS = 1000;
+
+struct COeruSignalStats
+{
+    uint64_t nQueued;
+    uint64_t nDropped;
+    uint64_t nSent;
+    uint64_t nFailed;
+    uint64_t nRetries;
+    size_t nQueueSize;
+    int64_t nLastLatencyMs;
+    int nLastStatus;
+
+    COeruSignalStats() : nQueued(0), nDropped(0), nSent(0), nFailed(0), nRetries(0),
+                         nQueueSize(0), nLastLatencyMs(0), nLastStatus(0) {}
+};
+
+/**
+ * Sends usage signals to the OeruShield signal endpoint. Signals are decided
+ * on while accepting blocks but only queued there; a dedicated thread sends
+ * them, so a slow or unreachable endpoint never holds up validation.
+ */
 class COeruSignal
 {
 public:
     static void InitOeruSignal(std::string strUAComment);
 
-    COeruSignal(std::string strUAComment);
+    COeruSignal(std::string strUAComment, const std::string& strEndpoint = DEFAULT_OERUSIGNAL_ENDPOINT,
+                int nTimeout = DEFAULT_OERUSIGNAL_TIMEOUT, unsigned int nMaxQueue = DEFAULT_OERUSIGNAL_QUEUE,
+                int nMaxRetries = DEFAULT_OERUSIGNAL_RETRIES);
 
     std::string CreateSignalPath(int nBlockHeight);
+    /** Queue a signal for this block if one is due. Cheap; called with cs_main held. */
     bool ExecuteOeruSignal(int nBlockHeight);
+    /** Queue a request for strPath. Returns false if the backlog is full. */
+    bool QueueSignal(const std::string& strPath);
+
+    /** Start the thread sending queued signals */
+    void StartDispatcher(boost::thread_group& threadGroup);
+    /** Thread body: send queued signals until interrupted */
+    void ThreadDispatch();
+
+    COeruSignalStats GetStats() const;
+
 private:
-    std::string hostname = "uasignal.e-gulden.org";
+    std::string hostname;
+    int port;
+    int nTimeout;
+    unsigned int nMaxQueue;
+    int nMaxRetries;
+
     std::string strUAComment;
     int nNextOeruSignalExecutionHeight = 0;
     std::time_t tLastRequestTime = 0;
+
+    mutable boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<std::string> queue;
+    COeruSignalStats stats;
+
+    /** Send one request and wait for the reply. Returns the HTTP status, or 0 on failure. */
+    int SendRequest(const std::string& strPath);
 };
 
 extern COeruSignal* poeruSignalMain;
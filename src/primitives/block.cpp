@@ -22,10 +22,45 @@ uint256 CBlockHeader::GetHash() const
 uint256 CBlockHeader::GetPoWHash() const
 {
     uint256 thash;
+    if (GetCachedPoWHash(thash))
+        return thash;
     scrypt_1024_1_1_256(BEGIN(nVersion), BEGIN(thash));
+    SetCachedPoWHash(thash);
     return thash;
 }
 
+uint256 CBlockHeader::GetPoWHash(CScryptContext& context) const
+{
+    uint256 thash;
+    if (GetCachedPoWHash(thash))
+        return thash;
+    context.Hash(BEGIN(nVersion), BEGIN(thash));
+    SetCachedPoWHash(thash);
+    return thash;
+}
+
+void GetPoWHashes(const CBlockHeader* pheaders, size_t nCount, uint256* phashes)
+{
+    // Only headers without a memoized hash are hashed, in place as in GetPoWHash()
+    std::vector<size_t> vMissing;
+    std::vector<char> vInputs;
+    for (size_t i = 0; i < nCount; i++) {
+        if (pheaders[i].GetCachedPoWHash(phashes[i]))
+            continue;
+        vMissing.push_back(i);
+        vInputs.insert(vInputs.end(), BEGIN(pheaders[i].nVersion), BEGIN(pheaders[i].nVersion) + 80);
+    }
+    if (vMissing.empty())
+        return;
+
+    std::vector<uint256> vHashes(vMissing.size());
+    scrypt_1024_1_1_256_sp_multi(&vInputs[0], BEGIN(vHashes[0]), vMissing.size());
+    for (size_t j = 0; j < vMissing.size(); j++) {
+        phashes[vMissing[j]] = vHashes[j];
+        pheaders[vMissing[j]].SetCachedPoWHash(vHashes[j]);
+    }
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
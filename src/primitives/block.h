@@ -10,6 +10,11 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <atomic>
+#include <string.h>
+
+class CScryptContext;
+
 /** Nodes collect new transactions into a block, hash them into a hash tree,
  * and scan through nonce values to make the block's hash satisfy proof-of-work
  * requirements.  When they solve the proof-of-work, they broadcast the block
@@ -28,11 +33,47 @@ public:
     uint32_t nBits;
     uint32_t nNonce;
 
-    CBlockHeader()
+private:
+    // memory only: memoized GetPoWHash() and the 80 header bytes it belongs to,
+    // so any change to the header fields invalidates it. The memo is filled
+    // from const accessors, possibly on a header shared between threads, so
+    // nPoWHashState lets a single writer in and publishes the hash once it is
+    // complete. Changing the fields still needs exclusive access.
+    enum { POWHASH_EMPTY, POWHASH_WRITING, POWHASH_READY };
+    mutable std::atomic<int> nPoWHashState;
+    mutable uint256 hashPoWCached;
+    mutable char vchPoWHashKey[80];
+
+public:
+    CBlockHeader() : nPoWHashState(POWHASH_EMPTY)
     {
         SetNull();
     }
 
+    CBlockHeader(const CBlockHeader& other) : nPoWHashState(POWHASH_EMPTY)
+    {
+        *this = other;
+    }
+
+    CBlockHeader& operator=(const CBlockHeader& other)
+    {
+        nVersion = other.nVersion;
+        hashPrevBlock = other.hashPrevBlock;
+        hashMerkleRoot = other.hashMerkleRoot;
+        nTime = other.nTime;
+        nBits = other.nBits;
+        nNonce = other.nNonce;
+        uint256 hash;
+        if (other.GetCachedPoWHash(hash)) {
+            memcpy(vchPoWHashKey, &nVersion, sizeof(vchPoWHashKey));
+            hashPoWCached = hash;
+            nPoWHashState.store(POWHASH_READY, std::memory_order_release);
+        } else {
+            nPoWHashState.store(POWHASH_EMPTY, std::memory_order_relaxed);
+        }
+        return *this;
+    }
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -53,6 +94,7 @@ public:
         nTime = 0;
         nBits = 0;
         nNonce = 0;
+        nPoWHashState.store(POWHASH_EMPTY, std::memory_order_relaxed);
     }
 
     bool IsNull() const
@@ -62,7 +104,39 @@ public:
 
     uint256 GetHash() const;
 
+    /** Scrypt proof-of-work hash, computed at most once while the header is unchanged */
     uint256 GetPoWHash() const;
+    /** Same as GetPoWHash(), using the caller's scrypt scratchpad */
+    uint256 GetPoWHash(CScryptContext& context) const;
+
+    /** Get the memoized PoW hash, if it is still valid for the current fields */
+    bool GetCachedPoWHash(uint256& hash) const
+    {
+        if (nPoWHashState.load(std::memory_order_acquire) != POWHASH_READY ||
+            memcmp(vchPoWHashKey, &nVersion, sizeof(vchPoWHashKey)) != 0)
+            return false;
+        hash = hashPoWCached;
+        return true;
+    }
+
+    /**
+     * Remember hash as the PoW hash of the current fields, e.g. when it is
+     * known from the block index. Does nothing if the memo is already valid
+     * or another thread is filling it.
+     */
+    void SetCachedPoWHash(const uint256& hash) const
+    {
+        int nState = nPoWHashState.load(std::memory_order_acquire);
+        if (nState == POWHASH_WRITING)
+            return;
+        if (nState == POWHASH_READY && memcmp(vchPoWHashKey, &nVersion, sizeof(vchPoWHashKey)) == 0)
+            return;
+        if (!nPoWHashState.compare_exchange_strong(nState, POWHASH_WRITING, std::memory_order_acquire))
+            return;
+        memcpy(vchPoWHashKey, &nVersion, sizeof(vchPoWHashKey));
+        hashPoWCached = hash;
+        nPoWHashState.store(POWHASH_READY, std::memory_order_release);
+    }
 
     int64_t GetBlockTime() const
     {
@@ -71,6 +145,14 @@ public:
 };
 
 
+/**
+ * Compute the scrypt proof-of-work hashes of nCount headers at once, using the
+ * multi-lane scrypt kernels. phashes must have room for nCount entries.
+ * Memoized hashes are reused, and the others are memoized on the headers.
+ */
+void GetPoWHashes(const CBlockHeader* pheaders, size_t nCount, uint256* phashes);
+
+
 class CBlock : public CBlockHeader
 {
 public:
@@ -115,6 +197,9 @@ public:
         block.nTime          = nTime;
         block.nBits          = nBits;
         block.nNonce         = nNonce;
+        uint256 hashPoW;
+        if (GetCachedPoWHash(hashPoW))
+            block.SetCachedPoWHash(hashPoW);
         return block;
     }
 
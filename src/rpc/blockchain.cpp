@@ -21,6 +21,7 @@
 #include "hash.h"
 #include "oerushield/oerudb.h"
 #include "oerushield/oerushield.h"
+#include "oerushield/oerusignal.h"
 
 #include <stdint.h>
 
@@ -261,19 +262,57 @@ UniValue getoerucertifiedaddresses(const UniValue &params, bool fHelp)
             + HelpExampleRpc("getoerucertifiedaddresses", "")
         );
 
-    std::vector<CBitcoinAddress> addresses;
-    poeruDBMain->GetCertifiedAddresses(addresses);
+    CertifiedSnapshotRef addresses = poeruDBMain->GetCertifiedSnapshot();
 
     UniValue obj(UniValue::VARR);
 
-    BOOST_FOREACH(const CBitcoinAddress& a, addresses)
+    BOOST_FOREACH(const CTxDestination& dest, *addresses)
     {
-        obj.push_back(a.ToString());
+        obj.push_back(CBitcoinAddress(dest).ToString());
     }
 
     return obj;
 }
 
+UniValue getoerusignalinfo(const UniValue &params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getoerusignalinfo\n"
+            "Returns statistics of the OeruShield usage signal dispatcher, or null if signalling is disabled (no -uacomment).\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"queued\": n,           (numeric) signals queued since startup\n"
+            "  \"dropped\": n,          (numeric) signals dropped because the queue was full\n"
+            "  \"sent\": n,             (numeric) signals the endpoint accepted\n"
+            "  \"failed\": n,           (numeric) signals given up on after all retries\n"
+            "  \"retries\": n,          (numeric) failed attempts that were retried\n"
+            "  \"queuesize\": n,        (numeric) signals currently waiting to be sent\n"
+            "  \"lastlatency\": n,      (numeric) duration of the last attempt in milliseconds\n"
+            "  \"laststatus\": n        (numeric) HTTP status of the last attempt, 0 if it failed to complete\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getoerusignalinfo", "")
+            + HelpExampleRpc("getoerusignalinfo", "")
+        );
+
+    if (poeruSignalMain == nullptr)
+        return NullUniValue;
+
+    COeruSignalStats stats = poeruSignalMain->GetStats();
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("queued", stats.nQueued));
+    obj.push_back(Pair("dropped", stats.nDropped));
+    obj.push_back(Pair("sent", stats.nSent));
+    obj.push_back(Pair("failed", stats.nFailed));
+    obj.push_back(Pair("retries", stats.nRetries));
+    obj.push_back(Pair("queuesize", (uint64_t)stats.nQueueSize));
+    obj.push_back(Pair("lastlatency", stats.nLastLatencyMs));
+    obj.push_back(Pair("laststatus", stats.nLastStatus));
+    return obj;
+}
+
 UniValue mempoolToJSON(bool fVerbose = false)
 {
     if (fVerbose)
@@ -1237,6 +1276,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolentry",           &getmempoolentry,           true  },
     { "blockchain",         "getmempoolinfo",            &getmempoolinfo,            true  },
     { "blockchain",         "getoerucertifiedaddresses", &getoerucertifiedaddresses, true  },
+    { "blockchain",         "getoerusignalinfo",         &getoerusignalinfo,         true  },
     { "blockchain",         "getrawmempool",             &getrawmempool,             true  },
     { "blockchain",         "gettxout",                  &gettxout,                  true  },
     { "blockchain",         "gettxoutsetinfo",           &gettxoutsetinfo,           true  },
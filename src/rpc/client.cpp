@@ -29,8 +29,10 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getaddednodeinfo", 0 },
     { "generate", 0 },
     { "generate", 1 },
+    { "generate", 2 },
     { "generatetoaddress", 0 },
     { "generatetoaddress", 2 },
+    { "generatetoaddress", 3 },
     { "getnetworkhashps", 0 },
     { "getnetworkhashps", 1 },
     { "sendtoaddress", 1 },
@@ -95,7 +95,12 @@ UniValue getnetworkhashps(const UniValue& params, bool fHelp)
     return GetNetworkHashPS(params.size() > 0 ? params[0].get_int() : 120, params.size() > 1 ? params[1].get_int() : -1);
 }
 
-UniValue generateBlocks(boost::shared_ptr<CReserveScript> coinbaseScript, int nGenerate, uint64_t nMaxTries, bool keepScript)
+static const int MAX_GENERATE_THREADS = 64;
+
+//! Hash rate of the last generate/generatetoaddress call, reported by getmininginfo
+static double dGenerateHashesPerSec = 0;
+
+UniValue generateBlocks(boost::shared_ptr<CReserveScript> coinbaseScript, int nGenerate, uint64_t nMaxTries, bool keepScript, int nThreads)
 {
     static const int nInnerLoopCount = 0x10000;
     int nHeightStart = 0;
@@ -110,24 +115,32 @@ UniValue generateBlocks(boost::shared_ptr<CReserveScript> coinbaseScript, int nG
     }
     unsigned int nExtraNonce = 0;
     UniValue blockHashes(UniValue::VARR);
+    uint64_t nHashes = 0;
+    int64_t nStart = GetTimeMicros();
     while (nHeight < nHeightEnd)
     {
         std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(Params()).CreateNewBlock(coinbaseScript->reserveScript));
         if (!pblocktemplate.get())
             throw JSONRPCError(RPC_INTERNAL_ERROR, "Couldn't create new block");
         CBlock *pblock = &pblocktemplate->block;
-        {
-            LOCK(cs_main);
-            IncrementExtraNonce(pblock, chainActive.Tip(), nExtraNonce);
-        }
-        while (nMaxTries > 0 && pblock->nNonce < nInnerLoopCount && !CheckProofOfWork(pblock->GetPoWHash(), pblock->nBits, Params().GetConsensus())) {
-            ++pblock->nNonce;
-            --nMaxTries;
-        }
-        if (nMaxTries == 0) {
-            break;
+        // Keep the template while it builds on the tip; extranonce changes
+        // then only rehash the coinbase's merkle branch
+        bool fFound = false;
+        while (!fFound && nMaxTries > 0) {
+            {
+                LOCK(cs_main);
+                if (pblock->hashPrevBlock != chainActive.Tip()->GetBlockHash())
+                    break;
+                IncrementExtraNonce(pblock, chainActive.Tip(), nExtraNonce, pblocktemplate->vCoinbaseMerkleBranch);
+            }
+            // Each extranonce gets a fresh nonce range, split across the threads
+            uint64_t nTriesBefore = nMaxTries;
+            fFound = ScanNonces(*pblock, pblock->nNonce, nInnerLoopCount, nThreads, nMaxTries, Params().GetConsensus());
+            nHashes += nTriesBefore - nMaxTries;
         }
-        if (pblock->nNonce == nInnerLoopCount) {
+        if (!fFound) {
+            if (nMaxTries == 0)
+                break;
             continue;
         }
         CValidationState state;
@@ -142,18 +155,35 @@ UniValue generateBlocks(boost::shared_ptr<CReserveScript> coinbaseScript, int nG
             coinbaseScript->KeepScript();
         }
     }
+
+    double dSeconds = (GetTimeMicros() - nStart) * 0.000001;
+    LogPrint("mining", "%s: %d blocks, %u hashes on %d threads in %.3fs\n", __func__, nHeight - nHeightStart, nHashes, nThreads, dSeconds);
+    {
+        LOCK(cs_main);
+        dGenerateHashesPerSec = dSeconds > 0 ? nHashes / dSeconds : 0;
+    }
     return blockHashes;
 }
 
+/** Worker threads for generate/generatetoaddress: 1 by default, all cores if 0 or less */
+static int ParseGenerateThreads(const UniValue& param)
+{
+    int nThreads = param.get_int();
+    if (nThreads <= 0)
+        nThreads = GetNumCores();
+    return std::min(nThreads, MAX_GENERATE_THREADS);
+}
+
 UniValue generate(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() < 1 || params.size() > 2)
+    if (fHelp || params.size() < 1 || params.size() > 3)
         throw runtime_error(
-            "generate numblocks ( maxtries )\n"
+            "generate numblocks ( maxtries threads )\n"
             "\nMine up to numblocks blocks immediately (before the RPC call returns)\n"
             "\nArguments:\n"
             "1. numblocks    (numeric, required) How many blocks are generated immediately.\n"
             "2. maxtries     (numeric, optional) How many iterations to try (default = 1000000).\n"
+            "3. threads      (numeric, optional) Number of mining threads, 0 for one per core (default = 1).\n"
             "\nResult\n"
             "[ blockhashes ]     (array) hashes of blocks generated\n"
             "\nExamples:\n"
@@ -166,6 +196,10 @@ UniValue generate(const UniValue& params, bool fHelp)
     if (params.size() > 1) {
         nMaxTries = params[1].get_int();
     }
+    int nThreads = 1;
+    if (params.size() > 2) {
+        nThreads = ParseGenerateThreads(params[2]);
+    }
 
     boost::shared_ptr<CReserveScript> coinbaseScript;
     GetMainSignals().ScriptForMining(coinbaseScript);
@@ -178,19 +212,20 @@ UniValue generate(const UniValue& params, bool fHelp)
     if (coinbaseScript->reserveScript.empty())
         throw JSONRPCError(RPC_INTERNAL_ERROR, "No coinbase script available (mining requires a wallet)");
 
-    return generateBlocks(coinbaseScript, nGenerate, nMaxTries, true);
+    return generateBlocks(coinbaseScript, nGenerate, nMaxTries, true, nThreads);
 }
 
 UniValue generatetoaddress(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() < 2 || params.size() > 3)
+    if (fHelp || params.size() < 2 || params.size() > 4)
         throw runtime_error(
-            "generatetoaddress numblocks address (maxtries)\n"
+            "generatetoaddress numblocks address ( maxtries threads )\n"
             "\nMine blocks immediately to a specified address (before the RPC call returns)\n"
             "\nArguments:\n"
             "1. numblocks    (numeric, required) How many blocks are generated immediately.\n"
             "2. address    (string, required) The address to send the newly generated litecoin to.\n"
             "3. maxtries     (numeric, optional) How many iterations to try (default = 1000000).\n"
+            "4. threads      (numeric, optional) Number of mining threads, 0 for one per core (default = 1).\n"
             "\nResult\n"
             "[ blockhashes ]     (array) hashes of blocks generated\n"
             "\nExamples:\n"
@@ -203,6 +238,10 @@ UniValue generatetoaddress(const UniValue& params, bool fHelp)
     if (params.size() > 2) {
         nMaxTries = params[2].get_int();
     }
+    int nThreads = 1;
+    if (params.size() > 3) {
+        nThreads = ParseGenerateThreads(params[3]);
+    }
 
     CBitcoinAddress address(params[1].get_str());
     if (!address.IsValid())
@@ -211,7 +250,7 @@ UniValue generatetoaddress(const UniValue& params, bool fHelp)
     boost::shared_ptr<CReserveScript> coinbaseScript(new CReserveScript());
     coinbaseScript->reserveScript = GetScriptForDestination(address.Get());
 
-    return generateBlocks(coinbaseScript, nGenerate, nMaxTries, false);
+    return generateBlocks(coinbaseScript, nGenerate, nMaxTries, false, nThreads);
 }
 
 UniValue getmininginfo(const UniValue& params, bool fHelp)
@@ -229,6 +268,7 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
             "  \"difficulty\": xxx.xxxxx    (numeric) The current difficulty\n"
             "  \"errors\": \"...\"            (string) Current errors\n"
             "  \"networkhashps\": nnn,      (numeric) The network hashes per second\n"
+            "  \"hashespersec\": nnn,       (numeric) The hash rate of the last generate or generatetoaddress call\n"
             "  \"pooledtx\": n              (numeric) The size of the mempool\n"
             "  \"testnet\": true|false      (boolean) If using testnet or not\n"
             "  \"chain\": \"xxxx\",           (string) current network name as defined in BIP70 (main, test, regtest)\n"
@@ -249,6 +289,7 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("difficulty",       (double)GetDifficulty()));
     obj.push_back(Pair("errors",           GetWarnings("statusbar")));
     obj.push_back(Pair("networkhashps",    getnetworkhashps(params, false)));
+    obj.push_back(Pair("hashespersec",     dGenerateHashesPerSec));
     obj.push_back(Pair("pooledtx",         (uint64_t)mempool.size()));
     obj.push_back(Pair("testnet",          Params().TestnetToBeDeprecatedFieldRPC()));
     obj.push_back(Pair("chain",            Params().NetworkIDString()));
@@ -307,6 +348,86 @@ static UniValue BIP22ValidationResult(const CValidationState& state)
     return "valid?";
 }
 
+/** The getblocktemplate fields of a transaction that don't depend on its template */
+struct CTemplateTxEntry
+{
+    //! Object with "data", "txid" and "hash"
+    UniValue fields;
+    int64_t nWeight;
+};
+
+/**
+ * The transactions array for a cached template, built once and shared by
+ * all getblocktemplate calls served from it. Transactions are kept by
+ * witness hash, so a new template only hex-encodes the ones that were not
+ * in the last one. Requires cs_main.
+ */
+static const UniValue& TemplateTransactions(const CCachedBlockTemplateRef& pcached, bool fPreSegWit)
+{
+    static CCachedBlockTemplateRef pcachedLast;
+    static bool fPreSegWitLast;
+    static UniValue transactionsLast;
+    static map<uint256, CTemplateTxEntry> mapEntriesLast;
+    AssertLockHeld(cs_main);
+    if (pcached == pcachedLast && fPreSegWit == fPreSegWitLast)
+        return transactionsLast;
+
+    const CBlockTemplate* pblocktemplate = pcached->pblocktemplate.get();
+    UniValue transactions(UniValue::VARR);
+    map<uint256, int64_t> setTxIndex;
+    map<uint256, CTemplateTxEntry> mapEntries;
+    int i = 0;
+    BOOST_FOREACH (const CTransaction& tx, pblocktemplate->block.vtx) {
+        uint256 txHash = tx.GetHash();
+        setTxIndex[txHash] = i++;
+
+        if (tx.IsCoinBase())
+            continue;
+
+        // Without witness data the witness hash is the txid
+        uint256 wtxid = tx.wit.IsNull() ? txHash : tx.GetWitnessHash();
+        CTemplateTxEntry& cached = mapEntries[wtxid];
+        map<uint256, CTemplateTxEntry>::iterator it = mapEntriesLast.find(wtxid);
+        if (it != mapEntriesLast.end()) {
+            std::swap(cached, it->second);
+        } else {
+            cached.fields = UniValue(UniValue::VOBJ);
+            cached.fields.push_back(Pair("data", EncodeHexTx(tx)));
+            cached.fields.push_back(Pair("txid", txHash.GetHex()));
+            cached.fields.push_back(Pair("hash", wtxid.GetHex()));
+            cached.nWeight = GetTransactionWeight(tx);
+        }
+
+        UniValue entry(cached.fields);
+
+        UniValue deps(UniValue::VARR);
+        BOOST_FOREACH (const CTxIn &in, tx.vin)
+        {
+            if (setTxIndex.count(in.prevout.hash))
+                deps.push_back(setTxIndex[in.prevout.hash]);
+        }
+        entry.push_back(Pair("depends", deps));
+
+        int index_in_template = i - 1;
+        entry.push_back(Pair("fee", pblocktemplate->vTxFees[index_in_template]));
+        int64_t nTxSigOps = pblocktemplate->vTxSigOpsCost[index_in_template];
+        if (fPreSegWit) {
+            assert(nTxSigOps % WITNESS_SCALE_FACTOR == 0);
+            nTxSigOps /= WITNESS_SCALE_FACTOR;
+        }
+        entry.push_back(Pair("sigops", nTxSigOps));
+        entry.push_back(Pair("weight", cached.nWeight));
+
+        transactions.push_back(entry);
+    }
+
+    pcachedLast = pcached;
+    fPreSegWitLast = fPreSegWit;
+    transactionsLast = transactions;
+    mapEntriesLast.swap(mapEntries);
+    return transactionsLast;
+}
+
 std::string gbt_vb_name(const Consensus::DeploymentPos pos) {
     const struct BIP9DeploymentInfo& vbinfo = VersionBitsDeploymentInfo[pos];
     std::string s = vbinfo.name;
@@ -469,8 +590,6 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     if (IsInitialBlockDownload())
         throw JSONRPCError(RPC_CLIENT_IN_INITIAL_DOWNLOAD, "Litecoin is downloading blocks...");
 
-    static unsigned int nTransactionsUpdatedLast;
-
     if (!lpval.isNull())
     {
         // Wait to respond until either the best block changes, OR a minute has passed and there are more transactions
@@ -489,13 +608,16 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         else
         {
             // NOTE: Spec does not specify behaviour for non-string longpollid, but this makes testing easier
+            CCachedBlockTemplateRef pcached = pblockTemplateCache->GetLatest();
             hashWatchedChain = chainActive.Tip()->GetBlockHash();
-            nTransactionsUpdatedLastLP = nTransactionsUpdatedLast;
+            nTransactionsUpdatedLastLP = pcached ? pcached->nTransactionsUpdated : 0;
         }
 
-        // Release the wallet and main lock while waiting
+        // Release the wallet and main lock while waiting. Waiters woken by
+        // a new tip share the template the cache builds for it.
         LEAVE_CRITICAL_SECTION(cs_main);
         {
+            CBlockTemplateCache::CWaiter waiter(*pblockTemplateCache);
             checktxtime = boost::get_system_time() + boost::posix_time::minutes(1);
 
             boost::unique_lock<boost::mutex> lock(csBestBlock);
@@ -518,35 +640,14 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     }
 
     // Update block
-    static CBlockIndex* pindexPrev;
-    static int64_t nStart;
-    static CBlockTemplate* pblocktemplate;
-    if (pindexPrev != chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
-    {
-        // Clear pindexPrev so future calls make a new block, despite any failures from here on
-        pindexPrev = NULL;
-
-        // Store the pindexBest used before CreateNewBlock, to avoid races
-        nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-        CBlockIndex* pindexPrevNew = chainActive.Tip();
-        nStart = GetTime();
-
-        // Create new block
-        if(pblocktemplate)
-        {
-            delete pblocktemplate;
-            pblocktemplate = NULL;
-        }
-        CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy);
-        if (!pblocktemplate)
-            throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
-
-        // Need to update only after we know CreateNewBlock succeeded
-        pindexPrev = pindexPrevNew;
-    }
-    CBlock* pblock = &pblocktemplate->block; // pointer for convenience
+    CCachedBlockTemplateRef pcached = pblockTemplateCache->Get();
+    if (!pcached)
+        throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
+    const CBlockTemplate* pblocktemplate = pcached->pblocktemplate.get();
+    CBlockIndex* pindexPrev = pcached->pindexPrev;
+    // The template is shared, so work on a copy of its header
+    CBlockHeader header = pblocktemplate->block.GetBlockHeader();
+    CBlockHeader* pblock = &header; // pointer for convenience
     const Consensus::Params& consensusParams = Params().GetConsensus();
 
     // Update nTime
@@ -558,42 +659,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
 
     UniValue aCaps(UniValue::VARR); aCaps.push_back("proposal");
 
-    UniValue transactions(UniValue::VARR);
-    map<uint256, int64_t> setTxIndex;
-    int i = 0;
-    BOOST_FOREACH (CTransaction& tx, pblock->vtx) {
-        uint256 txHash = tx.GetHash();
-        setTxIndex[txHash] = i++;
-
-        if (tx.IsCoinBase())
-            continue;
-
-        UniValue entry(UniValue::VOBJ);
-
-        entry.push_back(Pair("data", EncodeHexTx(tx)));
-        entry.push_back(Pair("txid", txHash.GetHex()));
-        entry.push_back(Pair("hash", tx.GetWitnessHash().GetHex()));
-
-        UniValue deps(UniValue::VARR);
-        BOOST_FOREACH (const CTxIn &in, tx.vin)
-        {
-            if (setTxIndex.count(in.prevout.hash))
-                deps.push_back(setTxIndex[in.prevout.hash]);
-        }
-        entry.push_back(Pair("depends", deps));
-
-        int index_in_template = i - 1;
-        entry.push_back(Pair("fee", pblocktemplate->vTxFees[index_in_template]));
-        int64_t nTxSigOps = pblocktemplate->vTxSigOpsCost[index_in_template];
-        if (fPreSegWit) {
-            assert(nTxSigOps % WITNESS_SCALE_FACTOR == 0);
-            nTxSigOps /= WITNESS_SCALE_FACTOR;
-        }
-        entry.push_back(Pair("sigops", nTxSigOps));
-        entry.push_back(Pair("weight", GetTransactionWeight(tx)));
-
-        transactions.push_back(entry);
-    }
+    const UniValue& transactions = TemplateTransactions(pcached, fPreSegWit);
 
     UniValue aux(UniValue::VOBJ);
     aux.push_back(Pair("flags", HexStr(COINBASE_FLAGS.begin(), COINBASE_FLAGS.end())));
@@ -666,8 +732,8 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     result.push_back(Pair("previousblockhash", pblock->hashPrevBlock.GetHex()));
     result.push_back(Pair("transactions", transactions));
     result.push_back(Pair("coinbaseaux", aux));
-    result.push_back(Pair("coinbasevalue", (int64_t)pblock->vtx[0].vout[0].nValue));
-    result.push_back(Pair("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast)));
+    result.push_back(Pair("coinbasevalue", (int64_t)pblocktemplate->block.vtx[0].vout[0].nValue));
+    result.push_back(Pair("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(pcached->nTransactionsUpdated)));
     result.push_back(Pair("target", hashTarget.GetHex()));
     result.push_back(Pair("mintime", (int64_t)pindexPrev->GetMedianTimePast()+1));
     result.push_back(Pair("mutable", aMutable));
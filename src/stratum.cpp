@@ -0,0 +1,568 @@
+// Copyright (c) 2026 The e-Gulden Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "stratum.h"
+
+#include "arith_uint256.h"
+#include "base58.h"
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "main.h"
+#include "miner.h"
+#include "netbase.h"
+#include "pow.h"
+#include "primitives/block.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "timedata.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "validationinterface.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdlib.h>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/listener.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+
+#include <univalue.h>
+
+/** Maximum length for lines received from a miner */
+static const int MAX_LINE_LENGTH = 100000;
+
+/** Stratum error codes, as used by the common pool implementations */
+enum StratumErrorCode
+{
+    STRATUM_ERR_OTHER = 20,
+    STRATUM_ERR_JOB_NOT_FOUND = 21,
+    STRATUM_ERR_DUPLICATE_SHARE = 22,
+    STRATUM_ERR_LOW_DIFFICULTY = 23,
+    STRATUM_ERR_UNAUTHORIZED = 24,
+    STRATUM_ERR_NOT_SUBSCRIBED = 25,
+};
+
+/**
+ * Work handed out in a mining.notify. The coinbase is sent in two halves
+ * around the extranonce, which sits where IncrementExtraNonce puts its
+ * counter: right after the height in the coinbase scriptSig.
+ */
+struct StratumJob
+{
+    CBlock block;
+    std::vector<unsigned char> vchCoinb1;
+    std::vector<unsigned char> vchCoinb2;
+    std::vector<uint256> vMerkleBranch;
+    int64_t nMinTime;
+    //! Header hashes of the shares submitted for this job
+    std::set<uint256> setShares;
+};
+
+struct StratumClient
+{
+    std::vector<unsigned char> vchExtraNonce1;
+    bool fSubscribed;
+    bool fAuthorized;
+    std::string strWorker;
+
+    StratumClient() : fSubscribed(false), fAuthorized(false) {}
+};
+
+/**
+ * Serves jobs to miners and checks their shares. Everything runs on the
+ * stratum event loop thread; new tips only trigger an event from the
+ * validation signals.
+ */
+class CStratumServer final : public CValidationInterface
+{
+public:
+    CStratumServer(struct event_base* base, const CChainParams& chainparams, const CScript& scriptPayout, double dDifficulty);
+    ~CStratumServer();
+
+    bool Listen(const CService& addrBind);
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindex);
+
+private:
+    struct event_base* base;
+    const CChainParams& chainparams;
+    CScript scriptPayout;
+    double dDifficulty;
+    arith_uint256 shareTarget;
+    BlockTemplateEngine engine;
+
+    struct evconnlistener* listener;
+    struct event* evNewTip;
+    struct event* evRefresh;
+    std::map<struct bufferevent*, StratumClient> mapClients;
+    std::map<uint32_t, StratumJob> mapJobs;
+    uint32_t nNextJobId;
+    uint32_t nNextExtraNonce1;
+    unsigned int nTransactionsUpdatedLast;
+
+    static void acceptcb(struct evconnlistener* listener, evutil_socket_t fd, struct sockaddr* addr, int socklen, void* ctx);
+    static void readcb(struct bufferevent* bev, void* ctx);
+    static void eventcb(struct bufferevent* bev, short what, void* ctx);
+    static void newtipcb(evutil_socket_t, short, void* ctx);
+    static void refreshcb(evutil_socket_t, short, void* ctx);
+
+    /** Build a job from a new template and send it to all subscribed miners */
+    void NewJob();
+    void Notify(struct bufferevent* bev, uint32_t nJobId, bool fClean);
+    void Send(struct bufferevent* bev, const UniValue& msg);
+    void Disconnect(struct bufferevent* bev);
+    void ProcessLine(struct bufferevent* bev, StratumClient& client, const std::string& strLine);
+    UniValue Submit(StratumClient& client, const UniValue& params);
+};
+
+static UniValue StratumError(int nCode, const std::string& strMessage)
+{
+    UniValue error(UniValue::VARR);
+    error.push_back(nCode);
+    error.push_back(strMessage);
+    error.push_back(NullUniValue);
+    return error;
+}
+
+/** Stratum sends the previous block hash in header byte order with each 32-bit word byte swapped */
+static std::string StratumPrevHash(const uint256& hash)
+{
+    std::vector<unsigned char> vch(hash.begin(), hash.end());
+    for (size_t i = 0; i < vch.size(); i += 4)
+        std::reverse(vch.begin() + i, vch.begin() + i + 4);
+    return HexStr(vch);
+}
+
+/** Parse a 32-bit header field sent as 8 hex digits, most significant first */
+static bool ParseStratumUInt32(const UniValue& value, uint32_t& n)
+{
+    if (!value.isStr() || value.get_str().size() != 8 || !IsHex(value.get_str()))
+        return false;
+    n = strtoul(value.get_str().c_str(), NULL, 16);
+    return true;
+}
+
+CStratumServer::CStratumServer(struct event_base* baseIn, const CChainParams& chainparamsIn, const CScript& scriptPayoutIn, double dDifficultyIn) :
+    base(baseIn), chainparams(chainparamsIn), scriptPayout(scriptPayoutIn), dDifficulty(dDifficultyIn), engine(chainparamsIn),
+    listener(NULL), nNextJobId(1), nNextExtraNonce1(1), nTransactionsUpdatedLast(0)
+{
+    // Scrypt miners scale difficulty by 65536, so difficulty 1 is a target
+    // of 0xffff << 240. Dividing by 65536 times the difficulty and shifting
+    // back keeps fractional difficulties exact enough.
+    shareTarget = ((arith_uint256(0xffff) << 224) / arith_uint256((uint64_t)(dDifficulty * 65536))) << 32;
+
+    evNewTip = event_new(base, -1, 0, newtipcb, this);
+    evRefresh = event_new(base, -1, EV_PERSIST, refreshcb, this);
+    struct timeval tv;
+    tv.tv_sec = STRATUM_JOB_REFRESH_SECONDS;
+    tv.tv_usec = 0;
+    event_add(evRefresh, &tv);
+    event_active(evNewTip, 0, 0);
+}
+
+CStratumServer::~CStratumServer()
+{
+    for (std::map<struct bufferevent*, StratumClient>::iterator it = mapClients.begin(); it != mapClients.end(); ++it)
+        bufferevent_free(it->first);
+    if (listener)
+        evconnlistener_free(listener);
+    event_free(evRefresh);
+    event_free(evNewTip);
+}
+
+bool CStratumServer::Listen(const CService& addrBind)
+{
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    if (!addrBind.GetSockAddr((struct sockaddr*)&sockaddr, &len)) {
+        LogPrintf("stratum: Bind address family for %s not supported\n", addrBind.ToString());
+        return false;
+    }
+    listener = evconnlistener_new_bind(base, acceptcb, this, LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, -1,
+                                       (struct sockaddr*)&sockaddr, len);
+    if (!listener) {
+        LogPrintf("stratum: Unable to bind to %s\n", addrBind.ToString());
+        return false;
+    }
+    LogPrintf("stratum: Listening on %s\n", addrBind.ToString());
+    return true;
+}
+
+void CStratumServer::UpdatedBlockTip(const CBlockIndex *pindex)
+{
+    // Called from the validation thread: leave the work to the event loop
+    event_active(evNewTip, 0, 0);
+}
+
+void CStratumServer::acceptcb(struct evconnlistener* listener, evutil_socket_t fd, struct sockaddr* addr, int socklen, void* ctx)
+{
+    CStratumServer* self = (CStratumServer*)ctx;
+    struct bufferevent* bev = bufferevent_socket_new(self->base, fd, BEV_OPT_CLOSE_ON_FREE);
+    if (!bev) {
+        evutil_closesocket(fd);
+        return;
+    }
+
+    StratumClient& client = self->mapClients[bev];
+    uint32_t nExtraNonce1 = self->nNextExtraNonce1++;
+    client.vchExtraNonce1.assign((unsigned char*)&nExtraNonce1, (unsigned char*)&nExtraNonce1 + STRATUM_EXTRANONCE1_SIZE);
+
+    CService addrClient;
+    addrClient.SetSockAddr(addr);
+    LogPrint("stratum", "stratum: Connection from %s, extranonce1 %s\n", addrClient.ToString(), HexStr(client.vchExtraNonce1));
+
+    bufferevent_setcb(bev, readcb, NULL, eventcb, self);
+    bufferevent_enable(bev, EV_READ | EV_WRITE);
+}
+
+void CStratumServer::readcb(struct bufferevent* bev, void* ctx)
+{
+    CStratumServer* self = (CStratumServer*)ctx;
+    struct evbuffer* input = bufferevent_get_input(bev);
+    size_t n_read_out = 0;
+    char* line;
+    //  If there is not a whole line to read, evbuffer_readln returns NULL
+    while ((line = evbuffer_readln(input, &n_read_out, EVBUFFER_EOL_CRLF)) != NULL) {
+        std::string s(line, n_read_out);
+        free(line);
+        self->ProcessLine(bev, self->mapClients[bev], s);
+        // Invalid requests free the connection
+        if (!self->mapClients.count(bev))
+            return;
+    }
+    //  Everything left is an incomplete line
+    if (evbuffer_get_length(input) > MAX_LINE_LENGTH) {
+        LogPrint("stratum", "stratum: Disconnecting because MAX_LINE_LENGTH exceeded\n");
+        self->Disconnect(bev);
+    }
+}
+
+void CStratumServer::eventcb(struct bufferevent* bev, short what, void* ctx)
+{
+    CStratumServer* self = (CStratumServer*)ctx;
+    if (what & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) {
+        LogPrint("stratum", "stratum: Miner disconnected\n");
+        self->Disconnect(bev);
+    }
+}
+
+void CStratumServer::newtipcb(evutil_socket_t, short, void* ctx)
+{
+    ((CStratumServer*)ctx)->NewJob();
+}
+
+void CStratumServer::refreshcb(evutil_socket_t, short, void* ctx)
+{
+    CStratumServer* self = (CStratumServer*)ctx;
+    if (mempool.GetTransactionsUpdated() != self->nTransactionsUpdatedLast)
+        self->NewJob();
+}
+
+void CStratumServer::Disconnect(struct bufferevent* bev)
+{
+    if (mapClients.erase(bev))
+        bufferevent_free(bev);
+}
+
+void CStratumServer::Send(struct bufferevent* bev, const UniValue& msg)
+{
+    std::string str = msg.write() + "\n";
+    evbuffer_add(bufferevent_get_output(bev), str.data(), str.size());
+}
+
+void CStratumServer::NewJob()
+{
+    if (IsInitialBlockDownload())
+        return;
+
+    StratumJob job;
+    int nHeight;
+    try {
+        LOCK(cs_main);
+        nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
+        std::unique_ptr<CBlockTemplate> pblocktemplate(engine.CreateNewBlock(scriptPayout));
+        if (!pblocktemplate)
+            return;
+        job.block = pblocktemplate->block;
+        job.vMerkleBranch = pblocktemplate->vCoinbaseMerkleBranch;
+        nHeight = chainActive.Height() + 1;
+        job.nMinTime = chainActive.Tip()->GetMedianTimePast() + 1;
+    } catch (const std::exception& e) {
+        LogPrintf("stratum: Unable to create a block template: %s\n", e.what());
+        return;
+    }
+
+    CMutableTransaction coinbase(job.block.vtx[0]);
+    CScript scriptSig = CScript() << nHeight;
+    size_t nPrefix = scriptSig.size();
+    scriptSig << std::vector<unsigned char>(STRATUM_EXTRANONCE1_SIZE + STRATUM_EXTRANONCE2_SIZE, 0);
+    scriptSig += COINBASE_FLAGS;
+    if (scriptSig.size() > 100) {
+        LogPrintf("stratum: Coinbase scriptSig too large\n");
+        return;
+    }
+    coinbase.vin[0].scriptSig = scriptSig;
+    job.block.vtx[0] = coinbase;
+
+    // The miner hashes the coinbase without its witness; the extranonce
+    // starts after version, input count, prevout, script length, the height
+    // push and the extranonce push opcode
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+    ss << coinbase;
+    size_t nOffset = 4 + 1 + 36 + GetSizeOfCompactSize(scriptSig.size()) + nPrefix + 1;
+    job.vchCoinb1.assign(ss.begin(), ss.begin() + nOffset);
+    job.vchCoinb2.assign(ss.begin() + nOffset + STRATUM_EXTRANONCE1_SIZE + STRATUM_EXTRANONCE2_SIZE, ss.end());
+
+    bool fClean = mapJobs.empty() || mapJobs.rbegin()->second.block.hashPrevBlock != job.block.hashPrevBlock;
+    if (fClean)
+        mapJobs.clear();
+    uint32_t nJobId = nNextJobId++;
+    mapJobs[nJobId] = job;
+    while (mapJobs.size() > STRATUM_MAX_JOBS)
+        mapJobs.erase(mapJobs.begin());
+
+    LogPrint("stratum", "stratum: New job %x at height %d with %u transactions%s\n",
+        nJobId, nHeight, job.block.vtx.size(), fClean ? ", clean" : "");
+    for (std::map<struct bufferevent*, StratumClient>::iterator it = mapClients.begin(); it != mapClients.end(); ++it) {
+        if (it->second.fSubscribed)
+            Notify(it->first, nJobId, fClean);
+    }
+}
+
+void CStratumServer::Notify(struct bufferevent* bev, uint32_t nJobId, bool fClean)
+{
+    const StratumJob& job = mapJobs[nJobId];
+
+    UniValue branch(UniValue::VARR);
+    for (const uint256& hash : job.vMerkleBranch)
+        branch.push_back(HexStr(hash.begin(), hash.end()));
+
+    UniValue params(UniValue::VARR);
+    params.push_back(strprintf("%x", nJobId));
+    params.push_back(StratumPrevHash(job.block.hashPrevBlock));
+    params.push_back(HexStr(job.vchCoinb1));
+    params.push_back(HexStr(job.vchCoinb2));
+    params.push_back(branch);
+    params.push_back(strprintf("%08x", job.block.nVersion));
+    params.push_back(strprintf("%08x", job.block.nBits));
+    params.push_back(strprintf("%08x", job.block.nTime));
+    params.push_back(fClean);
+
+    UniValue msg(UniValue::VOBJ);
+    msg.push_back(Pair("id", NullUniValue));
+    msg.push_back(Pair("method", "mining.notify"));
+    msg.push_back(Pair("params", params));
+    Send(bev, msg);
+}
+
+void CStratumServer::ProcessLine(struct bufferevent* bev, StratumClient& client, const std::string& strLine)
+{
+    UniValue request;
+    if (!request.read(strLine) || !request.isObject()) {
+        LogPrint("stratum", "stratum: Disconnecting miner sending invalid JSON\n");
+        Disconnect(bev);
+        return;
+    }
+    const UniValue& method = find_value(request, "method");
+    const UniValue& params = find_value(request, "params");
+
+    UniValue reply(UniValue::VOBJ);
+    reply.push_back(Pair("id", find_value(request, "id")));
+    UniValue result;
+    UniValue error;
+    bool fSubscribed = false;
+
+    if (!method.isStr() || !params.isArray()) {
+        error = StratumError(STRATUM_ERR_OTHER, "Invalid request");
+    } else if (method.get_str() == "mining.subscribe") {
+        UniValue subscription(UniValue::VARR);
+        subscription.push_back("mining.notify");
+        subscription.push_back(HexStr(client.vchExtraNonce1));
+        UniValue subscriptions(UniValue::VARR);
+        subscriptions.push_back(subscription);
+        result = UniValue(UniValue::VARR);
+        result.push_back(subscriptions);
+        result.push_back(HexStr(client.vchExtraNonce1));
+        result.push_back((int)STRATUM_EXTRANONCE2_SIZE);
+        fSubscribed = !client.fSubscribed;
+        client.fSubscribed = true;
+    } else if (method.get_str() == "mining.authorize") {
+        // Blocks pay to -stratumaddress; the worker name only shows up in the log
+        client.strWorker = params.size() > 0 && params[0].isStr() ? params[0].get_str() : "";
+        client.fAuthorized = true;
+        result = true;
+    } else if (method.get_str() == "mining.submit") {
+        if (!client.fSubscribed)
+            error = StratumError(STRATUM_ERR_NOT_SUBSCRIBED, "Not subscribed");
+        else if (!client.fAuthorized)
+            error = StratumError(STRATUM_ERR_UNAUTHORIZED, "Unauthorized worker");
+        else
+            error = Submit(client, params);
+        if (error.isNull())
+            result = true;
+    } else {
+        error = StratumError(STRATUM_ERR_OTHER, "Method not found");
+    }
+
+    reply.push_back(Pair("result", result));
+    reply.push_back(Pair("error", error));
+    Send(bev, reply);
+
+    if (fSubscribed) {
+        UniValue difficulty(UniValue::VARR);
+        difficulty.push_back(dDifficulty);
+        UniValue msg(UniValue::VOBJ);
+        msg.push_back(Pair("id", NullUniValue));
+        msg.push_back(Pair("method", "mining.set_difficulty"));
+        msg.push_back(Pair("params", difficulty));
+        Send(bev, msg);
+        if (!mapJobs.empty())
+            Notify(bev, mapJobs.rbegin()->first, true);
+    }
+}
+
+/** Check a share, submitting its block if it meets the block target. Returns the error, or null if accepted. */
+UniValue CStratumServer::Submit(StratumClient& client, const UniValue& params)
+{
+    // [worker, job_id, extranonce2, ntime, nonce]
+    uint32_t nTime, nNonce;
+    if (params.size() < 5 || !params[1].isStr() || !params[2].isStr() ||
+        params[2].get_str().size() != 2 * STRATUM_EXTRANONCE2_SIZE || !IsHex(params[2].get_str()) ||
+        !ParseStratumUInt32(params[3], nTime) || !ParseStratumUInt32(params[4], nNonce))
+        return StratumError(STRATUM_ERR_OTHER, "Invalid parameters");
+
+    std::map<uint32_t, StratumJob>::iterator it = mapJobs.find(strtoul(params[1].get_str().c_str(), NULL, 16));
+    if (it == mapJobs.end())
+        return StratumError(STRATUM_ERR_JOB_NOT_FOUND, "Job not found");
+    StratumJob& job = it->second;
+    if (nTime < job.nMinTime || nTime > GetAdjustedTime() + 2 * 60 * 60)
+        return StratumError(STRATUM_ERR_OTHER, "Time out of range");
+
+    std::vector<unsigned char> vchExtraNonce2 = ParseHex(params[2].get_str());
+    std::vector<unsigned char> vchCoinbase(job.vchCoinb1);
+    vchCoinbase.insert(vchCoinbase.end(), client.vchExtraNonce1.begin(), client.vchExtraNonce1.end());
+    vchCoinbase.insert(vchCoinbase.end(), vchExtraNonce2.begin(), vchExtraNonce2.end());
+    vchCoinbase.insert(vchCoinbase.end(), job.vchCoinb2.begin(), job.vchCoinb2.end());
+    CMutableTransaction coinbase;
+    CDataStream ss(vchCoinbase, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+    ss >> coinbase;
+    coinbase.wit = job.block.vtx[0].wit;
+
+    CBlockHeader header = job.block.GetBlockHeader();
+    header.hashMerkleRoot = ComputeMerkleRootFromBranch(coinbase.GetHash(), job.vMerkleBranch, 0);
+    header.nTime = nTime;
+    header.nNonce = nNonce;
+    uint256 hashPow = header.GetPoWHash();
+
+    // A block is never rejected as a low difficulty share, even when the
+    // share target is harder than the block target
+    bool fBlock = CheckProofOfWork(hashPow, header.nBits, chainparams.GetConsensus());
+    if (!fBlock && UintToArith256(hashPow) > shareTarget)
+        return StratumError(STRATUM_ERR_LOW_DIFFICULTY, "Low difficulty share");
+    if (!job.setShares.insert(header.GetHash()).second)
+        return StratumError(STRATUM_ERR_DUPLICATE_SHARE, "Duplicate share");
+
+    LogPrint("stratum", "stratum: Share from %s for job %s: %s\n", client.strWorker, params[1].get_str(), hashPow.GetHex());
+    if (!fBlock)
+        return NullUniValue;
+
+    CBlock block(job.block);
+    block.vtx[0] = coinbase;
+    block.hashMerkleRoot = header.hashMerkleRoot;
+    block.nTime = header.nTime;
+    block.nNonce = header.nNonce;
+    CValidationState state;
+    if (!ProcessNewBlock(state, chainparams, NULL, &block, true, NULL, false) || !state.IsValid()) {
+        LogPrintf("stratum: Block %s from %s rejected: %s\n", block.GetHash().ToString(), client.strWorker, FormatStateMessage(state));
+        return StratumError(STRATUM_ERR_OTHER, "Block rejected: " + FormatStateMessage(state));
+    }
+    LogPrintf("stratum: Block %s found by %s\n", block.GetHash().ToString(), client.strWorker);
+    return NullUniValue;
+}
+
+static struct event_base* base;
+static boost::thread stratumThread;
+static CStratumServer* pstratumServer = NULL;
+
+static void StratumThread()
+{
+    event_base_dispatch(base);
+}
+
+bool StartStratum()
+{
+    assert(!base);
+
+    CBitcoinAddress address(GetArg("-stratumaddress", ""));
+    if (!address.IsValid()) {
+        LogPrintf("stratum: -stratumaddress must be set to a valid payout address\n");
+        return false;
+    }
+    double dDifficulty = DEFAULT_STRATUM_DIFFICULTY;
+    if (mapArgs.count("-stratumdifficulty") && (!ParseDouble(mapArgs["-stratumdifficulty"], &dDifficulty) || !(dDifficulty >= 1.0 && dDifficulty <= MAX_STRATUM_DIFFICULTY))) {
+        LogPrintf("stratum: Invalid -stratumdifficulty '%s'\n", mapArgs["-stratumdifficulty"]);
+        return false;
+    }
+    CService addrBind;
+    if (!Lookup(GetArg("-stratumbind", DEFAULT_STRATUM_BIND).c_str(), addrBind, GetArg("-stratumport", DEFAULT_STRATUM_PORT), false)) {
+        LogPrintf("stratum: Invalid -stratumbind address '%s'\n", GetArg("-stratumbind", DEFAULT_STRATUM_BIND));
+        return false;
+    }
+
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+    base = event_base_new();
+    if (!base) {
+        LogPrintf("stratum: Unable to create event_base\n");
+        return false;
+    }
+
+    pstratumServer = new CStratumServer(base, Params(), GetScriptForDestination(address.Get()), dDifficulty);
+    if (!pstratumServer->Listen(addrBind)) {
+        delete pstratumServer;
+        pstratumServer = NULL;
+        event_base_free(base);
+        base = NULL;
+        return false;
+    }
+    RegisterValidationInterface(pstratumServer);
+
+    stratumThread = boost::thread(boost::bind(&TraceThread<void (*)()>, "stratum", &StratumThread));
+    return true;
+}
+
+void InterruptStratum()
+{
+    if (base) {
+        LogPrintf("stratum: Thread interrupt\n");
+        event_base_loopbreak(base);
+    }
+}
+
+void StopStratum()
+{
+    if (base) {
+        UnregisterValidationInterface(pstratumServer);
+        stratumThread.join();
+        delete pstratumServer;
+        pstratumServer = NULL;
+        event_base_free(base);
+        base = NULL;
+    }
+}
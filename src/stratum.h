@@ -0,0 +1,33 @@
+// Copyright (c) 2026 The e-Gulden Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/**
+ * Built-in stratum v1 server for miners.
+ */
+#ifndef BITCOIN_STRATUM_H
+#define BITCOIN_STRATUM_H
+
+#include <stdint.h>
+
+static const bool DEFAULT_STRATUM = false;
+static const char* const DEFAULT_STRATUM_BIND = "127.0.0.1";
+static const int DEFAULT_STRATUM_PORT = 3333;
+//! Share difficulty; 1 is a target of 0xffff << 240 (0x0000ffff << 224 times 65536), as scrypt miners expect
+static const double DEFAULT_STRATUM_DIFFICULTY = 1.0;
+//! Highest share difficulty; its target computation needs 65536 times it to fit in 64 bits
+static const double MAX_STRATUM_DIFFICULTY = 1e14;
+//! Seconds between checks for new mempool transactions to put in a job
+static const int STRATUM_JOB_REFRESH_SECONDS = 15;
+//! Jobs kept for late shares until the tip changes
+static const unsigned int STRATUM_MAX_JOBS = 8;
+//! Extranonce bytes chosen by the server, per connection, and by the miner
+static const unsigned int STRATUM_EXTRANONCE1_SIZE = 4;
+static const unsigned int STRATUM_EXTRANONCE2_SIZE = 4;
+
+/** Start the stratum server configured by -stratum*. Returns false on a configuration or bind error. */
+bool StartStratum();
+void InterruptStratum();
+void StopStratum();
+
+#endif // BITCOIN_STRATUM_H
@@ -366,6 +366,15 @@ BOOST_AUTO_TEST_CASE( divide )
     BOOST_CHECK(R2L / MaxL == ZeroL);
     BOOST_CHECK(MaxL / R2L == 1);
     BOOST_CHECK_THROW(R2L / ZeroL, uint_error);
+
+    const uint32_t divisors[] = { 1, 2, 3, 144, 1181, 0x8000, 0xECD75171, 0xffffffff };
+    for (unsigned int i = 0; i < sizeof(divisors) / sizeof(divisors[0]); i++) {
+        BOOST_CHECK(arith_uint256(R1L).DivideUint32(divisors[i]) == R1L / arith_uint256(divisors[i]));
+        BOOST_CHECK(arith_uint256(R2L).DivideUint32(divisors[i]) == R2L / arith_uint256(divisors[i]));
+        BOOST_CHECK(arith_uint256(MaxL).DivideUint32(divisors[i]) == MaxL / arith_uint256(divisors[i]));
+    }
+    BOOST_CHECK(arith_uint256(ZeroL).DivideUint32(7) == ZeroL);
+    BOOST_CHECK_THROW(arith_uint256(R1L).DivideUint32(0), uint_error);
 }
 
 
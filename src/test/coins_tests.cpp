@@ -9,12 +9,15 @@
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
 #include "main.h"
+#include "txdb.h"
 #include "consensus/validation.h"
 
 #include <vector>
 #include <map>
 
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 namespace
 {
@@ -68,14 +71,19 @@ public:
 class CCoinsViewCacheTest : public CCoinsViewCache
 {
 public:
-    CCoinsViewCacheTest(CCoinsView* base) : CCoinsViewCache(base) {}
+    CCoinsViewCacheTest(CCoinsView* base, unsigned int nShards = 1) : CCoinsViewCache(base, nShards) {}
 
     void SelfTest() const
     {
         // Manually recompute the dynamic usage of the whole data, and compare it.
-        size_t ret = memusage::DynamicUsage(cacheCoins);
-        for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
-            ret += it->second.coins.DynamicMemoryUsage();
+        size_t ret = 0;
+        for (unsigned int i = 0; i < nShards; i++) {
+            const CCoinsMap& cacheCoins = shards[i].cacheCoins;
+            ret += memusage::DynamicUsage(cacheCoins);
+            for (CCoinsMap::const_iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
+                BOOST_CHECK(&GetShard(it->first) == &shards[i]);
+                ret += it->second.coins.DynamicMemoryUsage();
+            }
         }
         BOOST_CHECK_EQUAL(DynamicMemoryUsage(), ret);
     }
@@ -187,7 +195,8 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
                 } else {
                     removed_all_caches = true;
                 }
-                stack.push_back(new CCoinsViewCacheTest(tip));
+                // Half of the caches are sharded like pcoinsTip.
+                stack.push_back(new CCoinsViewCacheTest(tip, insecure_rand() % 2 ? 1 : 4));
                 if (stack.size() == 4) {
                     reached_4_caches = true;
                 }
@@ -211,6 +220,222 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+static void PrefetchAll(const CCoinsViewCache* cache, const std::vector<uint256>* txids, unsigned int nStart)
+{
+    for (unsigned int i = 0; i < txids->size(); i++) {
+        cache->PrefetchCoins((*txids)[(nStart + i) % txids->size()]);
+    }
+}
+
+// Prefetches from other threads, racing with the owner spending and
+// creating coins, must leave the cache as if the owner had fetched alone.
+BOOST_AUTO_TEST_CASE(coins_cache_prefetch_test)
+{
+    // No coins are ever fully spent, so the base's reads stay deterministic.
+    CCoinsViewTest base;
+    std::vector<uint256> txids(2000);
+    {
+        CCoinsViewCacheTest setup(&base);
+        for (unsigned int i = 0; i < txids.size(); i++) {
+            txids[i] = GetRandHash();
+            CCoinsModifier coins = setup.ModifyNewCoins(txids[i], false);
+            coins->nVersion = 1;
+            coins->nHeight = i;
+            coins->vout.resize(2 + i % 2);
+            for (unsigned int j = 0; j < coins->vout.size(); j++) {
+                coins->vout[j].nValue = i * 10 + j;
+            }
+        }
+        BOOST_CHECK(setup.Flush());
+    }
+
+    CCoinsViewCacheTest cache(&base, 8);
+    std::map<uint256, CCoins> result;
+    for (int nRound = 0; nRound < 2; nRound++) {
+        boost::thread_group threads;
+        for (unsigned int t = 0; t < 4; t++) {
+            threads.create_thread(boost::bind(&PrefetchAll, &cache, &txids, t * txids.size() / 4));
+        }
+        for (unsigned int i = 0; i < txids.size(); i++) {
+            if (i % 4 == 0) {
+                CCoinsModifier coins = cache.ModifyCoins(txids[i]);
+                coins->Spend(0);
+                result[txids[i]] = *coins;
+            } else if (i % 4 == 1) {
+                uint256 txid = GetRandHash();
+                CCoinsModifier coins = cache.ModifyNewCoins(txid, false);
+                coins->nVersion = 1;
+                coins->vout.resize(1);
+                coins->vout[0].nValue = i;
+                result[txid] = *coins;
+            } else {
+                const CCoins* coins = cache.AccessCoins(txids[i]);
+                BOOST_CHECK(coins && coins->nHeight == (int)i);
+            }
+        }
+        threads.join_all();
+        BOOST_CHECK(cache.GetCacheSize() >= txids.size());
+        cache.SelfTest();
+
+        // The second round prefetches into an empty cache again.
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0);
+    }
+
+    for (std::map<uint256, CCoins>::const_iterator it = result.begin(); it != result.end(); it++) {
+        CCoins coins;
+        BOOST_CHECK(base.GetCoins(it->first, coins) && coins == it->second);
+    }
+}
+
+// The prefetch queue loads coins into the sharded cache from its workers,
+// and drops work added once the workers are too far behind.
+BOOST_AUTO_TEST_CASE(coins_prefetch_queue_test)
+{
+    CCoinsViewTest base;
+    std::vector<uint256> txids(40);
+    {
+        CCoinsViewCacheTest setup(&base);
+        for (unsigned int i = 0; i < txids.size(); i++) {
+            txids[i] = GetRandHash();
+            CCoinsModifier coins = setup.ModifyNewCoins(txids[i], false);
+            coins->nVersion = 1;
+            coins->nHeight = i;
+            coins->vout.resize(1);
+            coins->vout[0].nValue = i;
+        }
+        BOOST_CHECK(setup.Flush());
+    }
+
+    CCoinsViewCacheTest cache(&base, 8);
+    std::vector<CCoinsPrefetch> vFirst, vSecond, vLate;
+    for (unsigned int i = 0; i < txids.size(); i++) {
+        std::vector<CCoinsPrefetch>& v = i < 16 ? vFirst : i < 32 ? vSecond : vLate;
+        v.push_back(CCoinsPrefetch(cache, txids[i]));
+    }
+
+    // Without workers nothing is taken off the queue. Work is added while
+    // at most 20 prefetches are queued, so the third batch is dropped.
+    CCoinsPrefetchQueue queue(20);
+    BOOST_CHECK(queue.Add(vFirst));
+    BOOST_CHECK(queue.Add(vSecond));
+    BOOST_CHECK(!queue.Add(vLate));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0);
+
+    boost::thread_group threads;
+    for (int i = 0; i < 3; i++)
+        threads.create_thread(boost::bind(&CCoinsPrefetchQueue::Thread, &queue));
+    queue.Wait();
+    for (unsigned int i = 0; i < txids.size(); i++)
+        BOOST_CHECK_EQUAL(cache.HaveCoinsInCache(txids[i]), i < 32);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 32);
+    cache.SelfTest();
+
+    // Once the workers caught up, work is accepted again
+    BOOST_CHECK(queue.Add(vLate));
+    queue.Wait();
+    for (unsigned int i = 0; i < txids.size(); i++) {
+        const CCoins* coins = cache.AccessCoins(txids[i]);
+        BOOST_CHECK(coins && coins->nHeight == (int)i);
+    }
+    cache.SelfTest();
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+/** Completion hook that holds the snapshot writer until the test opens it */
+class SnapshotGate
+{
+private:
+    boost::mutex cs;
+    boost::condition_variable cond;
+    bool fOpen;
+    bool fResult;
+
+public:
+    SnapshotGate() : fOpen(false), fResult(false) {}
+
+    bool Wait() {
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (!fOpen)
+            cond.wait(lock);
+        return fResult;
+    }
+
+    void Open(bool fResultIn) {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fOpen = true;
+        fResult = fResultIn;
+        cond.notify_all();
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(coins_snapshot_test, TestingSetup)
+{
+    CCoinsViewDB db(1 << 20, true);
+    std::vector<uint256> txids(100);
+    uint256 hashBlock = GetRandHash();
+    {
+        SnapshotGate gate;
+        CCoinsViewSnapshot snapshot(&db, true, boost::bind(&SnapshotGate::Wait, &gate));
+        CCoinsViewCacheTest cache(&snapshot, 4);
+        for (unsigned int i = 0; i < txids.size(); i++) {
+            txids[i] = GetRandHash();
+            CCoinsModifier coins = cache.ModifyNewCoins(txids[i], false);
+            coins->nVersion = 1;
+            coins->vout.resize(1);
+            coins->vout[0].nValue = i;
+        }
+        cache.SetBestBlock(hashBlock);
+
+        // Flushing hands the changes to the snapshot without waiting for the write.
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0);
+        BOOST_CHECK(snapshot.DynamicMemoryUsage() > 0);
+        BOOST_CHECK(snapshot.GetBestBlock() == hashBlock);
+        for (unsigned int i = 0; i < txids.size(); i++) {
+            const CCoins* coins = cache.AccessCoins(txids[i]);
+            BOOST_CHECK(coins && coins->vout[0].nValue == i);
+        }
+        gate.Open(true);
+        BOOST_CHECK(snapshot.Sync());
+        BOOST_CHECK_EQUAL(snapshot.DynamicMemoryUsage(), 0);
+        BOOST_CHECK(db.GetBestBlock() == hashBlock);
+
+        // Spent coins read as spent through the snapshot and, once written, the database.
+        for (unsigned int i = 0; i < txids.size(); i += 2) {
+            cache.ModifyCoins(txids[i])->Spend(0);
+        }
+        hashBlock = GetRandHash();
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+        for (unsigned int i = 0; i < txids.size(); i++) {
+            BOOST_CHECK_EQUAL(cache.HaveCoins(txids[i]), i % 2 == 1);
+        }
+        BOOST_CHECK(snapshot.Sync());
+        BOOST_CHECK(db.GetBestBlock() == hashBlock);
+        for (unsigned int i = 0; i < txids.size(); i++) {
+            BOOST_CHECK_EQUAL(db.HaveCoins(txids[i]), i % 2 == 1);
+        }
+    }
+
+    // A failed write keeps the snapshot readable, and fails the next flush.
+    SnapshotGate gate;
+    gate.Open(false);
+    CCoinsViewSnapshot snapshot(&db, true, boost::bind(&SnapshotGate::Wait, &gate));
+    CCoinsViewCacheTest cache(&snapshot);
+    cache.ModifyCoins(txids[1])->Spend(0);
+    cache.SetBestBlock(GetRandHash());
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!snapshot.Sync());
+    BOOST_CHECK(snapshot.Failed());
+    BOOST_CHECK(!snapshot.HaveCoins(txids[1]));
+    BOOST_CHECK(snapshot.HaveCoins(txids[3]));
+    cache.ModifyCoins(txids[3])->Spend(0);
+    BOOST_CHECK(!cache.Flush());
+}
+
 // This test is similar to the previous test
 // except the emphasis is on testing the functionality of UpdateCoins
 // random txs are created and UpdateCoins is used to update the cache stack
@@ -322,6 +322,42 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
     }
 }
 
-
+BOOST_AUTO_TEST_CASE(dbwrapper_profiles)
+{
+    std::string strDatabase;
+    const CDBProfile* profile;
+    BOOST_CHECK(ParseDBProfileArg("chainstate:legacy", strDatabase, profile));
+    BOOST_CHECK_EQUAL(strDatabase, "chainstate");
+    BOOST_CHECK_EQUAL(profile->pszName, "legacy");
+    BOOST_CHECK(!ParseDBProfileArg("chainstate", strDatabase, profile));
+    BOOST_CHECK(!ParseDBProfileArg("chainstate:fast", strDatabase, profile));
+    BOOST_CHECK(!ParseDBProfileArg("wallet:coins", strDatabase, profile));
+    BOOST_CHECK(FindDBProfile("none") == NULL);
+
+    BOOST_CHECK_EQUAL(GetDBProfile("chainstate").pszName, "coins");
+    BOOST_CHECK_EQUAL(GetDBProfile("index").pszName, "index");
+    BOOST_CHECK_EQUAL(GetDBProfile("oerushield").pszName, "small");
+    BOOST_CHECK_EQUAL(GetDBProfile("other").pszName, "legacy");
+    mapMultiArgs["-dbprofile"].push_back("index:small");
+    mapMultiArgs["-dbprofile"].push_back("index:legacy");
+    BOOST_CHECK_EQUAL(GetDBProfile("index").pszName, "legacy");
+    BOOST_CHECK_EQUAL(GetDBProfile("chainstate").pszName, "coins");
+    mapMultiArgs.erase("-dbprofile");
+
+    // Every profile opens a working database
+    const char* profiles[] = {"legacy", "coins", "index", "small"};
+    for (unsigned int i = 0; i < ARRAYLEN(profiles); i++) {
+        path ph = temp_directory_path() / unique_path();
+        {
+            CDBWrapper dbw(ph, (1 << 20), false, false, false, *FindDBProfile(profiles[i]));
+            uint256 in = GetRandHash();
+            uint256 res;
+            BOOST_CHECK(dbw.Write('k', in));
+            BOOST_CHECK(dbw.Read('k', res));
+            BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
+        }
+        remove_all(ph);
+    }
+}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,167 @@
+// Copyright (c) 2026 The e-Gulden Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "arith_uint256.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "kgw.h"
+#include "test/test_bitcoin.h"
+
+#include <math.h>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(kgw_tests, BasicTestingSetup)
+
+// Parameters GetNextWorkRequired uses on mainnet
+static const uint64_t KGW_TARGET_SPACING = 120;
+static const uint64_t KGW_PAST_BLOCKS_MIN = 42;
+static const uint64_t KGW_PAST_BLOCKS_MAX = 1181;
+
+/** KimotoGravityWell as it was before it was optimized; the consensus reference */
+static unsigned int KimotoGravityWellReference(const CBlockIndex* pindexLast, uint64_t TargetBlockSpacingSeconds, uint64_t PastBlocksMin, uint64_t PastBlocksMax, const Consensus::Params& params)
+{
+    const CBlockIndex *BlockLastSolved = pindexLast;
+    const CBlockIndex *BlockReading    = pindexLast;
+
+    uint64_t PastBlocksMass          = 0;
+    int64_t  PastRateActualSeconds   = 0;
+    int64_t  PastRateTargetSeconds   = 0;
+    double   PastRateAdjustmentRatio = double(1);
+
+    arith_uint256 PastDifficultyAverage, PastDifficultyAveragePrev;
+    double        EventHorizonDeviation, EventHorizonDeviationFast, EventHorizonDeviationSlow;
+
+    if(BlockLastSolved == NULL || BlockLastSolved->nHeight == 0 || (uint64_t) BlockLastSolved->nHeight < PastBlocksMin)
+        return UintToArith256(params.powLimit).GetCompact();
+
+    for(unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++)
+    {
+        if(PastBlocksMax > 0 && i > PastBlocksMax) break;
+        PastBlocksMass++;
+
+        PastDifficultyAverage.SetCompact(BlockReading->nBits);
+
+        if(i > 1) {
+            if(PastDifficultyAverage >= PastDifficultyAveragePrev) {
+                PastDifficultyAverage = ((PastDifficultyAverage - PastDifficultyAveragePrev) / i) + PastDifficultyAveragePrev;
+            } else {
+                PastDifficultyAverage = PastDifficultyAveragePrev - ((PastDifficultyAveragePrev - PastDifficultyAverage) / i);
+            }
+        }
+
+        PastDifficultyAveragePrev = PastDifficultyAverage;
+
+        PastRateActualSeconds = BlockLastSolved->GetBlockTime() - BlockReading->GetBlockTime();
+        PastRateTargetSeconds = TargetBlockSpacingSeconds * PastBlocksMass;
+
+        PastRateActualSeconds = (PastRateActualSeconds < 0) ? 0 : PastRateActualSeconds;
+        PastRateAdjustmentRatio = (PastRateActualSeconds != 0 && PastRateTargetSeconds != 0)
+            ? double(PastRateTargetSeconds) / double(PastRateActualSeconds)
+            : double(1);
+
+        EventHorizonDeviation     = 1 + (0.7084 * pow((double(PastBlocksMass) / double(144)), -1.228));
+        EventHorizonDeviationFast = EventHorizonDeviation;
+        EventHorizonDeviationSlow = 1 / EventHorizonDeviation;
+
+        if((PastBlocksMass >= PastBlocksMin
+                    && (PastRateAdjustmentRatio <= EventHorizonDeviationSlow || PastRateAdjustmentRatio >= EventHorizonDeviationFast))
+                || (BlockReading->pprev == NULL)) {
+            break;
+        }
+
+        BlockReading = BlockReading->pprev;
+    }
+
+    arith_uint256 bnNew(PastDifficultyAverage);
+    if(PastRateActualSeconds != 0 && PastRateTargetSeconds != 0)
+    {
+        bnNew *= PastRateActualSeconds;
+        bnNew /= PastRateTargetSeconds;
+    }
+
+    const arith_uint256 bnPowLimit = UintToArith256(params.powLimit);
+    if(bnNew > bnPowLimit) {
+        bnNew = bnPowLimit;
+    }
+
+    return bnNew.GetCompact();
+}
+
+/**
+ * Build a chain whose difficulty follows KGW, with block spacing going through
+ * steady, fast, slow and erratic phases (including timestamps going backwards).
+ */
+static void BuildChain(std::vector<CBlockIndex>& blocks, std::vector<uint256>& hashes, const Consensus::Params& params)
+{
+    uint32_t nRand = 0x4b4757;
+    uint32_t nTime = 1400000000;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        nRand = nRand * 1103515245 + 12345;
+        int nPhase = (i / 400) % 4;
+        int64_t nSpacing;
+        if (nPhase == 0)
+            nSpacing = 100 + (nRand >> 16) % 40;
+        else if (nPhase == 1)
+            nSpacing = 5 + (nRand >> 16) % 20;
+        else if (nPhase == 2)
+            nSpacing = 600 + (nRand >> 16) % 1800;
+        else
+            nSpacing = (int64_t)((nRand >> 16) % 900) - 300;
+        nTime = (uint32_t)(nTime + nSpacing);
+
+        hashes[i] = ArithToUint256(arith_uint256(i + 1));
+        blocks[i].phashBlock = &hashes[i];
+        blocks[i].pprev = i ? &blocks[i - 1] : NULL;
+        blocks[i].nHeight = i;
+        blocks[i].nTime = nTime;
+        blocks[i].nBits = i ? KimotoGravityWellReference(&blocks[i - 1], KGW_TARGET_SPACING, KGW_PAST_BLOCKS_MIN, KGW_PAST_BLOCKS_MAX, params)
+                            : UintToArith256(params.powLimit).GetCompact();
+    }
+}
+
+/*
+ * Differential test against the reference implementation over a whole
+ * synthetic chain, from the tip of every height, with and without the cache.
+ */
+BOOST_AUTO_TEST_CASE(kgw_matches_reference)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = Params().GetConsensus();
+
+    std::vector<CBlockIndex> blocks(3200);
+    std::vector<uint256> hashes(blocks.size());
+    BuildChain(blocks, hashes, params);
+
+    for (size_t i = 0; i < blocks.size(); i++) {
+        unsigned int nExpected = KimotoGravityWellReference(&blocks[i], KGW_TARGET_SPACING, KGW_PAST_BLOCKS_MIN, KGW_PAST_BLOCKS_MAX, params);
+        BOOST_CHECK_EQUAL(KimotoGravityWell(&blocks[i], KGW_TARGET_SPACING, KGW_PAST_BLOCKS_MIN, KGW_PAST_BLOCKS_MAX, params), nExpected);
+        // Second call is answered from the cache
+        BOOST_CHECK_EQUAL(KimotoGravityWell(&blocks[i], KGW_TARGET_SPACING, KGW_PAST_BLOCKS_MIN, KGW_PAST_BLOCKS_MAX, params), nExpected);
+
+        // Without a hash the cache is bypassed
+        CBlockIndex index(blocks[i]);
+        index.phashBlock = NULL;
+        BOOST_CHECK_EQUAL(KimotoGravityWell(&index, KGW_TARGET_SPACING, KGW_PAST_BLOCKS_MIN, KGW_PAST_BLOCKS_MAX, params), nExpected);
+    }
+
+    // Cached results are per parameter set
+    const CBlockIndex* pindexLast = &blocks.back();
+    BOOST_CHECK_EQUAL(KimotoGravityWell(pindexLast, KGW_TARGET_SPACING * 2, KGW_PAST_BLOCKS_MIN, KGW_PAST_BLOCKS_MAX, params),
+                      KimotoGravityWellReference(pindexLast, KGW_TARGET_SPACING * 2, KGW_PAST_BLOCKS_MIN, KGW_PAST_BLOCKS_MAX, params));
+    BOOST_CHECK_EQUAL(KimotoGravityWell(pindexLast, KGW_TARGET_SPACING, KGW_PAST_BLOCKS_MIN, 0, params),
+                      KimotoGravityWellReference(pindexLast, KGW_TARGET_SPACING, KGW_PAST_BLOCKS_MIN, 0, params));
+}
+
+/* The embedded table must reproduce the formula it was generated from */
+BOOST_AUTO_TEST_CASE(kgw_event_horizon_deviation_table)
+{
+    for (uint64_t nMass = 1; nMass <= 2 * KGW_PAST_BLOCKS_MAX; nMass++) {
+        double nExpected = 1 + (0.7084 * pow((double(nMass) / double(144)), -1.228));
+        BOOST_CHECK_EQUAL(KGWEventHorizonDeviation(nMass), nExpected);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
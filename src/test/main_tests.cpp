@@ -2,11 +2,19 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "blockfilemap.h"
 #include "chainparams.h"
+#include "consensus/validation.h"
+#include "hash.h"
 #include "main.h"
+#include "miner.h"
+#include "txdb.h"
+#include "versionbits.h"
 
 #include "test/test_bitcoin.h"
 
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/signals2/signal.hpp>
 #include <boost/test/unit_test.hpp>
 
@@ -60,6 +68,358 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK_EQUAL(nSum, 1049999997690000ULL);
 }
 
+BOOST_AUTO_TEST_CASE(check_block_headers_pow)
+{
+    const CChainParams& chainparams = Params(CBaseChainParams::MAIN);
+    const CBlockHeader genesis = chainparams.GenesisBlock().GetBlockHeader();
+    CValidationState state;
+
+    // Batches of every shape, on the worker threads and inline
+    for (int nThreads = 3; nThreads >= 0; nThreads -= 3) {
+        nScriptCheckThreads = nThreads;
+        std::vector<CBlockHeader> headers;
+        BOOST_CHECK(CheckBlockHeadersPoW(headers, state, chainparams.GetConsensus()));
+        headers.resize(1, genesis);
+        BOOST_CHECK(CheckBlockHeadersPoW(headers, state, chainparams.GetConsensus()));
+        headers.resize(POW_CHECK_BATCH_SIZE * 2 + 5, genesis);
+        BOOST_CHECK(CheckBlockHeadersPoW(headers, state, chainparams.GetConsensus()));
+
+        // A single header with bad proof of work fails the whole batch
+        headers[POW_CHECK_BATCH_SIZE + 3].nNonce++;
+        BOOST_CHECK(!CheckBlockHeadersPoW(headers, state, chainparams.GetConsensus()));
+        BOOST_CHECK_EQUAL(state.GetRejectReason(), "high-hash");
+        state = CValidationState();
+    }
+    nScriptCheckThreads = 3;
+}
+
+BOOST_AUTO_TEST_CASE(memoized_pow_hash)
+{
+    const CBlock& genesisBlock = Params(CBaseChainParams::MAIN).GenesisBlock();
+    CBlockHeader header;
+    header = genesisBlock.GetBlockHeader();
+    uint256 hash, cached;
+
+    hash = header.GetPoWHash();
+    BOOST_CHECK(header.GetCachedPoWHash(cached));
+    BOOST_CHECK(cached == hash);
+    BOOST_CHECK(CBlock(header).GetBlockHeader().GetCachedPoWHash(cached));
+
+    // Any change to the fields invalidates the memoized hash
+    header.nNonce++;
+    BOOST_CHECK(!header.GetCachedPoWHash(cached));
+    BOOST_CHECK(header.GetPoWHash() != hash);
+    header.nNonce--;
+    header.hashMerkleRoot = uint256S("0x01");
+    BOOST_CHECK(!header.GetCachedPoWHash(cached));
+    header.hashMerkleRoot = genesisBlock.hashMerkleRoot;
+    BOOST_CHECK(!header.GetCachedPoWHash(cached));
+    BOOST_CHECK(header.GetPoWHash() == hash);
+
+    // Batched hashing memoizes on the headers it was given
+    std::vector<CBlockHeader> headers(3, genesisBlock.GetBlockHeader());
+    headers[1].nTime++;
+    std::vector<uint256> hashes(headers.size());
+    GetPoWHashes(&headers[0], headers.size(), &hashes[0]);
+    for (size_t i = 0; i < headers.size(); i++) {
+        BOOST_CHECK(headers[i].GetCachedPoWHash(cached));
+        BOOST_CHECK(cached == hashes[i]);
+    }
+    BOOST_CHECK(hashes[0] == hash && hashes[2] == hash && hashes[1] != hash);
+}
+
+BOOST_AUTO_TEST_CASE(disk_block_index_powhash)
+{
+    const CBlockHeader genesis = Params(CBaseChainParams::MAIN).GenesisBlock().GetBlockHeader();
+    CBlockIndex index(genesis);
+    // Large enough that the extra flag doesn't change the VARINT's size
+    index.nStatus = BLOCK_VALID_TREE | BLOCK_OPT_WITNESS;
+
+    // Without the flag the entry serializes exactly as before
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CDiskBlockIndex(&index);
+    size_t nSizeWithout = ss.size();
+    CDiskBlockIndex diskindex;
+    ss >> diskindex;
+    BOOST_CHECK(diskindex.hashPoW.IsNull());
+
+    index.hashPoW = genesis.GetPoWHash();
+    index.nStatus |= BLOCK_HAVE_POWHASH;
+    ss << CDiskBlockIndex(&index);
+    BOOST_CHECK_EQUAL(ss.size(), nSizeWithout + 32);
+    ss >> diskindex;
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK(diskindex.hashPoW == genesis.GetPoWHash());
+    BOOST_CHECK(diskindex.GetBlockHash() == genesis.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(mapped_block_read)
+{
+    const CChainParams& chainparams = Params(CBaseChainParams::MAIN);
+    CBlock block1(chainparams.GenesisBlock());
+    CBlock block2(block1);
+    block2.vtx.resize(10, block2.vtx[0]);
+    CDiskBlockPos pos1(5, 0);
+    BOOST_CHECK(WriteBlockToDisk(block1, pos1, chainparams.MessageStart()));
+    unsigned int nSize1 = ::GetSerializeSize(block1, SER_DISK, CLIENT_VERSION);
+    CDiskBlockPos pos2(5, pos1.nPos + nSize1);
+    BOOST_CHECK(WriteBlockToDisk(block2, pos2, chainparams.MessageStart()));
+
+    CBlockFileMap files(1);
+    CBlock block;
+    BOOST_CHECK(files.ReadBlock(pos2, block));
+    BOOST_CHECK(block.GetHash() == block2.GetHash());
+    BOOST_CHECK_EQUAL(block.vtx.size(), 10U);
+    CMappedBlock mapped;
+    BOOST_CHECK(files.GetBlock(pos1, mapped));
+    BOOST_CHECK_EQUAL((size_t)(mapped.pend - mapped.pbegin), nSize1);
+
+    // Positions outside the file and missing files are left to file I/O
+    BOOST_CHECK(!files.GetBlock(CDiskBlockPos(5, pos2.nPos + 1000000), mapped));
+    BOOST_CHECK(!files.GetBlock(CDiskBlockPos(6, pos1.nPos), mapped));
+    BOOST_CHECK(!files.GetBlock(CDiskBlockPos(5, 4), mapped));
+
+    // A released mapping stays readable by whoever holds it
+    BOOST_CHECK(files.GetBlock(pos1, mapped));
+    files.Release(5);
+    CMemoryReader reader(SER_DISK, CLIENT_VERSION, mapped.pbegin, mapped.pend);
+    reader >> block;
+    BOOST_CHECK(reader.empty());
+    BOOST_CHECK(block.GetHash() == block1.GetHash());
+
+    files.SetMaxFiles(0);
+    BOOST_CHECK(!files.ReadBlock(pos1, block));
+}
+
+static void CheckRawBlock(const CBlockIndex* pindex, bool fMapped)
+{
+    CMappedBlock raw;
+    std::vector<char> vchBuffer;
+    BOOST_CHECK(ReadRawBlockFromDisk(raw, vchBuffer, pindex));
+    BOOST_CHECK_EQUAL(vchBuffer.empty(), fMapped);
+
+    CBlock block;
+    BOOST_CHECK(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    BOOST_CHECK(std::vector<char>(raw.pbegin, raw.pend) == std::vector<char>(ss.begin(), ss.end()));
+
+    // An index whose position holds another block is rejected
+    CBlockIndex index(*pindex);
+    index.nDataPos = pindex->pprev->nDataPos;
+    BOOST_CHECK(!ReadRawBlockFromDisk(raw, vchBuffer, &index));
+    index.nDataPos = pindex->nDataPos + 1;
+    BOOST_CHECK(!ReadRawBlockFromDisk(raw, vchBuffer, &index));
+}
+
+BOOST_FIXTURE_TEST_CASE(raw_block_read, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+
+    // The chain is in the file still being appended to, so it is read with file I/O
+    CheckRawBlock(chainActive[5], false);
+
+    // Once a block is stored in the next file, the earlier one is mapped
+    CBlockTemplate* pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(CScript() << OP_TRUE);
+    CBlock block = pblocktemplate->block;
+    delete pblocktemplate;
+    unsigned int nExtraNonce = 0;
+    IncrementExtraNonce(&block, chainActive.Tip(), nExtraNonce);
+    while (!CheckProofOfWork(block.GetPoWHash(), block.nBits, chainparams.GetConsensus())) ++block.nNonce;
+    CDiskBlockPos pos(1, 0);
+    BOOST_CHECK(WriteBlockToDisk(block, pos, chainparams.MessageStart()));
+    CValidationState state;
+    BOOST_CHECK(ProcessNewBlock(state, chainparams, NULL, &block, true, &pos, false));
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(chainActive.Tip()->nFile, 1);
+    CheckRawBlock(chainActive[5], true);
+    CheckRawBlock(chainActive.Tip(), false);
+
+    // Before segwit the stored bytes suit every peer. After it, a peer that
+    // doesn't want witness data gets the block decoded and reserialized.
+    BOOST_CHECK(CanSendRawBlock(chainActive.Tip(), false, chainparams.GetConsensus()));
+    BOOST_CHECK(CanSendRawBlock(chainActive.Tip(), true, chainparams.GetConsensus()));
+    const Consensus::Params& params = chainparams.GetConsensus();
+    std::vector<CBlockIndex> vIndex(3 * params.nMinerConfirmationWindow + 1);
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        vIndex[i].pprev = i ? &vIndex[i - 1] : NULL;
+        vIndex[i].nHeight = i;
+        vIndex[i].nTime = chainActive.Tip()->nTime;
+        vIndex[i].nVersion = VERSIONBITS_TOP_BITS | (1 << params.vDeployments[Consensus::DEPLOYMENT_SEGWIT].bit);
+        vIndex[i].BuildSkip();
+    }
+    const CBlockIndex* pindexSegWit = &vIndex.back();
+    BOOST_CHECK(CanSendRawBlock(pindexSegWit->pprev, false, params));
+    BOOST_CHECK(!CanSendRawBlock(pindexSegWit, false, params));
+    BOOST_CHECK(CanSendRawBlock(pindexSegWit, true, params));
+}
+
+BOOST_FIXTURE_TEST_CASE(block_read_ahead, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+    CBlockReadAhead readahead;
+    CBlock block;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(readahead.Read(chainActive[5], chainparams.GetConsensus()));
+        BOOST_CHECK(readahead.GetIndex() == chainActive[5]);
+        BOOST_CHECK(readahead.GetBlock().GetHash() == chainActive[5]->GetBlockHash());
+
+        // A block read ahead for another index is not used, and is dropped
+        BOOST_CHECK(!readahead.Take(chainActive[6], block));
+        BOOST_CHECK(block.IsNull());
+        BOOST_CHECK(readahead.GetIndex() == NULL);
+        BOOST_CHECK(!readahead.Take(chainActive[5], block));
+
+        BOOST_CHECK(readahead.Read(chainActive[5], chainparams.GetConsensus()));
+        BOOST_CHECK(readahead.Take(chainActive[5], block));
+        BOOST_CHECK(block.GetHash() == chainActive[5]->GetBlockHash());
+        BOOST_CHECK(readahead.GetIndex() == NULL);
+    }
+
+    // Switching back to a longer chain connects several blocks in one
+    // step, reading each ahead while the one before it connects
+    CBlockIndex* pindexTip = chainActive.Tip();
+    CBlockIndex* pindexFork = chainActive[8];
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(InvalidateBlock(state, chainparams, pindexFork));
+    }
+    BOOST_CHECK(ActivateBestChain(state, chainparams));
+    BOOST_CHECK_EQUAL(chainActive.Height(), 7);
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(), CScript() << OP_TRUE);
+    BOOST_CHECK_EQUAL(chainActive.Height(), 8);
+    BOOST_CHECK(chainActive.Tip() != pindexFork);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(ResetBlockFailureFlags(pindexFork));
+    }
+    BOOST_CHECK(ActivateBestChain(state, chainparams));
+    BOOST_CHECK(state.IsValid());
+    BOOST_CHECK(chainActive.Tip() == pindexTip);
+    BOOST_CHECK(pcoinsTip->GetBestBlock() == pindexTip->GetBlockHash());
+}
+
+BOOST_FIXTURE_TEST_CASE(reindex_block_files, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+    uint256 hashTip = chainActive.Tip()->GetBlockHash();
+    int nHeight = chainActive.Height();
+
+    // Start over from the block files alone, as -reindex does
+    UnloadBlockIndex();
+    delete pcoinsTip;
+    delete pcoinsSnapshot;
+    delete pcoinsdbview;
+    delete pblocktree;
+    pblocktree = new CBlockTreeDB(1 << 20, true);
+    pcoinsdbview = new CCoinsViewDB(1 << 23, true);
+    pcoinsSnapshot = new CCoinsViewSnapshot(pcoinsdbview, DEFAULT_BACKGROUND_FLUSH);
+    pcoinsTip = new CCoinsViewCache(pcoinsSnapshot, COINS_TIP_SHARDS);
+    fReindex = true;
+    BOOST_CHECK(InitBlockIndex(chainparams));
+    BOOST_CHECK(ReindexBlockFiles(chainparams, 2));
+    fReindex = false;
+
+    BOOST_CHECK_EQUAL(chainActive.Height(), nHeight);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == hashTip);
+    BOOST_CHECK(mapBlockIndex.size() == (size_t)nHeight + 1);
+}
+
+static uint256 HashCoins(CCoinsView* view)
+{
+    FlushStateToDisk();
+    BOOST_CHECK(pcoinsSnapshot->Sync());
+    boost::scoped_ptr<CCoinsViewCursor> pcursor(view->Cursor());
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << pcursor->GetBestBlock();
+    for (; pcursor->Valid(); pcursor->Next()) {
+        uint256 key;
+        CCoins coins;
+        BOOST_CHECK(pcursor->GetKey(key) && pcursor->GetValue(coins));
+        ss << key << coins;
+    }
+    return ss.GetHash();
+}
+
+BOOST_FIXTURE_TEST_CASE(reindex_shuffled_block_files, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    for (int i = 0; i < 30; i++)
+        CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+
+    // A shorter fork, indexed last, whose blocks are left in the connect
+    // queue once the chain is connected
+    CBlockIndex* pindexFork = chainActive[chainActive.Height() - 4];
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(InvalidateBlock(state, chainparams, pindexFork));
+    }
+    BOOST_CHECK(ActivateBestChain(state, chainparams));
+    std::vector<CBlock> vFork;
+    for (int i = 0; i < 3; i++)
+        vFork.push_back(CreateAndProcessBlock(std::vector<CMutableTransaction>(), CScript() << OP_TRUE));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(ResetBlockFailureFlags(pindexFork));
+    }
+    BOOST_CHECK(ActivateBestChain(state, chainparams));
+    uint256 hashTip = chainActive.Tip()->GetBlockHash();
+    int nHeight = chainActive.Height();
+    BOOST_CHECK_EQUAL(nHeight, 40);
+    uint256 hashCoins = HashCoins(pcoinsdbview);
+
+    std::vector<CBlock> vBlocks(nHeight + 1);
+    for (int i = 0; i <= nHeight; i++)
+        BOOST_CHECK(ReadBlockFromDisk(vBlocks[i], chainActive[i], chainparams.GetConsensus()));
+    unsigned int nBlockSize = ::GetSerializeSize(vBlocks[1], SER_DISK, CLIENT_VERSION);
+
+    UnloadBlockIndex();
+    delete pcoinsTip;
+    delete pcoinsSnapshot;
+    delete pcoinsdbview;
+    delete pblocktree;
+    pblocktree = new CBlockTreeDB(1 << 20, true);
+    pcoinsdbview = new CCoinsViewDB(1 << 23, true);
+    pcoinsSnapshot = new CCoinsViewSnapshot(pcoinsdbview, DEFAULT_BACKGROUND_FLUSH);
+    pcoinsTip = new CCoinsViewCache(pcoinsSnapshot, COINS_TIP_SHARDS);
+
+    // Rewrite the blocks over three files, the highest ones first and each
+    // file in descending order, so that every block but the genesis block
+    // waits for its parent, most of them for one stored in a later file
+    boost::filesystem::remove(GetBlockPosFilename(CDiskBlockPos(0, 0), "blk"));
+    std::vector<unsigned int> vFileSize(3, 0);
+    std::vector<std::pair<int, const CBlock*> > vWrite;
+    vWrite.push_back(std::make_pair(0, &vBlocks[0]));
+    for (int i = nHeight; i > 0; i--)
+        vWrite.push_back(std::make_pair(2 - 3 * (i - 1) / nHeight, &vBlocks[i]));
+    for (size_t i = 0; i < vFork.size(); i++)
+        vWrite.push_back(std::make_pair(2, &vFork[i]));
+    for (size_t i = 0; i < vWrite.size(); i++) {
+        CDiskBlockPos pos(vWrite[i].first, vFileSize[vWrite[i].first]);
+        BOOST_CHECK(WriteBlockToDisk(*vWrite[i].second, pos, chainparams.MessageStart()));
+        vFileSize[pos.nFile] = pos.nPos + ::GetSerializeSize(*vWrite[i].second, SER_DISK, CLIENT_VERSION);
+    }
+
+    // Keep only a few out-of-order blocks decoded, so that the rest are read
+    // again from disk, and let a single block wait to be connected, so that
+    // the second fork block finds the first one still queued and drops it.
+    // Scan threads beyond the number of files find no file to claim.
+    fReindex = true;
+    BOOST_CHECK(InitBlockIndex(chainparams));
+    BOOST_CHECK(ReindexBlockFiles(chainparams, MAX_REINDEX_SCAN_THREADS, 10 * nBlockSize, 1));
+    fReindex = false;
+
+    BOOST_CHECK_EQUAL(chainActive.Height(), nHeight);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == hashTip);
+    BOOST_CHECK_EQUAL(mapBlockIndex.size(), nHeight + 1 + vFork.size());
+    BOOST_CHECK(mapBlockIndex.count(vFork.back().GetHash()));
+    BOOST_CHECK(HashCoins(pcoinsdbview) == hashCoins);
+}
+
 bool ReturnFalse() { return false; }
 bool ReturnTrue() { return true; }
 
@@ -9,6 +9,7 @@
 #include "consensus/validation.h"
 #include "main.h"
 #include "miner.h"
+#include "pow.h"
 #include "pubkey.h"
 #include "script/standard.h"
 #include "txmempool.h"
@@ -178,6 +179,93 @@ void TestPackageSelection(const CChainParams& chainparams, CScript scriptPubKey,
     BOOST_CHECK(pblocktemplate->block.vtx[8].GetHash() == hashLowFeeTx2);
 }
 
+static bool TemplateHasTx(const CBlockTemplate* pblocktemplate, const uint256& hash)
+{
+    BOOST_FOREACH(const CTransaction& tx, pblocktemplate->block.vtx) {
+        if (tx.GetHash() == hash)
+            return true;
+    }
+    return false;
+}
+
+// Test that BlockTemplateEngine extends its selection as transactions arrive,
+// picks the same transactions as BlockAssembler, and starts over when it must.
+// Like TestPackageSelection, this reuses the chain of CreateNewBlock_validity.
+void TestTemplateEngine(const CChainParams& chainparams, CScript scriptPubKey, std::vector<CTransaction *>& txFirst)
+{
+    TestMemPoolEntryHelper entry;
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    BlockTemplateEngine engine(chainparams);
+    BOOST_CHECK(engine.UpdateSelection(pindexPrev));
+    BOOST_CHECK(!engine.UpdateSelection(pindexPrev));
+
+    // A low fee parent, then an unrelated medium fee tx and a high fee child
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vin[0].prevout.hash = txFirst[0]->GetHash();
+    tx.vin[0].prevout.n = 0;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = txFirst[0]->vout[0].nValue - 1000;
+    uint256 hashParentTx = tx.GetHash();
+    mempool.addUnchecked(hashParentTx, entry.Fee(1000).Time(GetTime()).SpendsCoinbase(true).FromTx(tx));
+    BOOST_CHECK(!engine.UpdateSelection(pindexPrev));
+
+    tx.vin[0].prevout.hash = txFirst[1]->GetHash();
+    tx.vout[0].nValue = txFirst[1]->vout[0].nValue - 10000;
+    uint256 hashMediumFeeTx = tx.GetHash();
+    mempool.addUnchecked(hashMediumFeeTx, entry.Fee(10000).Time(GetTime()).SpendsCoinbase(true).FromTx(tx));
+
+    tx.vin[0].prevout.hash = hashParentTx;
+    tx.vout[0].nValue = txFirst[0]->vout[0].nValue - 1000 - 50000;
+    CTransaction highFeeTx(tx);
+    mempool.addUnchecked(highFeeTx.GetHash(), entry.Fee(50000).Time(GetTime()).SpendsCoinbase(false).FromTx(tx));
+
+    CBlockTemplate* pblocktemplate = engine.CreateNewBlock(scriptPubKey);
+    CBlockTemplate* pexpected = BlockAssembler(chainparams).CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4U);
+    BOOST_CHECK(pblocktemplate->block.vtx[1].GetHash() == hashParentTx);
+    for (size_t i = 1; i < pexpected->block.vtx.size(); i++)
+        BOOST_CHECK(TemplateHasTx(pblocktemplate, pexpected->block.vtx[i].GetHash()));
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], pexpected->vTxFees[0]);
+    CValidationState state;
+    BOOST_CHECK(TestBlockValidity(state, chainparams, pblocktemplate->block, pindexPrev, false, false));
+    delete pblocktemplate;
+    delete pexpected;
+
+    // Removing a selected transaction or prioritising one starts over
+    std::list<CTransaction> removed;
+    mempool.removeRecursive(highFeeTx, removed);
+    BOOST_CHECK(engine.UpdateSelection(pindexPrev));
+    BOOST_CHECK(!engine.UpdateSelection(pindexPrev));
+    mempool.PrioritiseTransaction(hashMediumFeeTx, hashMediumFeeTx.ToString(), 0, 1000);
+    BOOST_CHECK(engine.UpdateSelection(pindexPrev));
+    mempool.clear();
+    BOOST_CHECK(engine.UpdateSelection(pindexPrev));
+
+    // With room for two transactions, a better one that doesn't fit replaces
+    // the worst selected one; a worse one is left out
+    size_t nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    mapArgs["-blockmaxweight"] = strprintf("%d", 4000 + 10 * nTxSize);
+    BlockTemplateEngine smallEngine(chainparams);
+    mapArgs.erase("-blockmaxweight");
+    uint256 hashes[4];
+    const CAmount fees[4] = {10000, 20000, 50000, 5000};
+    for (int i = 0; i < 4; i++) {
+        tx.vin[0].prevout.hash = txFirst[i]->GetHash();
+        tx.vout[0].nValue = txFirst[i]->vout[0].nValue - fees[i];
+        hashes[i] = tx.GetHash();
+        mempool.addUnchecked(hashes[i], entry.Fee(fees[i]).Time(GetTime()).SpendsCoinbase(true).FromTx(tx));
+        BOOST_CHECK_EQUAL(smallEngine.UpdateSelection(pindexPrev), i == 0 || i == 2);
+    }
+    pblocktemplate = smallEngine.CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3U);
+    BOOST_CHECK(TemplateHasTx(pblocktemplate, hashes[1]));
+    BOOST_CHECK(TemplateHasTx(pblocktemplate, hashes[2]));
+    delete pblocktemplate;
+    mempool.clear();
+}
+
 // NOTE: These tests rely on CreateNewBlock doing its own self-validation!
 BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
 {
@@ -495,6 +583,8 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     mempool.clear();
 
     TestPackageSelection(chainparams, scriptPubKey, txFirst);
+    mempool.clear();
+    TestTemplateEngine(chainparams, scriptPubKey, txFirst);
 
     BOOST_FOREACH(CTransaction *_tx, txFirst)
         delete _tx;
@@ -502,4 +592,110 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+BOOST_AUTO_TEST_CASE(ScanNonces_lowest_nonce)
+{
+    const Consensus::Params& params = Params(CBaseChainParams::REGTEST).GetConsensus();
+
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = uint256S("0x1234");
+    header.hashMerkleRoot = uint256S("0x5678");
+    header.nTime = 1500000000;
+    header.nBits = 0x1f3fffff; // a block every 1024 hashes or so
+
+    // Reference: the first valid nonce found one hash at a time
+    CBlockHeader expected(header);
+    expected.nNonce = 0;
+    while (!CheckProofOfWork(expected.GetPoWHash(), expected.nBits, params))
+        expected.nNonce++;
+
+    for (int nThreads = 1; nThreads <= 4; nThreads += 3) {
+        CBlockHeader scanned(header);
+        uint64_t nMaxTries = 1000000;
+        BOOST_CHECK(ScanNonces(scanned, 0, 0x10000, nThreads, nMaxTries, params));
+        BOOST_CHECK_EQUAL(scanned.nNonce, expected.nNonce);
+        BOOST_CHECK(scanned.GetPoWHash() == expected.GetPoWHash());
+        // At least the hashes up to the valid nonce were done
+        BOOST_CHECK(nMaxTries <= 1000000 - (expected.nNonce + 1));
+    }
+
+    // The tries budget stops the search
+    CBlockHeader hard(header);
+    hard.nBits = 0x1d00ffff;
+    uint64_t nMaxTries = 10;
+    BOOST_CHECK(!ScanNonces(hard, 0, 0x10000, 4, nMaxTries, params));
+    BOOST_CHECK_EQUAL(nMaxTries, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(IncrementExtraNonce_branch)
+{
+    // Odd sizes duplicate the last hash at some level of the tree
+    for (int nTx = 1; nTx <= 9; nTx++) {
+        CBlock block;
+        for (int i = 0; i < nTx; i++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout.n = i;
+            if (i == 0)
+                tx.vin[0].prevout.SetNull();
+            tx.vout.resize(1);
+            tx.vout[0].nValue = i;
+            block.vtx.push_back(tx);
+        }
+        std::vector<uint256> vBranch = BlockMerkleBranch(block, 0);
+
+        CBlock blockFull(block);
+        unsigned int nExtraNonce = 0;
+        unsigned int nExtraNonceFull = 0;
+        for (int i = 0; i < 3; i++) {
+            IncrementExtraNonce(&block, chainActive.Tip(), nExtraNonce, vBranch);
+            IncrementExtraNonce(&blockFull, chainActive.Tip(), nExtraNonceFull);
+            BOOST_CHECK_EQUAL(nExtraNonce, nExtraNonceFull);
+            BOOST_CHECK(block.vtx[0].GetHash() == blockFull.vtx[0].GetHash());
+            BOOST_CHECK(block.hashMerkleRoot == blockFull.hashMerkleRoot);
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(BlockTemplateCache_tip, TestChain100Setup)
+{
+    CBlockTemplateCache cache(Params());
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    CCachedBlockTemplateRef pfirst;
+    {
+        LOCK(cs_main);
+        pfirst = cache.Get();
+        BOOST_CHECK(pfirst && pfirst->pindexPrev == chainActive.Tip());
+        // Served again while nothing changed
+        BOOST_CHECK(cache.Get() == pfirst);
+    }
+    BOOST_CHECK(cache.GetLatest() == pfirst);
+    BOOST_CHECK(!cache.WaitForNew(pfirst, boost::get_system_time() + boost::posix_time::milliseconds(10)));
+
+    // Without the build thread, a new tip is picked up by Get
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+    CCachedBlockTemplateRef psecond;
+    {
+        LOCK(cs_main);
+        psecond = cache.Get();
+        BOOST_CHECK(psecond != pfirst && psecond->pindexPrev == chainActive.Tip());
+    }
+    BOOST_CHECK(cache.WaitForNew(pfirst, boost::get_system_time()));
+
+    // With it, waiters are woken up with a template for the new tip
+    RegisterValidationInterface(&cache);
+    boost::thread thread(&CBlockTemplateCache::ThreadBuild, &cache);
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+    BOOST_CHECK(cache.WaitForNew(psecond, boost::get_system_time() + boost::posix_time::seconds(60)));
+    CCachedBlockTemplateRef pthird = cache.GetLatest();
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(pthird->pindexPrev == chainActive.Tip());
+        BOOST_CHECK(cache.Get() == pthird);
+    }
+    thread.interrupt();
+    thread.join();
+    UnregisterValidationInterface(&cache);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,101 +5,300 @@
 #include "test/test_bitcoin.h"
 
 #include "base58.h"
+#include "chain.h"
 #include "oerushield/oerudb.h"
 #include "oerushield/oerushield.h"
+#include "oerushield/oerusignal.h"
 #include "oerushield/oerutx.h"
 #include "oerushield/signaturechecker.h"
+#include "script/script.h"
 
+#include <algorithm>
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
+#include <fstream>
 #include <string>
 
 BOOST_FIXTURE_TEST_SUITE(oerushield_tests, BasicTestingSetup)
 
-std::string GetTempFilePath()
+boost::filesystem::path GetTempFilePath()
 {
-    boost::filesystem::path tmpfile = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
-    return tmpfile.string().c_str();
+    return boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
 }
 
-BOOST_AUTO_TEST_CASE (oerudb_certified_addresses)
+CKeyID GetAddressKey(const std::string& strAddress)
 {
-    COeruDB oeruDB(GetTempFilePath());
+    CKeyID keyID;
+    BOOST_CHECK(CBitcoinAddress(strAddress).GetKeyID(keyID));
+    return keyID;
+}
 
-    std::string addresses[] = {
-        "LdwLvykqj2nUH3MWcut6mtjHxVxVFC7st5",
-        "LWZR9ybwmT8vSXP6tmrBX4b6nE9o94AjQG",
-        "LWkdEB9SHUfuBiTvZofK2LqYE4RTTtUcqi",
-        "LVcGHJcTv1ctR6GLRXxR4SQSsycdmQ6pwZ",
-        "LPD8ZwGjE4WmQ1EEnjZHrvofSyvGtbEWsH",
-        "LPGeGFBPCVLHdGVD1i1oikzD92XZoTEVyh"
+BOOST_AUTO_TEST_CASE (oerudb_certified_addresses)
+{
+    COeruDB oeruDB(GetTempFilePath(), 1 << 20, true);
+
+    CKeyID keys[] = {
+        GetAddressKey("LdwLvykqj2nUH3MWcut6mtjHxVxVFC7st5"),
+        GetAddressKey("LWZR9ybwmT8vSXP6tmrBX4b6nE9o94AjQG"),
+        GetAddressKey("LWkdEB9SHUfuBiTvZofK2LqYE4RTTtUcqi"),
+        GetAddressKey("LVcGHJcTv1ctR6GLRXxR4SQSsycdmQ6pwZ"),
+        GetAddressKey("LPD8ZwGjE4WmQ1EEnjZHrvofSyvGtbEWsH"),
+        GetAddressKey("LPGeGFBPCVLHdGVD1i1oikzD92XZoTEVyh")
     };
 
     // Add some certified addresses
-    oeruDB.AddCertifiedAddress(CBitcoinAddress(addresses[0]));
-    oeruDB.AddCertifiedAddress(CBitcoinAddress(addresses[1]));
-    oeruDB.AddCertifiedAddress(CBitcoinAddress(addresses[2]));
+    oeruDB.AddCertifiedAddress(keys[0]);
+    oeruDB.AddCertifiedAddress(keys[1]);
+    oeruDB.AddCertifiedAddress(keys[2]);
 
     // Add one double to check uniqueness enforced
-    oeruDB.AddCertifiedAddress(CBitcoinAddress(addresses[0]));
+    oeruDB.AddCertifiedAddress(keys[0]);
 
     BOOST_CHECK(oeruDB.NumCertifiedAddresses() == 3);
 
     // Check certified == true
-    BOOST_CHECK(oeruDB.IsAddressCertified(CBitcoinAddress(addresses[0])) == true);
-    BOOST_CHECK(oeruDB.IsAddressCertified(CBitcoinAddress(addresses[1])) == true);
-    BOOST_CHECK(oeruDB.IsAddressCertified(CBitcoinAddress(addresses[2])) == true);
+    BOOST_CHECK(oeruDB.IsAddressCertified(keys[0]) == true);
+    BOOST_CHECK(oeruDB.IsAddressCertified(keys[1]) == true);
+    BOOST_CHECK(oeruDB.IsAddressCertified(keys[2]) == true);
 
     // Check certified == false
-    BOOST_CHECK(oeruDB.IsAddressCertified(CBitcoinAddress(addresses[3])) == false);
-    BOOST_CHECK(oeruDB.IsAddressCertified(CBitcoinAddress(addresses[4])) == false);
-    BOOST_CHECK(oeruDB.IsAddressCertified(CBitcoinAddress(addresses[5])) == false);
+    BOOST_CHECK(oeruDB.IsAddressCertified(keys[3]) == false);
+    BOOST_CHECK(oeruDB.IsAddressCertified(keys[4]) == false);
+    BOOST_CHECK(oeruDB.IsAddressCertified(keys[5]) == false);
 
     // Remove addresses and check certified == false
-    oeruDB.RemoveCertifiedAddress(CBitcoinAddress(addresses[0]));
-    oeruDB.RemoveCertifiedAddress(CBitcoinAddress(addresses[1]));
-    oeruDB.RemoveCertifiedAddress(CBitcoinAddress(addresses[2]));
+    oeruDB.RemoveCertifiedAddress(keys[0]);
+    oeruDB.RemoveCertifiedAddress(keys[1]);
+    oeruDB.RemoveCertifiedAddress(keys[2]);
 
     BOOST_CHECK(oeruDB.NumCertifiedAddresses() == 0);
 
-    BOOST_CHECK(oeruDB.IsAddressCertified(CBitcoinAddress(addresses[0])) == false);
-    BOOST_CHECK(oeruDB.IsAddressCertified(CBitcoinAddress(addresses[1])) == false);
-    BOOST_CHECK(oeruDB.IsAddressCertified(CBitcoinAddress(addresses[2])) == false);
+    BOOST_CHECK(oeruDB.IsAddressCertified(keys[0]) == false);
+    BOOST_CHECK(oeruDB.IsAddressCertified(keys[1]) == false);
+    BOOST_CHECK(oeruDB.IsAddressCertified(keys[2]) == false);
 }
 
-BOOST_AUTO_TEST_CASE (oerudb_read_write_dbfile)
+BOOST_AUTO_TEST_CASE (oerudb_certified_snapshot)
 {
-    boost::filesystem::path tmpfile = boost::filesystem::temp_directory_path() / "oeru.db";
-
-    COeruDB writeOeruDB(tmpfile.string().c_str());
+    COeruDB oeruDB(GetTempFilePath(), 1 << 20, true);
+    CKeyID keyA = GetAddressKey("LdwLvykqj2nUH3MWcut6mtjHxVxVFC7st5");
+    CKeyID keyB = GetAddressKey("LWZR9ybwmT8vSXP6tmrBX4b6nE9o94AjQG");
+
+    CertifiedSnapshotRef empty = oeruDB.GetCertifiedSnapshot();
+    BOOST_CHECK(empty && empty->empty());
+
+    // Changes only become visible once published
+    oeruDB.AddCertifiedAddress(keyA);
+    oeruDB.AddCertifiedAddress(keyB);
+    BOOST_CHECK(oeruDB.GetCertifiedSnapshot()->empty());
+    oeruDB.PublishSnapshot();
+
+    CertifiedSnapshotRef both = oeruDB.GetCertifiedSnapshot();
+    BOOST_CHECK(both->size() == 2);
+    BOOST_CHECK(std::is_sorted(both->begin(), both->end()));
+
+    // A snapshot held by a reader is not affected by later changes
+    oeruDB.RemoveCertifiedAddress(keyA);
+    oeruDB.PublishSnapshot();
+    BOOST_CHECK(both->size() == 2);
+    BOOST_CHECK(oeruDB.GetCertifiedSnapshot()->size() == 1);
+    BOOST_CHECK(oeruDB.GetCertifiedSnapshot()->front() == CTxDestination(keyB));
+    BOOST_CHECK(empty->empty());
+}
 
-    std::string addresses[] = {
-        "LdwLvykqj2nUH3MWcut6mtjHxVxVFC7st5",
-        "LWZR9ybwmT8vSXP6tmrBX4b6nE9o94AjQG",
-        "LWkdEB9SHUfuBiTvZofK2LqYE4RTTtUcqi"
+BOOST_AUTO_TEST_CASE (oerudb_flush_reopen)
+{
+    boost::filesystem::path path = GetTempFilePath();
+    CKeyID keys[] = {
+        GetAddressKey("LdwLvykqj2nUH3MWcut6mtjHxVxVFC7st5"),
+        GetAddressKey("LWZR9ybwmT8vSXP6tmrBX4b6nE9o94AjQG"),
+        GetAddressKey("LWkdEB9SHUfuBiTvZofK2LqYE4RTTtUcqi")
     };
+    uint256 hashBlock = uint256S("0x01");
+
+    {
+        COeruDB writeOeruDB(path, 1 << 20);
+        BOOST_CHECK(writeOeruDB.GetBestBlock().IsNull());
+        writeOeruDB.AddCertifiedAddress(keys[0]);
+        writeOeruDB.AddCertifiedAddress(keys[1]);
+        writeOeruDB.AddCertifiedAddress(keys[2]);
+        BOOST_CHECK(writeOeruDB.Flush(hashBlock));
+
+        // Unflushed changes are lost
+        writeOeruDB.RemoveCertifiedAddress(keys[1]);
+    }
+
+    {
+        COeruDB readOeruDB(path, 1 << 20);
+        BOOST_CHECK(readOeruDB.GetBestBlock() == hashBlock);
+        BOOST_CHECK(readOeruDB.NumCertifiedAddresses() == 3);
+        BOOST_CHECK(readOeruDB.IsAddressCertified(keys[0]) == true);
+        BOOST_CHECK(readOeruDB.IsAddressCertified(keys[1]) == true);
+        BOOST_CHECK(readOeruDB.IsAddressCertified(keys[2]) == true);
+
+        BOOST_CHECK(readOeruDB.ShouldReindex(950000, hashBlock) == false);
+        BOOST_CHECK(readOeruDB.ShouldReindex(950000, uint256S("0x02")) == true);
+    }
+
+    boost::filesystem::remove_all(path);
+}
 
-    writeOeruDB.AddCertifiedAddress(CBitcoinAddress(addresses[0]));
-    writeOeruDB.AddCertifiedAddress(CBitcoinAddress(addresses[1]));
-    writeOeruDB.AddCertifiedAddress(CBitcoinAddress(addresses[2]));
-
-    BOOST_CHECK(writeOeruDB.NumCertifiedAddresses() == 3);
-
-    writeOeruDB.WriteFile();
+BOOST_AUTO_TEST_CASE (oerudb_block_undo)
+{
+    boost::filesystem::path path = GetTempFilePath();
+    CKeyID keyA = GetAddressKey("LdwLvykqj2nUH3MWcut6mtjHxVxVFC7st5");
+    CKeyID keyB = GetAddressKey("LWZR9ybwmT8vSXP6tmrBX4b6nE9o94AjQG");
+    uint256 hashBlock1 = uint256S("0x01");
+    uint256 hashBlock2 = uint256S("0x02");
+
+    {
+        COeruDB oeruDB(path, 1 << 20);
+        oeruDB.AddCertifiedAddress(keyA);
+
+        // Block 1 re-enables A and enables B; block 2 disables A
+        COeruBlockUndo undo1;
+        oeruDB.AddCertifiedAddress(keyA, &undo1);
+        oeruDB.AddCertifiedAddress(keyB, &undo1);
+        oeruDB.WriteBlockUndo(hashBlock1, undo1);
+        BOOST_CHECK(oeruDB.Flush(hashBlock1));
+
+        COeruBlockUndo undo2;
+        oeruDB.RemoveCertifiedAddress(keyA, &undo2);
+        oeruDB.WriteBlockUndo(hashBlock2, undo2);
+
+        // Undo of an unflushed block
+        BOOST_CHECK(oeruDB.UndoBlock(hashBlock2));
+        BOOST_CHECK(oeruDB.IsAddressCertified(keyA) && oeruDB.IsAddressCertified(keyB));
+        BOOST_CHECK(!oeruDB.UndoBlock(hashBlock2));
+        BOOST_CHECK(oeruDB.Flush(hashBlock1));
+    }
+
+    {
+        // Undo of a block whose record was flushed
+        COeruDB oeruDB(path, 1 << 20);
+        BOOST_CHECK(oeruDB.UndoBlock(hashBlock1));
+        BOOST_CHECK(oeruDB.IsAddressCertified(keyA));
+        BOOST_CHECK(!oeruDB.IsAddressCertified(keyB));
+        BOOST_CHECK(oeruDB.Flush(uint256()));
+        BOOST_CHECK(!oeruDB.UndoBlock(hashBlock1));
+    }
+
+    boost::filesystem::remove_all(path);
+}
 
-    COeruDB readOeruDB(tmpfile.string().c_str());
-    readOeruDB.ReadFile();
+BOOST_AUTO_TEST_CASE (oerudb_script_address_type)
+{
+    boost::filesystem::path path = GetTempFilePath();
+    CKeyID keyID = GetAddressKey("LdwLvykqj2nUH3MWcut6mtjHxVxVFC7st5");
+    CScriptID scriptID(CScript() << OP_TRUE);
+    std::string strScriptAddress = CBitcoinAddress(scriptID).ToString();
+    uint256 hashBlock = uint256S("0x01");
+
+    {
+        COeruDB oeruDB(path, 1 << 20);
+        oeruDB.AddCertifiedAddress(CBitcoinAddress(strScriptAddress).Get());
+        oeruDB.AddCertifiedAddress(keyID);
+        BOOST_CHECK(oeruDB.IsAddressCertified(scriptID));
+        BOOST_CHECK(oeruDB.Flush(uint256()));
+    }
+
+    {
+        // Script addresses are reported as script addresses after a reopen
+        COeruDB oeruDB(path, 1 << 20);
+        CertifiedSnapshotRef snapshot = oeruDB.GetCertifiedSnapshot();
+        BOOST_CHECK(snapshot->size() == 2);
+        BOOST_CHECK(std::count(snapshot->begin(), snapshot->end(), CTxDestination(scriptID)) == 1);
+        BOOST_CHECK(std::count(snapshot->begin(), snapshot->end(), CTxDestination(keyID)) == 1);
+        BOOST_CHECK(std::count(snapshot->begin(), snapshot->end(), CTxDestination(CKeyID(scriptID))) == 0);
+
+        // and after the undo of a block that removed them
+        COeruBlockUndo undo;
+        oeruDB.RemoveCertifiedAddress(scriptID, &undo);
+        oeruDB.WriteBlockUndo(hashBlock, undo);
+        BOOST_CHECK(!oeruDB.IsAddressCertified(scriptID));
+        BOOST_CHECK(oeruDB.UndoBlock(hashBlock));
+        oeruDB.PublishSnapshot();
+        snapshot = oeruDB.GetCertifiedSnapshot();
+        BOOST_CHECK(std::count(snapshot->begin(), snapshot->end(), CTxDestination(scriptID)) == 1);
+        BOOST_CHECK(CBitcoinAddress(snapshot->front()).ToString() == strScriptAddress ||
+                    CBitcoinAddress(snapshot->back()).ToString() == strScriptAddress);
+    }
+
+    boost::filesystem::remove_all(path);
+}
 
-    BOOST_CHECK(readOeruDB.NumCertifiedAddresses() == 3);
+BOOST_AUTO_TEST_CASE (oerudb_key_and_script_same_hash)
+{
+    boost::filesystem::path path = GetTempFilePath();
+    CKeyID keyID = GetAddressKey("LdwLvykqj2nUH3MWcut6mtjHxVxVFC7st5");
+    CScriptID scriptID(keyID);
+    uint256 hashBlock = uint256S("0x01");
+
+    {
+        // Certifying the script address doesn't certify the key address of the same hash
+        COeruDB oeruDB(path, 1 << 20);
+        oeruDB.AddCertifiedAddress(scriptID);
+        BOOST_CHECK(oeruDB.IsAddressCertified(scriptID));
+        BOOST_CHECK(!oeruDB.IsAddressCertified(keyID));
+        BOOST_CHECK(oeruDB.NumCertifiedAddresses() == 1);
+
+        // Both count towards activation
+        COeruBlockUndo undo;
+        oeruDB.AddCertifiedAddress(keyID, &undo);
+        BOOST_CHECK(oeruDB.NumCertifiedAddresses() == 2);
+        oeruDB.WriteBlockUndo(hashBlock, undo);
+        BOOST_CHECK(oeruDB.Flush(hashBlock));
+    }
+
+    {
+        COeruDB oeruDB(path, 1 << 20);
+        BOOST_CHECK(oeruDB.NumCertifiedAddresses() == 2);
+        BOOST_CHECK(oeruDB.IsAddressCertified(scriptID) && oeruDB.IsAddressCertified(keyID));
+
+        // Removing one leaves the other
+        oeruDB.RemoveCertifiedAddress(scriptID);
+        BOOST_CHECK(!oeruDB.IsAddressCertified(scriptID));
+        BOOST_CHECK(oeruDB.IsAddressCertified(keyID));
+        BOOST_CHECK(oeruDB.NumCertifiedAddresses() == 1);
+
+        // Undo only touches the form the block changed
+        BOOST_CHECK(oeruDB.UndoBlock(hashBlock));
+        BOOST_CHECK(!oeruDB.IsAddressCertified(keyID));
+        BOOST_CHECK(!oeruDB.IsAddressCertified(scriptID));
+        BOOST_CHECK(oeruDB.NumCertifiedAddresses() == 0);
+
+        oeruDB.AddCertifiedAddress(scriptID);
+        oeruDB.AddCertifiedAddress(keyID);
+        oeruDB.RemoveCertifiedAddress(keyID);
+        BOOST_CHECK(oeruDB.IsAddressCertified(scriptID));
+        BOOST_CHECK(!oeruDB.IsAddressCertified(keyID));
+    }
+
+    boost::filesystem::remove_all(path);
+}
 
-    // Check certified == true
-    BOOST_CHECK(readOeruDB.IsAddressCertified(CBitcoinAddress(addresses[0])) == true);
-    BOOST_CHECK(readOeruDB.IsAddressCertified(CBitcoinAddress(addresses[1])) == true);
-    BOOST_CHECK(readOeruDB.IsAddressCertified(CBitcoinAddress(addresses[2])) == true);
+BOOST_AUTO_TEST_CASE (oerudb_import_legacy_file)
+{
+    boost::filesystem::path tmpfile = GetTempFilePath();
+    {
+        std::ofstream dbfile(tmpfile.string().c_str());
+        dbfile << "LdwLvykqj2nUH3MWcut6mtjHxVxVFC7st5" << std::endl;
+        dbfile << "LWZR9ybwmT8vSXP6tmrBX4b6nE9o94AjQG" << std::endl;
+        dbfile << "not-an-address" << std::endl;
+    }
+
+    COeruDB oeruDB(GetTempFilePath(), 1 << 20, true);
+    BOOST_CHECK(oeruDB.ImportLegacyFile(tmpfile.string()));
+    BOOST_CHECK(oeruDB.NumCertifiedAddresses() == 2);
+    BOOST_CHECK(oeruDB.IsAddressCertified(GetAddressKey("LdwLvykqj2nUH3MWcut6mtjHxVxVFC7st5")) == true);
+    BOOST_CHECK(oeruDB.IsAddressCertified(GetAddressKey("LWZR9ybwmT8vSXP6tmrBX4b6nE9o94AjQG")) == true);
+
+    boost::filesystem::remove(tmpfile);
 }
 
 BOOST_AUTO_TEST_CASE (oerudb_reindex)
 {
-    COeruDB oeruDB(GetTempFilePath());
+    COeruDB oeruDB(GetTempFilePath(), 1 << 20, true);
 
     // OeruShieldFirstMasterTXHeight: 941905 on mainnet
     BOOST_CHECK(oeruDB.ShouldReindex(940000) == false);
@@ -107,7 +306,7 @@ BOOST_AUTO_TEST_CASE (oerudb_reindex)
 
     // Add one certified address, expect no reindex necessary as
     // OERUDB was presumably initialized before the first master TX
-    oeruDB.AddCertifiedAddress(CBitcoinAddress("LLUAaniHSW6eH1QQUrJ7ZAEHurkhx857f3"));
+    oeruDB.AddCertifiedAddress(GetAddressKey("LLUAaniHSW6eH1QQUrJ7ZAEHurkhx857f3"));
 
     BOOST_CHECK(oeruDB.ShouldReindex(940000) == false);
     BOOST_CHECK(oeruDB.ShouldReindex(950000) == false);
@@ -124,6 +323,56 @@ BOOST_AUTO_TEST_CASE (oerushield_is_master_key)
     BOOST_CHECK(oeruShield.IsMasterKey(CBitcoinAddress("LQHK6ejxSbjnu4XKa1XjprjmPhrtPdiJaG")) == false);
 }
 
+BOOST_AUTO_TEST_CASE (oerushield_blocks_since_last_certified)
+{
+    COeruDB oeruDB(GetTempFilePath(), 1 << 20, true);
+    COeruShield oeruShield(&oeruDB);
+
+    CBitcoinAddress certified("LaZ27rggR2KnmvVGxa3kzkoqxgDYidti2k");
+    CBitcoinAddress other("LgEHSpv22knkaSR1ZbPSaxqtXujReQykK9");
+    CKeyID certifiedKey, otherKey;
+    BOOST_CHECK(certified.GetKeyID(certifiedKey));
+    BOOST_CHECK(other.GetKeyID(otherKey));
+    oeruDB.AddCertifiedAddress(certifiedKey);
+
+    // Identification comes from the block index only, so no block is read
+    std::vector<CBlockIndex> chain(12);
+    for (size_t i = 0; i < chain.size(); i++) {
+        chain[i].nHeight = i;
+        chain[i].pprev = i > 0 ? &chain[i - 1] : NULL;
+        chain[i].nStatus = BLOCK_OERU_CHECKED;
+    }
+    chain[3].nStatus |= BLOCK_OERU_IDENTIFIED;
+    chain[3].hashOeruMiner = certifiedKey;
+    chain[5].nStatus |= BLOCK_OERU_IDENTIFIED;
+    chain[5].hashOeruMiner = otherKey;
+
+    CBlock block;
+    BOOST_CHECK_EQUAL(oeruShield.GetBlocksSinceLastCertified(&block, &chain[1]), 1);
+    BOOST_CHECK_EQUAL(oeruShield.GetBlocksSinceLastCertified(&block, &chain[3]), 0);
+    BOOST_CHECK_EQUAL(oeruShield.GetBlocksSinceLastCertified(&block, &chain[5]), 2);
+    BOOST_CHECK_EQUAL(oeruShield.GetBlocksSinceLastCertified(&block, &chain[10]), 7);
+    BOOST_CHECK_EQUAL(oeruShield.GetBlocksSinceLastCertified(&block, &chain[11]), -1);
+
+    // Certification follows the current OeruDB state
+    oeruDB.RemoveCertifiedAddress(certifiedKey);
+    oeruDB.AddCertifiedAddress(otherKey);
+    BOOST_CHECK_EQUAL(oeruShield.GetBlocksSinceLastCertified(&block, &chain[5]), 0);
+    BOOST_CHECK_EQUAL(oeruShield.GetBlocksSinceLastCertified(&block, &chain[4]), 4);
+
+    // Only the key address of an identified miner certifies its blocks
+    oeruDB.RemoveCertifiedAddress(otherKey);
+    oeruDB.AddCertifiedAddress(CScriptID(otherKey));
+    BOOST_CHECK_EQUAL(oeruShield.GetBlocksSinceLastCertified(&block, &chain[5]), 5);
+
+    // A block without an OERU coinbase is indexed as checked but not identified
+    CBlockIndex index;
+    index.nHeight = 7;
+    oeruShield.IndexBlock(&block, &index);
+    BOOST_CHECK(index.nStatus & BLOCK_OERU_CHECKED);
+    BOOST_CHECK(!(index.nStatus & BLOCK_OERU_IDENTIFIED));
+}
+
 BOOST_AUTO_TEST_CASE (oerutxout_tests)
 {
     std::vector<unsigned char> data = ParseHex("4f455255010000006d1fa8b87567e351717ced5b7c4277cffec6d11f6474b566571759133ae6c4b6d0fc034333f30f2c11bd4f7974531bf42ba87dda9be7b6004d9ed514897133d51850");
@@ -208,4 +457,24 @@ BOOST_AUTO_TEST_CASE (oerusignature_checker)
     BOOST_CHECK(sigChecker.VerifySignature(msg2, sig2, addr1) == false);
 }
 
+BOOST_AUTO_TEST_CASE (oerusignal_queue)
+{
+    // Nothing listens on port 1; the dispatcher isn't started anyway
+    COeruSignal oeruSignal("test", "127.0.0.1:1", 1, 2, 0);
+
+    // The first block queues a signal, the next ones are rate limited
+    BOOST_CHECK(oeruSignal.ExecuteOeruSignal(100) == true);
+    BOOST_CHECK(oeruSignal.ExecuteOeruSignal(200) == false);
+
+    // The backlog is bounded; signals beyond it are dropped
+    BOOST_CHECK(oeruSignal.QueueSignal("/test:1") == true);
+    BOOST_CHECK(oeruSignal.QueueSignal("/test:2") == false);
+
+    COeruSignalStats stats = oeruSignal.GetStats();
+    BOOST_CHECK(stats.nQueued == 2);
+    BOOST_CHECK(stats.nDropped == 1);
+    BOOST_CHECK(stats.nQueueSize == 2);
+    BOOST_CHECK(stats.nSent == 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
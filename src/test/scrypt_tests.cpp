@@ -13,23 +13,149 @@ BOOST_AUTO_TEST_CASE(scrypt_hashtest)
     #define HASHCOUNT 5
     const char* inputhex[HASHCOUNT] = { "020000004c1271c211717198227392b029a64a7971931d351b387bb80db027f270411e398a07046f7d4a08dd815412a8712f874a7ebf0507e3878bd24e20a3b73fd750a667d2f451eac7471b00de6659", "0200000011503ee6a855e900c00cfdd98f5f55fffeaee9b6bf55bea9b852d9de2ce35828e204eef76acfd36949ae56d1fbe81c1ac9c0209e6331ad56414f9072506a77f8c6faf551eac7471b00389d01", "02000000a72c8a177f523946f42f22c3e86b8023221b4105e8007e59e81f6beb013e29aaf635295cb9ac966213fb56e046dc71df5b3f7f67ceaeab24038e743f883aff1aaafaf551eac7471b0166249b", "010000007824bc3a8a1b4628485eee3024abd8626721f7f870f8ad4d2f33a27155167f6a4009d1285049603888fe85a84b6c803a53305a8d497965a5e896e1a00568359589faf551eac7471b0065434e", "0200000050bfd4e4a307a8cb6ef4aef69abc5c0f2d579648bd80d7733e1ccc3fbc90ed664a7f74006cb11bde87785f229ecd366c2d4e44432832580e0608c579e4cb76f383f7f551eac7471b00c36982" };
     const char* expected[HASHCOUNT] = { "00000000002bef4107f882f6115e0b01f348d21195dacd3582aa2dabd7985806" , "00000000003a0d11bdd5eb634e08b7feddcfbbf228ed35d250daf19f1c88fc94", "00000000000b40f895f288e13244728a6c2d9d59d8aff29c65f8dd5114a8ca81", "00000000003007005891cd4923031e99d8e8d72f6e8e7edc6a86181897e105fe", "000000000018f0b426a4afc7130ccb47fa02af730d345b4fe7c7724d3800ec8c" };
-#if defined(USE_SSE2)
-    scrypt_detect_sse2();
-#endif
+    scrypt_detect();
     uint256 scrypthash;
     std::vector<unsigned char> inputbytes;
     char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
     for (int i = 0; i < HASHCOUNT; i++) {
         inputbytes = ParseHex(inputhex[i]);
-#if defined(USE_SSE2)
-        // Test SSE2 scrypt
-        scrypt_1024_1_1_256_sp_sse2((const char*)&inputbytes[0], BEGIN(scrypthash), scratchpad);
+        // Test the detected scrypt
+        scrypt_1024_1_1_256_sp((const char*)&inputbytes[0], BEGIN(scrypthash), scratchpad);
         BOOST_CHECK_EQUAL(scrypthash.ToString().c_str(), expected[i]);
-#endif
+
         // Test generic scrypt
         scrypt_1024_1_1_256_sp_generic((const char*)&inputbytes[0], BEGIN(scrypthash), scratchpad);
         BOOST_CHECK_EQUAL(scrypthash.ToString().c_str(), expected[i]);
     }
 }
 
+/** Fill n 80-byte headers: the known-answer headers first, then the same headers with other nonces. */
+static std::vector<unsigned char> ScryptTestHeaders(size_t n)
+{
+    const char* inputhex[] = { "020000004c1271c211717198227392b029a64a7971931d351b387bb80db027f270411e398a07046f7d4a08dd815412a8712f874a7ebf0507e3878bd24e20a3b73fd750a667d2f451eac7471b00de6659", "0200000011503ee6a855e900c00cfdd98f5f55fffeaee9b6bf55bea9b852d9de2ce35828e204eef76acfd36949ae56d1fbe81c1ac9c0209e6331ad56414f9072506a77f8c6faf551eac7471b00389d01", "02000000a72c8a177f523946f42f22c3e86b8023221b4105e8007e59e81f6beb013e29aaf635295cb9ac966213fb56e046dc71df5b3f7f67ceaeab24038e743f883aff1aaafaf551eac7471b0166249b", "010000007824bc3a8a1b4628485eee3024abd8626721f7f870f8ad4d2f33a27155167f6a4009d1285049603888fe85a84b6c803a53305a8d497965a5e896e1a00568359589faf551eac7471b0065434e", "0200000050bfd4e4a307a8cb6ef4aef69abc5c0f2d579648bd80d7733e1ccc3fbc90ed664a7f74006cb11bde87785f229ecd366c2d4e44432832580e0608c579e4cb76f383f7f551eac7471b00c36982" };
+    std::vector<unsigned char> headers;
+    for (size_t i = 0; i < n; i++) {
+        std::vector<unsigned char> header = ParseHex(inputhex[i % 5]);
+        header[76] ^= (unsigned char)(i / 5);
+        headers.insert(headers.end(), header.begin(), header.end());
+    }
+    return headers;
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_kernels)
+{
+    // Every kernel this CPU supports must match the generic implementation in every lane
+    const size_t count = 32;
+    std::vector<unsigned char> headers = ScryptTestHeaders(count);
+    std::vector<uint256> expected(count);
+    char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
+    for (size_t i = 0; i < count; i++)
+        scrypt_1024_1_1_256_sp_generic((const char*)&headers[80 * i], BEGIN(expected[i]), scratchpad);
+    BOOST_CHECK_EQUAL(expected[0].ToString(), "00000000002bef4107f882f6115e0b01f348d21195dacd3582aa2dabd7985806");
+
+    std::vector<ScryptKernel> kernels = scrypt_supported_kernels();
+    BOOST_CHECK(kernels[0].hash == &scrypt_1024_1_1_256_sp_generic);
+    for (size_t k = 0; k < kernels.size(); k++) {
+        BOOST_TEST_MESSAGE("Testing scrypt kernel " << kernels[k].name);
+        std::vector<char> widescratchpad(scrypt_scratchpad_size(kernels[k].lanes));
+        std::vector<uint256> hashes(count);
+        for (size_t i = 0; i + kernels[k].lanes <= count; i += kernels[k].lanes)
+            kernels[k].hash((const char*)&headers[80 * i], BEGIN(hashes[i]), &widescratchpad[0]);
+        for (size_t i = 0; i < count - count % kernels[k].lanes; i++)
+            BOOST_CHECK_MESSAGE(hashes[i] == expected[i], kernels[k].name << " lane " << i % kernels[k].lanes);
+
+        // The mixing step alone, wrapped in the two PBKDF2 steps, is the same hash
+        std::vector<uint8_t> B(128 * kernels[k].lanes);
+        for (size_t l = 0; l < kernels[k].lanes; l++)
+            PBKDF2_SHA256(&headers[80 * l], 80, &headers[80 * l], 80, 1, &B[128 * l], 128);
+        kernels[k].core(&B[0], &widescratchpad[0]);
+        for (size_t l = 0; l < kernels[k].lanes; l++) {
+            uint256 hash;
+            PBKDF2_SHA256(&headers[80 * l], 80, &B[128 * l], 128, 1, hash.begin(), 32);
+            BOOST_CHECK_MESSAGE(hash == expected[l], kernels[k].name << " core lane " << l);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_multi)
+{
+    // Batches of every size up to two full 16-way rounds plus remainder
+    const size_t count = 37;
+    std::vector<unsigned char> headers = ScryptTestHeaders(count);
+    std::vector<uint256> expected(count);
+    char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
+    for (size_t i = 0; i < count; i++)
+        scrypt_1024_1_1_256_sp_generic((const char*)&headers[80 * i], BEGIN(expected[i]), scratchpad);
+
+    BOOST_TEST_MESSAGE("Using scrypt kernels " << scrypt_detect());
+    for (size_t n = 0; n <= count; n += (n < 9 ? 1 : 7)) {
+        std::vector<uint256> hashes(count);
+        scrypt_1024_1_1_256_sp_multi((const char*)&headers[0], BEGIN(hashes[0]), n);
+        for (size_t i = 0; i < count; i++)
+            BOOST_CHECK(hashes[i] == (i < n ? expected[i] : uint256()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_context)
+{
+    const size_t count = 21;
+    std::vector<unsigned char> headers = ScryptTestHeaders(count);
+    std::vector<uint256> expected(count);
+    char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
+    for (size_t i = 0; i < count; i++)
+        scrypt_1024_1_1_256_sp_generic((const char*)&headers[80 * i], BEGIN(expected[i]), scratchpad);
+    scrypt_detect();
+
+    // A context starts empty, serves single hashes and then grows for a wide batch
+    CScryptContext context;
+    uint256 hash;
+    for (size_t i = 0; i < 5; i++) {
+        context.Hash((const char*)&headers[80 * i], BEGIN(hash));
+        BOOST_CHECK(hash == expected[i]);
+    }
+    std::vector<uint256> hashes(count);
+    context.HashMulti((const char*)&headers[0], BEGIN(hashes[0]), count);
+    BOOST_CHECK(hashes == expected);
+    context.Hash((const char*)&headers[80 * 7], BEGIN(hash));
+    BOOST_CHECK(hash == expected[7]);
+
+    // The thread-local context backs the allocation-free scrypt_1024_1_1_256()
+    scrypt_1024_1_1_256((const char*)&headers[80 * 3], BEGIN(hash));
+    BOOST_CHECK(hash == expected[3]);
+    BOOST_CHECK(&CScryptContext::ThreadLocal() == &CScryptContext::ThreadLocal());
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_midstate)
+{
+    // Headers i, i + 5, i + 10, ... share their first 64 bytes and differ in the nonce;
+    // 17 of each fill the widest (16-lane) kernel and leave a partial batch
+    const size_t count = 85;
+    std::vector<unsigned char> headers = ScryptTestHeaders(count);
+    std::vector<uint256> expected(count);
+    char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
+    for (size_t i = 0; i < count; i++)
+        scrypt_1024_1_1_256_sp_generic((const char*)&headers[80 * i], BEGIN(expected[i]), scratchpad);
+    BOOST_CHECK_EQUAL(expected[0].ToString(), "00000000002bef4107f882f6115e0b01f348d21195dacd3582aa2dabd7985806");
+    scrypt_detect();
+
+    CScryptContext context;
+    for (size_t h = 0; h < 5; h++) {
+        CScryptMidstate midstate((const char*)&headers[80 * h]);
+
+        // Known-answer header on its own
+        uint256 hash;
+        midstate.Hash((const char*)&headers[80 * h + 64], BEGIN(hash));
+        BOOST_CHECK(hash == expected[h]);
+
+        // and batched with its other nonces, through every kernel width
+        std::vector<char> tails;
+        for (size_t i = h; i < count; i += 5)
+            tails.insert(tails.end(), &headers[80 * i + 64], &headers[80 * i + 80]);
+        std::vector<uint256> hashes(tails.size() / 16);
+        context.HashMulti(midstate, &tails[0], BEGIN(hashes[0]), hashes.size());
+        for (size_t i = 0; i < hashes.size(); i++)
+            BOOST_CHECK(hashes[i] == expected[h + 5 * i]);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
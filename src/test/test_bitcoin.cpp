@@ -58,7 +58,8 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         mempool.setSanityCheck(1.0);
         pblocktree = new CBlockTreeDB(1 << 20, true);
         pcoinsdbview = new CCoinsViewDB(1 << 23, true);
-        pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+        pcoinsSnapshot = new CCoinsViewSnapshot(pcoinsdbview, DEFAULT_BACKGROUND_FLUSH);
+        pcoinsTip = new CCoinsViewCache(pcoinsSnapshot, COINS_TIP_SHARDS);
         InitBlockIndex(chainparams);
         {
             CValidationState state;
@@ -66,8 +67,11 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
             BOOST_CHECK(ok);
         }
         nScriptCheckThreads = 3;
-        for (int i=0; i < nScriptCheckThreads-1; i++)
+        for (int i=0; i < nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadPoWCheck);
+            threadGroup.create_thread(&ThreadCoinsPrefetch);
+        }
         RegisterNodeSignals(GetNodeSignals());
 }
 
@@ -78,6 +82,7 @@ TestingSetup::~TestingSetup()
         threadGroup.join_all();
         UnloadBlockIndex();
         delete pcoinsTip;
+        delete pcoinsSnapshot;
         delete pcoinsdbview;
         delete pblocktree;
         boost::filesystem::remove_all(pathTemp);
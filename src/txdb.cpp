@@ -7,8 +7,11 @@
 
 #include "chainparams.h"
 #include "hash.h"
+#include "memusage.h"
 #include "pow.h"
 #include "uint256.h"
+#include "util.h"
+#include "utiltime.h"
 
 #include <stdint.h>
 
@@ -27,7 +30,7 @@ static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
 
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, GetDBProfile("chainstate"))
 {
 }
 
@@ -46,18 +49,24 @@ uint256 CCoinsViewDB::GetBestBlock() const {
     return hashBestChain;
 }
 
+/** Add the change in a cache entry to batch. Returns false for clean entries, which are skipped. */
+static bool BatchWriteEntry(CDBBatch &batch, const CCoinsMap::value_type &entry) {
+    if (!(entry.second.flags & CCoinsCacheEntry::DIRTY))
+        return false;
+    if (entry.second.coins.IsPruned())
+        batch.Erase(make_pair(DB_COINS, entry.first));
+    else
+        batch.Write(make_pair(DB_COINS, entry.first), entry.second.coins);
+    return true;
+}
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
-        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            if (it->second.coins.IsPruned())
-                batch.Erase(make_pair(DB_COINS, it->first));
-            else
-                batch.Write(make_pair(DB_COINS, it->first), it->second.coins);
+        if (BatchWriteEntry(batch, *it))
             changed++;
-        }
         count++;
         CCoinsMap::iterator itOld = it++;
         mapCoins.erase(itOld);
@@ -69,7 +78,145 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+bool CCoinsViewDB::WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    CDBBatch batch(db);
+    size_t changed = 0;
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
+        if (BatchWriteEntry(batch, *it))
+            changed++;
+    }
+    if (!hashBlock.IsNull())
+        batch.Write(DB_BEST_BLOCK, hashBlock);
+
+    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)mapCoins.size());
+    return db.WriteBatch(batch);
+}
+
+CCoinsViewSnapshot::CCoinsViewSnapshot(CCoinsViewDB *dbIn, bool fBackgroundIn, const boost::function<bool()>& fnWrittenIn) :
+    CCoinsViewBacked(dbIn), db(dbIn), fBackground(fBackgroundIn), fnWritten(fnWrittenIn),
+    cachedSnapshotUsage(0), fPending(false), fWriting(false), fFailed(false), fStop(false)
+{
+    if (fBackground)
+        thread = boost::thread(boost::bind(&TraceThread<boost::function<void()> >, "coinsflush", boost::function<void()>(boost::bind(&CCoinsViewSnapshot::Thread, this))));
+}
+
+CCoinsViewSnapshot::~CCoinsViewSnapshot()
+{
+    Sync();
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fStop = true;
+    }
+    cond.notify_all();
+    if (thread.joinable())
+        thread.join();
+}
+
+bool CCoinsViewSnapshot::GetCoins(const uint256 &txid, CCoins &coins) const {
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        CCoinsMap::const_iterator it = mapSnapshot.find(txid);
+        if (it != mapSnapshot.end()) {
+            coins = it->second.coins;
+            return true;
+        }
+    }
+    // Entries that are not in the snapshot are not touched by its write
+    return db->GetCoins(txid, coins);
+}
+
+bool CCoinsViewSnapshot::HaveCoins(const uint256 &txid) const {
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        CCoinsMap::const_iterator it = mapSnapshot.find(txid);
+        if (it != mapSnapshot.end())
+            return !it->second.coins.IsPruned();
+    }
+    return db->HaveCoins(txid);
+}
+
+uint256 CCoinsViewSnapshot::GetBestBlock() const {
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (fPending && !hashSnapshot.IsNull())
+            return hashSnapshot;
+    }
+    return db->GetBestBlock();
+}
+
+bool CCoinsViewSnapshot::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    if (!Sync())
+        return false;
+    if (!fBackground)
+        return db->BatchWrite(mapCoins, hashBlock) && (!fnWritten || fnWritten());
+
+    boost::unique_lock<boost::mutex> lock(cs);
+    // The cache hands over its whole map; clean entries are skipped by the write.
+    mapSnapshot.swap(mapCoins);
+    hashSnapshot = hashBlock;
+    cachedSnapshotUsage = memusage::DynamicUsage(mapSnapshot);
+    for (CCoinsMap::const_iterator it = mapSnapshot.begin(); it != mapSnapshot.end(); it++)
+        cachedSnapshotUsage += it->second.coins.DynamicMemoryUsage();
+    fPending = true;
+    cond.notify_all();
+    return true;
+}
+
+void CCoinsViewSnapshot::WriteSnapshot(boost::unique_lock<boost::mutex>& lock) {
+    fWriting = true;
+    lock.unlock();
+    int64_t nStart = GetTimeMicros();
+    bool fOk = false;
+    try {
+        fOk = db->WriteCoins(mapSnapshot, hashSnapshot) && (!fnWritten || fnWritten());
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+    LogPrint("bench", "- Write coins snapshot: %.2fms [%u entries]\n", 0.001 * (GetTimeMicros() - nStart), (unsigned int)mapSnapshot.size());
+    lock.lock();
+    fWriting = false;
+    if (fOk) {
+        // Readers fall through to the database from here on
+        mapSnapshot.clear();
+        cachedSnapshotUsage = 0;
+        fPending = false;
+    } else {
+        // Keep serving the snapshot; the owner shuts down on the next flush
+        LogPrintf("%s: failed to write the coins snapshot to the database\n", __func__);
+        fFailed = true;
+    }
+    cond.notify_all();
+}
+
+void CCoinsViewSnapshot::Thread() {
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (true) {
+        while (!fStop && !(fPending && !fWriting && !fFailed))
+            cond.wait(lock);
+        if (fStop)
+            return;
+        WriteSnapshot(lock);
+    }
+}
+
+bool CCoinsViewSnapshot::Sync() {
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (fPending && !fFailed)
+        cond.wait(lock);
+    return !fFailed;
+}
+
+bool CCoinsViewSnapshot::Failed() const {
+    boost::unique_lock<boost::mutex> lock(cs);
+    return fFailed;
+}
+
+size_t CCoinsViewSnapshot::DynamicMemoryUsage() const {
+    boost::unique_lock<boost::mutex> lock(cs);
+    return cachedSnapshotUsage;
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, GetDBProfile("index")) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -198,15 +345,13 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
                 pindexNew->nNonce         = diskindex.nNonce;
                 pindexNew->nStatus        = diskindex.nStatus;
                 pindexNew->nTx            = diskindex.nTx;
+                pindexNew->hashPoW        = diskindex.hashPoW;
+                pindexNew->hashOeruMiner  = diskindex.hashOeruMiner;
 
-                // Litecoin: Disable PoW Sanity check while loading block index from disk.
-                // We use the sha256 hash for the block index for performance reasons, which is recorded for later use.
-                // CheckProofOfWork() uses the scrypt hash which is discarded after a block is accepted.
-                // While it is technically feasible to verify the PoW, doing so takes several minutes as it
-                // requires recomputing every PoW hash during every Litecoin startup.
-                // We opt instead to simply trust the data that is on your local disk.
-                //if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, Params().GetConsensus()))
-                //    return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
+                // The block index is keyed by the sha256 hash, while CheckProofOfWork() needs the scrypt
+                // hash. Recomputing scrypt for every header here would add minutes to every startup, so
+                // the index is trusted as loaded; LoadBlockIndexDB checks any stored scrypt hashes against
+                // nBits, and -checkpowonload recomputes all of them in parallel.
 
                 pcursor->Next();
             } else {
@@ -16,6 +16,9 @@
 #include <vector>
 
 #include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 class CBlockIndex;
 class CCoinsViewDBCursor;
@@ -73,9 +76,65 @@ public:
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! Like BatchWrite, but leaves mapCoins intact so it can still be read meanwhile
+    bool WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock);
     CCoinsViewCursor *Cursor() const;
 };
 
+/**
+ * Layer between the coins cache and the coin database that takes a flushed
+ * batch of changes as a snapshot and, in background mode, writes it to the
+ * database on its own thread. The cache above can be emptied and filled
+ * again right away: reads look in the snapshot before the database until the
+ * write is committed. A new snapshot is only taken once the previous one is
+ * written, so the database never skips a batch.
+ *
+ * Without background mode, BatchWrite writes through synchronously as before.
+ * GetCoins and HaveCoins are thread-safe; BatchWrite and Sync must be called
+ * by the owner of the cache above.
+ */
+class CCoinsViewSnapshot : public CCoinsViewBacked
+{
+private:
+    CCoinsViewDB *db;
+    const bool fBackground;
+    //! Called after each snapshot is committed, on the thread that wrote it
+    const boost::function<bool()> fnWritten;
+
+    mutable boost::mutex cs;
+    boost::condition_variable cond;
+    //! Not modified while fPending, so the writer reads it without cs
+    CCoinsMap mapSnapshot;
+    uint256 hashSnapshot;
+    size_t cachedSnapshotUsage;
+    bool fPending;
+    bool fWriting;
+    bool fFailed;
+    bool fStop;
+    boost::thread thread;
+
+    void WriteSnapshot(boost::unique_lock<boost::mutex>& lock);
+    void Thread();
+
+public:
+    CCoinsViewSnapshot(CCoinsViewDB *dbIn, bool fBackgroundIn, const boost::function<bool()>& fnWrittenIn = boost::function<bool()>());
+    ~CCoinsViewSnapshot();
+
+    bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    bool HaveCoins(const uint256 &txid) const;
+    uint256 GetBestBlock() const;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+
+    //! Whether BatchWrite hands the changes to the background thread
+    bool IsBackground() const { return fBackground; }
+    //! Wait until the pending snapshot, if any, is written. Returns false if a write failed.
+    bool Sync();
+    //! Whether a background write has failed; the database is behind the cache from then on
+    bool Failed() const;
+    //! Memory held by the snapshot that is still being written
+    size_t DynamicMemoryUsage() const;
+};
+
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
 class CCoinsViewDBCursor: public CCoinsViewCursor
 {
@@ -21,6 +21,8 @@
 #include "boost/multi_index/ordered_index.hpp"
 #include "boost/multi_index/hashed_index.hpp"
 
+#include <boost/signals2/signal.hpp>
+
 class CAutoFile;
 class CBlockIndex;
 
@@ -464,6 +466,13 @@ public:
     typedef indexed_transaction_set::nth_index<0>::type::iterator txiter;
     std::vector<std::pair<uint256, txiter> > vTxHashes; //!< All tx witness hashes/entries in mapTx, in random order
 
+    /** Called with cs held, once an entry is fully linked into mapTx */
+    boost::signals2::signal<void (const CTxMemPoolEntry&)> NotifyEntryAdded;
+    /** Called with cs held, just before an entry is removed from mapTx */
+    boost::signals2::signal<void (const CTxMemPoolEntry&)> NotifyEntryRemoved;
+    /** Called with cs held after PrioritiseTransaction changed an entry's modified fee */
+    boost::signals2::signal<void (const CTxMemPoolEntry&)> NotifyEntryPrioritised;
+
     struct CompareIteratorByHash {
         bool operator()(const txiter &a, const txiter &b) const {
             return a->GetTx().GetHash() < b->GetTx().GetHash();